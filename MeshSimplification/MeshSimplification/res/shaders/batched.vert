@@ -0,0 +1,53 @@
+#version 430 core
+
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoord;
+layout (location = 3) in uint aDrawId; // Per instance, the base instance of the draw command
+layout (location = 4) in vec3 aMorphPos; // Position and normal at the next coarser LOD level
+layout (location = 5) in vec3 aMorphNormal;
+
+out vec3 fragPos;
+out vec3 normal;
+out vec2 texCoord;
+flat out float materialShininess;
+
+layout (std140) uniform Camera
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+};
+
+// Matches MeshBatch::DrawData
+struct DrawData
+{
+    mat4 model;
+    mat3 normalMatrix; // Inverse transpose of model, computed on the CPU
+    uint material;
+    float morphFactor; // 0 draws this level, 1 looks like the next coarser one
+};
+
+layout (std430, binding = 0) readonly buffer DrawBuffer
+{
+    DrawData draws[];
+};
+
+layout (std430, binding = 1) readonly buffer MaterialBuffer
+{
+    vec4 materials[]; // x: shininess
+};
+
+void main()
+{
+    mat4 model = draws[aDrawId].model;
+    float morphFactor = draws[aDrawId].morphFactor;
+    vec3 position = mix(aPos, aMorphPos, morphFactor);
+
+    fragPos = vec3(model * vec4(position, 1.0));
+    normal = draws[aDrawId].normalMatrix * mix(aNormal, aMorphNormal, morphFactor);
+    texCoord = aTexCoord;
+    materialShininess = materials[draws[aDrawId].material].x;
+
+    gl_Position = projection * view * model * vec4(position, 1.0);
+}
@@ -16,16 +16,18 @@ struct DirLight
     vec3 specular;
 };
 
+// Members are ordered so each vec3 shares its 16 bytes with a float in the std140 layout (see UniformBlocks.h)
 struct PointLight
 {    
     vec3 position;
-    
     float constant;
-    float linear;
-    float quadratic;  
 
     vec3 ambient;
+    float linear;
+
     vec3 diffuse;
+    float quadratic;
+
     vec3 specular;
 };
 #define NR_POINT_LIGHTS 2
@@ -53,11 +55,29 @@ in vec3 fragPos;
 in vec3 normal;
 in vec2 texCoord;
 
+layout (std140) uniform Camera
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+};
+
+layout (std140) uniform Lights
+{
+    DirLight dirLight;
+    PointLight pointLights[NR_POINT_LIGHTS];
+};
+
 uniform Material material;
-uniform DirLight dirLight;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
 uniform SpotLight spotLight;
-uniform vec3 viewPos;
+
+#ifdef BATCHED
+// Batched draws read their material from a buffer in the vertex shader
+flat in float materialShininess;
+#define SHININESS materialShininess
+#else
+#define SHININESS material.shininess
+#endif
 
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
 {
@@ -67,7 +87,7 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
 
     // specular shading
     vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), SHININESS);
 
     // combine results
     vec3 ambient = light.ambient;// * vec3(texture(material.diffuse, texCoord));
@@ -85,7 +105,7 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
 
     // specular shading
     vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), SHININESS);
 
     // attenuation
     float distance = length(light.position - fragPos);
@@ -116,7 +136,7 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
 
         // specular shading
         vec3 reflectDir = reflect(-lightDir, normal);
-        float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+        float spec = pow(max(dot(viewDir, reflectDir), 0.0), SHININESS);
 
         // attenuation
         float distance = length(light.position - fragPos);
@@ -3,20 +3,31 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoord;
+layout (location = 4) in vec3 aMorphPos; // Position and normal at the next coarser LOD level
+layout (location = 5) in vec3 aMorphNormal;
 
 out vec3 fragPos;
 out vec3 normal;
 out vec2 texCoord;
 
-uniform mat4 projection;
-uniform mat4 view;
+layout (std140) uniform Camera
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+};
+
 uniform mat4 model;
+uniform mat3 normalMatrix; // Inverse transpose of the model matrix, computed once per draw on the CPU
+uniform float morphFactor; // 0 draws this level, 1 looks like the next coarser one
 
 void main()
 {
-    fragPos = vec3(model * vec4(aPos, 1.0));
-    normal = mat3(transpose(inverse(model))) * aNormal; // Recalculate normal according to scale
+    vec3 position = mix(aPos, aMorphPos, morphFactor);
+
+    fragPos = vec3(model * vec4(position, 1.0));
+    normal = normalMatrix * mix(aNormal, aMorphNormal, morphFactor);
     texCoord = aTexCoord;
 
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = projection * view * model * vec4(position, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,47 @@
+#version 430 core
+
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoord;
+
+out vec3 fragPos;
+out vec3 normal;
+out vec2 texCoord;
+
+layout (std140) uniform Camera
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+};
+
+// Matches BenchmarkScene::InstanceData
+struct Instance
+{
+    mat4 model;
+    mat3 normalMatrix; // Inverse transpose of model, computed on the CPU
+};
+
+// Instances of all LOD levels, each level's draw starts at its own offset
+layout (std430, binding = 2) readonly buffer InstanceBuffer
+{
+    Instance instances[];
+};
+
+uniform uint instanceOffset;
+
+void main()
+{
+    mat4 model = instances[instanceOffset + gl_InstanceID].model;
+
+    fragPos = vec3(model * vec4(aPos, 1.0));
+#ifdef PER_VERTEX_NORMAL_MATRIX
+    // Old path, only kept to measure the cost of inverting per vertex in the benchmark
+    normal = mat3(transpose(inverse(model))) * aNormal;
+#else
+    normal = instances[instanceOffset + gl_InstanceID].normalMatrix * aNormal;
+#endif
+    texCoord = aTexCoord;
+
+    gl_Position = projection * view * model * vec4(aPos, 1.0);
+}
@@ -0,0 +1,194 @@
+#include "BenchmarkScene.h"
+
+#include <glm/gtc/matrix_inverse.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+BenchmarkScene::BenchmarkScene()
+{
+    instanceBuffer = GLBuffer::create();
+}
+
+void BenchmarkScene::Draw(Shader& shader, Model& model, const glm::mat4& baseMatrix, const glm::vec3& cameraPos, float fovY, float viewportHeight, const Frustum* frustum)
+{
+    int levels = model.lodCount();
+    lodInstances.resize(levels);
+    for (std::vector<glm::mat4>& instances : lodInstances)
+        instances.clear();
+    instancesCulled = 0;
+
+    // The instances only differ by a translation, so their bounding spheres have the same world radius
+    float scale = std::max(glm::length(glm::vec3(baseMatrix[0])), std::max(glm::length(glm::vec3(baseMatrix[1])), glm::length(glm::vec3(baseMatrix[2]))));
+    float radius = model.boundsRadius * scale;
+
+    // Place the instances and bucket them by the level they use
+    for (int row = 0; row < rows; row++)
+    {
+        for (int column = 0; column < columns; column++)
+        {
+            glm::mat4 matrix = glm::translate(glm::mat4(1.0f), glm::vec3(column * spacing, 0.0f, -row * spacing)) * baseMatrix;
+
+            if (frustum && !frustum->intersectsSphere(glm::vec3(matrix * glm::vec4(model.boundsCenter, 1.0f)), radius))
+            {
+                instancesCulled++;
+                continue;
+            }
+
+            int lod = 0;
+            if (policy == LOD_POLICY_PER_COLUMN)
+                lod = column % levels;
+            else if (policy == LOD_POLICY_SCREEN_SPACE)
+                lod = model.coarsestLodWithin(model.pixelsPerUnit(matrix, cameraPos, fovY, viewportHeight), pixelThreshold);
+
+            lodInstances[lod].push_back(matrix);
+        }
+    }
+
+    // All instances go into one buffer, each level reads its own range
+    // The instances only differ by a translation, so they share the normal matrix, inverted once here instead of per vertex
+    InstanceData instance;
+    instance.normalMatrix = glm::mat3x4(glm::inverseTranspose(glm::mat3(baseMatrix)));
+
+    instanceData.clear();
+    for (const std::vector<glm::mat4>& instances : lodInstances)
+    {
+        for (const glm::mat4& matrix : instances)
+        {
+            instance.model = matrix;
+            instanceData.push_back(instance);
+        }
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBuffer);
+    if (instanceData.size() > instanceCapacity)
+    {
+        instanceCapacity = instanceData.size();
+        glBufferData(GL_SHADER_STORAGE_BUFFER, instanceCapacity * sizeof(InstanceData), nullptr, GL_DYNAMIC_DRAW);
+    }
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, instanceData.size() * sizeof(InstanceData), instanceData.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BENCHMARK_INSTANCE_BUFFER_BINDING, instanceBuffer);
+
+    drawCalls = 0;
+    instancesDrawn = 0;
+    trianglesDrawn = 0;
+    verticesDrawn = 0;
+
+    gpuTimer.beginFrame(levels + 1);
+    GLint offsetLocation = shader.getUniformLocation("instanceOffset");
+    unsigned int offset = 0;
+    for (int lod = 0; lod < levels; lod++)
+    {
+        gpuTimer.mark(lod);
+
+        unsigned int count = static_cast<unsigned int>(lodInstances[lod].size());
+        if (count == 0)
+            continue;
+
+        glUniform1ui(offsetLocation, offset);
+        for (Mesh& mesh : model.lodMeshes(lod))
+        {
+            mesh.DrawInstanced(shader, count);
+            drawCalls++;
+            verticesDrawn += mesh.vertices.size() * count;
+        }
+
+        instancesDrawn += count;
+        trianglesDrawn += static_cast<size_t>(model.lodFaceCount(lod)) * count;
+        offset += count;
+    }
+    gpuTimer.mark(levels);
+    gpuTimer.endFrame();
+}
+
+void BenchmarkScene::recordFrame(float frameTime)
+{
+    // Rolling window of frame times and triangle counts
+    if (frameTimes.size() < BENCHMARK_HISTORY)
+    {
+        frameTimes.push_back(frameTime);
+        triangleHistory.push_back(trianglesDrawn);
+    }
+    else
+    {
+        timeSum -= frameTimes[frameNext];
+        triangleSum -= static_cast<double>(triangleHistory[frameNext]);
+        frameTimes[frameNext] = frameTime;
+        triangleHistory[frameNext] = trianglesDrawn;
+    }
+    frameNext = (frameNext + 1) % BENCHMARK_HISTORY;
+    timeSum += frameTime;
+    triangleSum += static_cast<double>(trianglesDrawn);
+
+    if (recordFramesLeft > 0)
+    {
+        recordTimes.push_back(frameTime);
+        recordTriangles += static_cast<double>(trianglesDrawn);
+        recordVertices += static_cast<double>(verticesDrawn);
+        recordDraws += drawCalls;
+        if (--recordFramesLeft == 0)
+            writeRecording();
+    }
+}
+
+float BenchmarkScene::averageFrameTime() const
+{
+    return frameTimes.empty() ? 0.0f : static_cast<float>(timeSum / frameTimes.size() * 1000.0);
+}
+
+float BenchmarkScene::percentileFrameTime(float percentile) const
+{
+    if (frameTimes.empty())
+        return 0.0f;
+
+    std::vector<float> sorted(frameTimes);
+    size_t n = static_cast<size_t>(percentile / 100.0f * (sorted.size() - 1) + 0.5f);
+    std::nth_element(sorted.begin(), sorted.begin() + n, sorted.end());
+    return sorted[n] * 1000.0f;
+}
+
+double BenchmarkScene::trianglesPerSecond() const
+{
+    return timeSum > 0.0 ? triangleSum / timeSum : 0.0;
+}
+
+void BenchmarkScene::startRecording(int frames, const std::string& csvPath)
+{
+    if (frames <= 0)
+        return;
+
+    recordFrames = frames;
+    recordFramesLeft = frames;
+    recordPath = csvPath;
+    recordTimes.clear();
+    recordTriangles = 0.0;
+    recordVertices = 0.0;
+    recordDraws = 0;
+}
+
+void BenchmarkScene::writeRecording()
+{
+    double total = 0.0;
+    for (float time : recordTimes)
+        total += time;
+
+    std::sort(recordTimes.begin(), recordTimes.end());
+    float median = recordTimes[recordTimes.size() / 2] * 1000.0f;
+    float p95 = recordTimes[static_cast<size_t>(0.95f * (recordTimes.size() - 1))] * 1000.0f;
+
+    // Header only for a new file, so runs with different settings can be collected in one table
+    bool newFile = !std::ifstream(recordPath).good();
+    std::ofstream file(recordPath, std::ios::app);
+    if (newFile)
+        file << "rows,columns,policy,pixel_threshold,normal_matrix,frames,avg_frame_ms,median_frame_ms,p95_frame_ms,triangles_per_second,vertices_per_second,draws_per_frame\n";
+
+    const char* policyNames[] = { "finest", "per_column", "screen_space" };
+    file << rows << "," << columns << "," << policyNames[policy] << "," << pixelThreshold << ","
+        << (perVertexNormalMatrix ? "per_vertex" : "per_instance") << "," << recordFrames << ","
+        << total / recordTimes.size() * 1000.0 << "," << median << "," << p95 << ","
+        << recordTriangles / total << "," << recordVertices / total << "," << static_cast<double>(recordDraws) / recordFrames << "\n";
+
+    std::cout << "Benchmark written to " << recordPath << std::endl;
+}
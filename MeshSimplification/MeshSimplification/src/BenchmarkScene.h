@@ -0,0 +1,99 @@
+#ifndef BENCHMARKSCENE_H
+#define BENCHMARKSCENE_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+#include "GLResource.h"
+#include "GpuTimer.h"
+#include "Model.h"
+#include "Shader.h"
+
+// Shader storage binding point of the instance transforms in res/shaders/instanced.vert
+const GLuint BENCHMARK_INSTANCE_BUFFER_BINDING = 2;
+// Number of frame times kept for the statistics
+const int BENCHMARK_HISTORY = 240;
+
+// How each instance of the grid picks its LOD level
+enum LodPolicy
+{
+	LOD_POLICY_FINEST,       // Everything at full detail
+	LOD_POLICY_PER_COLUMN,   // Column c uses level c, for comparing levels side by side
+	LOD_POLICY_SCREEN_SPACE  // Coarsest level under the pixel threshold, per instance
+};
+
+// Draws a rows x columns grid of instances of a model across its LOD levels with one instanced
+// draw per mesh and level, and collects frame time, triangle throughput and draw counts.
+class BenchmarkScene
+{
+public:
+	int rows = 10;
+	int columns = 10;
+	float spacing = 1.5f; // Distance between instances in world units
+	LodPolicy policy = LOD_POLICY_PER_COLUMN;
+	float pixelThreshold = 1.0f;
+	bool perVertexNormalMatrix = false; // Set when drawing with the shader that inverts the model matrix per vertex, for comparison
+
+	// Statistics of the last frame
+	size_t drawCalls = 0;
+	size_t instancesDrawn = 0;
+	size_t trianglesDrawn = 0;
+	size_t verticesDrawn = 0; // Vertex shader invocations, ignoring the post transform cache
+	size_t instancesCulled = 0;
+
+	BenchmarkScene();
+
+	// baseMatrix places the model at the first grid cell, the grid extends along +x and -z.
+	// Instances outside the frustum are skipped, it has to be in world space (projection * view).
+	void Draw(Shader& shader, Model& model, const glm::mat4& baseMatrix, const glm::vec3& cameraPos, float fovY, float viewportHeight, const Frustum* frustum = nullptr);
+	// Call once per frame with the CPU frame time in seconds
+	void recordFrame(float frameTime);
+
+	float averageFrameTime() const; // milliseconds
+	float percentileFrameTime(float percentile) const;
+	double trianglesPerSecond() const;
+	const GpuTimer& getGpuTimer() const { return gpuTimer; }
+
+	// Collect the given number of frames and append a summary line to the CSV file
+	void startRecording(int frames, const std::string& csvPath);
+	bool isRecording() const { return recordFramesLeft > 0; }
+
+private:
+	// std430 layout of Instance in res/shaders/instanced.vert
+	struct InstanceData
+	{
+		glm::mat4 model;
+		glm::mat3x4 normalMatrix; // mat3 columns are padded to vec4
+	};
+	static_assert(sizeof(InstanceData) == 112, "InstanceData must match the std430 layout");
+
+	GLBuffer instanceBuffer;
+	size_t instanceCapacity = 0;
+
+	std::vector<std::vector<glm::mat4>> lodInstances; // Instance transforms bucketed by level
+	std::vector<InstanceData> instanceData;
+
+	GpuTimer gpuTimer; // One section per LOD level
+
+	std::vector<float> frameTimes;
+	size_t frameNext = 0;
+	double triangleSum = 0.0; // Triangles and time over the frame history, for the throughput
+	double timeSum = 0.0;
+	std::vector<size_t> triangleHistory;
+
+	int recordFramesLeft = 0;
+	int recordFrames = 0;
+	std::string recordPath;
+	std::vector<float> recordTimes;
+	double recordTriangles = 0.0;
+	double recordVertices = 0.0;
+	size_t recordDraws = 0;
+
+	void writeRecording();
+};
+
+#endif
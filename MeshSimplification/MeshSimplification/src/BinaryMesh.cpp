@@ -0,0 +1,156 @@
+#include "BinaryMesh.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "Trace.h"
+
+namespace
+{
+    template<typename T>
+    void writeArray(std::ostream& stream, const std::vector<T>& values)
+    {
+        if (!values.empty())
+            stream.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    }
+
+    // Elements read at a time from a stream whose length isn't known, so a corrupt count fails at the end of the data
+    // instead of allocating what the header claims up front
+    const size_t READ_CHUNK_BYTES = size_t(1) << 20;
+
+    template<typename T>
+    bool readArray(std::istream& stream, std::vector<T>& values, size_t count, bool sized)
+    {
+        if (sized)
+        {
+            values.resize(count);
+            if (count > 0)
+                stream.read(reinterpret_cast<char*>(values.data()), count * sizeof(T));
+            return static_cast<bool>(stream);
+        }
+
+        values.clear();
+        size_t chunk = READ_CHUNK_BYTES / sizeof(T);
+        while (values.size() < count && stream)
+        {
+            size_t start = values.size();
+            values.resize(start + std::min(chunk, count - start));
+            stream.read(reinterpret_cast<char*>(values.data() + start), (values.size() - start) * sizeof(T));
+        }
+        return static_cast<bool>(stream);
+    }
+
+    // Bytes left in a seekable stream, -1 for sockets and other streams that can't seek
+    int64_t remainingBytes(std::istream& stream)
+    {
+        std::streampos position = stream.tellg();
+        if (position == std::streampos(-1))
+        {
+            stream.clear();
+            return -1;
+        }
+        stream.seekg(0, std::ios::end);
+        std::streampos end = stream.tellg();
+        stream.seekg(position);
+        if (end == std::streampos(-1) || !stream)
+        {
+            stream.clear();
+            return -1;
+        }
+        return static_cast<int64_t>(end - position);
+    }
+
+    bool validIndices(const MeshData& data)
+    {
+        for (unsigned int index : data.indices)
+            if (index >= data.positions.size())
+                return false;
+        for (const Meshlet& meshlet : data.meshlets)
+            if (meshlet.firstIndex > data.indices.size() || meshlet.indexCount > data.indices.size() - meshlet.firstIndex)
+                return false;
+        return true;
+    }
+}
+
+bool writeBinaryMesh(const std::string& path, const MeshData& data)
+{
+    TRACE_ZONE("write msbm");
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+    {
+        std::cerr << "ERROR::BINARY_MESH::Could not open " << path << " for writing" << std::endl;
+        return false;
+    }
+
+    if (!writeBinaryMesh(file, data))
+    {
+        std::cerr << "ERROR::BINARY_MESH::Failed writing " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool readBinaryMesh(const std::string& path, MeshData& data)
+{
+    TRACE_ZONE("read msbm");
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+
+    if (!readBinaryMesh(file, data))
+    {
+        std::cerr << "ERROR::BINARY_MESH::" << path << " is not a complete version " << BINARY_MESH_VERSION << " binary mesh" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool writeBinaryMesh(std::ostream& stream, const MeshData& data)
+{
+    BinaryMeshHeader header;
+    std::memcpy(header.magic, BINARY_MESH_MAGIC, sizeof(header.magic));
+    header.version = BINARY_MESH_VERSION;
+    header.vertexCount = static_cast<uint32_t>(data.positions.size());
+    header.indexCount = static_cast<uint32_t>(data.indices.size());
+    header.meshletCount = static_cast<uint32_t>(data.meshlets.size());
+    header.collapseCount = static_cast<uint32_t>(data.collapses.size());
+    header.error = data.error;
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    // Normals and texture coordinates are optional, an empty array is written as zeros so the layout stays fixed
+    writeArray(stream, data.positions);
+    writeArray(stream, data.normals.size() == data.positions.size() ? data.normals : std::vector<glm::vec3>(data.positions.size(), glm::vec3(0.0f)));
+    writeArray(stream, data.texCoords.size() == data.positions.size() ? data.texCoords : std::vector<glm::vec2>(data.positions.size(), glm::vec2(0.0f)));
+    writeArray(stream, data.indices);
+    writeArray(stream, data.meshlets);
+    writeArray(stream, data.collapses);
+    return static_cast<bool>(stream);
+}
+
+bool readBinaryMesh(std::istream& stream, MeshData& data)
+{
+    BinaryMeshHeader header;
+    stream.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!stream || std::memcmp(header.magic, BINARY_MESH_MAGIC, sizeof(header.magic)) != 0 || header.version != BINARY_MESH_VERSION)
+        return false;
+
+    // Every count comes from the file or the peer, a seekable stream has to hold all the arrays they add up to
+    uint64_t vertexBytes = uint64_t(header.vertexCount) * (2 * sizeof(glm::vec3) + sizeof(glm::vec2));
+    uint64_t bytes = vertexBytes + uint64_t(header.indexCount) * sizeof(unsigned int) + uint64_t(header.meshletCount) * sizeof(Meshlet)
+        + uint64_t(header.collapseCount) * sizeof(CollapseRecord);
+    int64_t remaining = remainingBytes(stream);
+    if (remaining >= 0 && bytes > static_cast<uint64_t>(remaining))
+        return false;
+
+    bool sized = remaining >= 0;
+    data.error = header.error;
+    return readArray(stream, data.positions, header.vertexCount, sized) &&
+        readArray(stream, data.normals, header.vertexCount, sized) &&
+        readArray(stream, data.texCoords, header.vertexCount, sized) &&
+        readArray(stream, data.indices, header.indexCount, sized) &&
+        readArray(stream, data.meshlets, header.meshletCount, sized) &&
+        readArray(stream, data.collapses, header.collapseCount, sized) &&
+        validIndices(data);
+}
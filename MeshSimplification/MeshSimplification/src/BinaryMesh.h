@@ -0,0 +1,64 @@
+#ifndef BINARYMESH_H
+#define BINARYMESH_H
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "Meshlet.h"
+
+// One edge collapse of a simplification, vertex v0 into v1 with vl and vr the third vertices of the removed faces (-1 on a boundary).
+// Ids are vertices of the input mesh as loaded, not of the compact result.
+struct CollapseRecord
+{
+	int32_t v0, v1, vl, vr;
+	float error;
+};
+
+// Render ready mesh without any GL or OpenMesh state, the unit that is written to and read from the binary cache
+struct MeshData
+{
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec2> texCoords;
+	std::vector<unsigned int> indices; // Ordered by meshlet when meshlets are present
+	std::vector<Meshlet> meshlets;
+	std::vector<CollapseRecord> collapses; // Collapses that produced the mesh, in order, empty unless recorded
+	float error = 0.0f; // Geometric error of the simplification that produced the mesh
+
+	// Heap bytes held by the arrays
+	uint64_t memoryBytes() const
+	{
+		return positions.capacity() * sizeof(glm::vec3) + normals.capacity() * sizeof(glm::vec3) + texCoords.capacity() * sizeof(glm::vec2)
+			+ indices.capacity() * sizeof(unsigned int) + meshlets.capacity() * sizeof(Meshlet) + collapses.capacity() * sizeof(CollapseRecord);
+	}
+};
+
+// Header of a .msbm file, followed by the arrays of MeshData in declaration order.
+// The arrays are raw little endian, so reading is a few large reads without any parsing.
+struct BinaryMeshHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t meshletCount;
+	uint32_t collapseCount;
+	float error;
+};
+
+const char BINARY_MESH_MAGIC[4] = { 'M', 'S', 'B', 'M' };
+const uint32_t BINARY_MESH_VERSION = 2;
+
+bool writeBinaryMesh(const std::string& path, const MeshData& data);
+// Fails on files of another version, the cache is regenerated rather than converted
+bool readBinaryMesh(const std::string& path, MeshData& data);
+// Same layout in memory or over a socket, the streams have to be binary. Reading fails on counts larger than the rest
+// of a seekable stream, on indices past the vertices and on meshlets past the indices.
+bool writeBinaryMesh(std::ostream& stream, const MeshData& data);
+bool readBinaryMesh(std::istream& stream, MeshData& data);
+
+#endif
@@ -0,0 +1,400 @@
+#include "ClusterLod.h"
+
+#include "OpenMesh/Core/Mesh/TriMesh_ArrayKernelT.hh"
+#include "OpenMesh/Tools/Decimater/DecimaterT.hh"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+
+#include "QuadricErrorModule.h"
+
+namespace
+{
+    typedef OpenMesh::TriMesh_ArrayKernelT<> GroupMesh;
+    typedef OpenMesh::Decimater::DecimaterT<GroupMesh> GroupDecimater;
+    typedef ModQuadricErrorT<GroupMesh>::Handle GroupQuadric;
+
+    struct GroupResult
+    {
+        std::vector<unsigned int> indices; // Simplified triangles ordered by meshlet, in source vertex ids
+        std::vector<Meshlet> meshlets; // Ranges of indices
+        float error = 0.0f;
+        bool reduced = false;
+    };
+
+    // Grows the first sphere until it holds the second
+    void mergeSphere(LodBounds& bounds, const LodBounds& other)
+    {
+        float distance = glm::length(other.center - bounds.center);
+        if (distance + other.radius <= bounds.radius)
+            return;
+        if (distance + bounds.radius <= other.radius)
+        {
+            bounds.center = other.center;
+            bounds.radius = other.radius;
+            return;
+        }
+
+        float radius = (distance + bounds.radius + other.radius) * 0.5f;
+        bounds.center += (other.center - bounds.center) * ((radius - bounds.radius) / distance);
+        bounds.radius = radius;
+    }
+
+    // Neighbouring clusters of a level in groups of up to CLUSTER_GROUP_SIZE, always adding the cluster sharing the most edges.
+    // Fewer edges on the group boundary means fewer locked vertices and more room to simplify.
+    std::vector<std::vector<size_t>> groupClusters(const std::vector<Cluster>& clusters, const std::vector<size_t>& level, const std::vector<unsigned int>& indices)
+    {
+        std::unordered_map<uint64_t, size_t> edgeCluster;
+        std::vector<std::unordered_map<size_t, int>> sharedEdges(level.size());
+        for (size_t c = 0; c < level.size(); c++)
+        {
+            const Meshlet& meshlet = clusters[level[c]].meshlet;
+            for (unsigned int i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i += 3)
+            {
+                for (int k = 0; k < 3; k++)
+                {
+                    uint64_t a = indices[i + k], b = indices[i + (k + 1) % 3];
+                    uint64_t key = std::min(a, b) << 32 | std::max(a, b);
+                    auto inserted = edgeCluster.emplace(key, c);
+                    size_t other = inserted.first->second;
+                    if (!inserted.second && other != c)
+                    {
+                        sharedEdges[c][other]++;
+                        sharedEdges[other][c]++;
+                    }
+                }
+            }
+        }
+
+        std::vector<std::vector<size_t>> groups;
+        std::vector<bool> grouped(level.size(), false);
+        for (size_t seed = 0; seed < level.size(); seed++)
+        {
+            if (grouped[seed])
+                continue;
+
+            std::vector<size_t> group = { seed };
+            grouped[seed] = true;
+            std::unordered_map<size_t, int> frontier = sharedEdges[seed];
+            while (group.size() < CLUSTER_GROUP_SIZE)
+            {
+                size_t best = SIZE_MAX;
+                int bestShared = 0;
+                for (const auto& candidate : frontier)
+                {
+                    if (!grouped[candidate.first] && candidate.second > bestShared)
+                    {
+                        best = candidate.first;
+                        bestShared = candidate.second;
+                    }
+                }
+                if (best == SIZE_MAX)
+                    break;
+
+                group.push_back(best);
+                grouped[best] = true;
+                for (const auto& neighbour : sharedEdges[best])
+                    frontier[neighbour.first] += neighbour.second;
+            }
+
+            for (size_t& member : group)
+                member = level[member];
+            groups.push_back(std::move(group));
+        }
+        return groups;
+    }
+
+    // Decimates the triangles of a group to half with the quadric module. Locked vertices are shared with other groups
+    // and can't be collapsed, collapses only ever keep existing vertices, so the result still uses the source vertex ids.
+    void simplifyGroup(const std::vector<glm::vec3>& positions, const std::vector<char>& locked, const std::vector<unsigned int>& groupIndices, GroupResult& result)
+    {
+        GroupMesh mesh;
+        // The decimater requests and releases these as well, held here so the face status outlives it for the loop below
+        mesh.request_vertex_status();
+        mesh.request_edge_status();
+        mesh.request_face_status();
+
+        std::unordered_map<unsigned int, unsigned int> localVertex;
+        std::vector<unsigned int> sourceVertex;
+        std::vector<GroupMesh::VertexHandle> handles(groupIndices.size());
+        for (size_t i = 0; i < groupIndices.size(); i++)
+        {
+            unsigned int vertex = groupIndices[i];
+            auto inserted = localVertex.emplace(vertex, static_cast<unsigned int>(sourceVertex.size()));
+            if (inserted.second)
+            {
+                const glm::vec3& p = positions[vertex];
+                GroupMesh::VertexHandle vh = mesh.add_vertex(GroupMesh::Point(p.x, p.y, p.z));
+                mesh.status(vh).set_locked(locked[vertex] != 0);
+                sourceVertex.push_back(vertex);
+            }
+            handles[i] = mesh.vertex_handle(inserted.first->second);
+        }
+
+        // Triangles the half-edge structure can't hold (non-manifold) are kept as they are
+        std::vector<unsigned int> localIndices;
+        for (size_t i = 0; i + 2 < groupIndices.size(); i += 3)
+        {
+            if (!mesh.add_face(handles[i], handles[i + 1], handles[i + 2]).is_valid())
+            {
+                for (int k = 0; k < 3; k++)
+                    localIndices.push_back(static_cast<unsigned int>(handles[i + k].idx()));
+            }
+        }
+
+        size_t faces = groupIndices.size() / 3;
+        {
+            GroupDecimater decimater(mesh);
+            GroupQuadric quadric;
+            decimater.add(quadric);
+            decimater.initialize();
+            decimater.decimate_to_faces(0, faces / 2);
+            result.error = static_cast<float>(decimater.module(quadric).geometricError());
+        }
+
+        for (GroupMesh::FaceHandle fh : mesh.faces())
+        {
+            if (mesh.status(fh).deleted())
+                continue;
+            for (GroupMesh::VertexHandle vh : mesh.fv_range(fh))
+                localIndices.push_back(static_cast<unsigned int>(vh.idx()));
+        }
+        result.reduced = localIndices.size() / 3 <= faces * CLUSTER_MIN_REDUCTION;
+        if (!result.reduced)
+            return;
+
+        std::vector<glm::vec3> localPositions(sourceVertex.size());
+        for (size_t v = 0; v < sourceVertex.size(); v++)
+            localPositions[v] = positions[sourceVertex[v]];
+        result.meshlets = buildMeshlets(localPositions, {}, localIndices);
+
+        result.indices.resize(localIndices.size());
+        for (size_t i = 0; i < localIndices.size(); i++)
+            result.indices[i] = sourceVertex[localIndices[i]];
+    }
+}
+
+void ClusterLod::clear()
+{
+    clusters.clear();
+    renderMesh.reset();
+    builtVertices.clear();
+    builtIndices.clear();
+    levelCount = 0;
+}
+
+void ClusterLod::gatherMeshes(const std::vector<Mesh>& meshes, std::vector<Vertex>& vertices, std::vector<unsigned int>& sourceIndices)
+{
+    // Textures are dropped like in the other LOD views
+    vertices.clear();
+    sourceIndices.clear();
+    for (const Mesh& mesh : meshes)
+    {
+        unsigned int baseVertex = static_cast<unsigned int>(vertices.size());
+        for (const Vertex& vertex : mesh.vertices)
+        {
+            vertices.push_back(vertex);
+            vertices.back().MorphPosition = vertex.Position;
+            vertices.back().MorphNormal = vertex.Normal;
+        }
+        for (unsigned int index : mesh.indices)
+            sourceIndices.push_back(baseVertex + index);
+    }
+}
+
+bool ClusterLod::build(std::vector<Vertex> vertices, std::vector<unsigned int> sourceIndices, ThreadPool& pool)
+{
+    clear();
+
+    printf("Building cluster LOD...\n");
+    // Wall time, the groups are simplified on several threads
+    auto startTime = std::chrono::steady_clock::now();
+
+    if (sourceIndices.empty())
+        return false;
+
+    std::vector<glm::vec3> positions(vertices.size());
+    for (size_t v = 0; v < vertices.size(); v++)
+        positions[v] = vertices[v].Position;
+
+    // Level 0 is the full mesh, its clusters have no error
+    std::vector<unsigned int> indices = sourceIndices;
+    std::vector<Meshlet> meshlets = buildMeshlets(positions, {}, indices);
+    std::vector<size_t> level;
+    for (const Meshlet& meshlet : meshlets)
+    {
+        Cluster cluster;
+        cluster.meshlet = meshlet;
+        cluster.self.center = meshlet.center;
+        cluster.self.radius = meshlet.radius;
+        cluster.parent.error = FLT_MAX;
+        level.push_back(clusters.size());
+        clusters.push_back(cluster);
+    }
+    levelCount = 1;
+
+    std::vector<int> vertexGroup(vertices.size());
+    std::vector<char> locked(vertices.size());
+    // Vertices of clusters that became roots. Their neighbours keep simplifying on later levels, and would pull the
+    // shared boundary away from the root and crack the cut if these could move.
+    std::vector<char> rootLocked(vertices.size());
+    while (level.size() > 1 && levelCount < CLUSTER_MAX_LEVELS)
+    {
+        std::vector<std::vector<size_t>> groups = groupClusters(clusters, level, indices);
+
+        // Vertices used by more than one group are on a group boundary, they must not move for the levels to line up
+        std::fill(vertexGroup.begin(), vertexGroup.end(), -1);
+        locked = rootLocked;
+        for (size_t g = 0; g < groups.size(); g++)
+        {
+            for (size_t c : groups[g])
+            {
+                const Meshlet& meshlet = clusters[c].meshlet;
+                for (unsigned int i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i++)
+                {
+                    int& group = vertexGroup[indices[i]];
+                    if (group < 0)
+                        group = static_cast<int>(g);
+                    else if (group != static_cast<int>(g))
+                        locked[indices[i]] = 1;
+                }
+            }
+        }
+
+        // Groups only read shared data and write their own result
+        std::vector<GroupResult> results(groups.size());
+        for (size_t g = 0; g < groups.size(); g++)
+        {
+            pool.submit([&, g]()
+            {
+                std::vector<unsigned int> groupIndices;
+                for (size_t c : groups[g])
+                {
+                    const Meshlet& meshlet = clusters[c].meshlet;
+                    groupIndices.insert(groupIndices.end(), indices.begin() + meshlet.firstIndex, indices.begin() + meshlet.firstIndex + meshlet.indexCount);
+                }
+                simplifyGroup(positions, locked, groupIndices, results[g]);
+            });
+        }
+        pool.wait();
+
+        std::vector<size_t> nextLevel;
+        for (size_t g = 0; g < groups.size(); g++)
+        {
+            // Groups that didn't simplify leave their clusters as roots
+            if (!results[g].reduced)
+            {
+                for (size_t c : groups[g])
+                {
+                    const Meshlet& meshlet = clusters[c].meshlet;
+                    for (unsigned int i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i++)
+                        rootLocked[indices[i]] = 1;
+                }
+                continue;
+            }
+
+            // The error adds up along the DAG, since each group is only measured against the level it was made from
+            LodBounds bounds = clusters[groups[g][0]].self;
+            float childError = 0.0f;
+            for (size_t c : groups[g])
+            {
+                mergeSphere(bounds, clusters[c].self);
+                childError = std::max(childError, clusters[c].self.error);
+            }
+            bounds.error = childError + results[g].error;
+
+            for (size_t c : groups[g])
+                clusters[c].parent = bounds;
+
+            unsigned int firstIndex = static_cast<unsigned int>(indices.size());
+            indices.insert(indices.end(), results[g].indices.begin(), results[g].indices.end());
+            for (Meshlet meshlet : results[g].meshlets)
+            {
+                meshlet.firstIndex += firstIndex;
+
+                Cluster cluster;
+                cluster.meshlet = meshlet;
+                cluster.level = levelCount;
+                cluster.self = bounds;
+                cluster.parent.error = FLT_MAX;
+                nextLevel.push_back(clusters.size());
+                clusters.push_back(cluster);
+            }
+        }
+        if (nextLevel.empty())
+            break;
+
+        printf("Cluster level %i: %zu clusters in %zu groups\n", levelCount, nextLevel.size(), groups.size());
+        level.swap(nextLevel);
+        levelCount++;
+    }
+
+    builtVertices = std::move(vertices);
+    builtIndices = std::move(indices);
+    buildTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    printf("Cluster LOD complete: %zu clusters in %i levels\n", clusters.size(), levelCount);
+    return true;
+}
+
+void ClusterLod::upload()
+{
+    if (builtIndices.empty())
+        return;
+
+    renderMesh = std::make_unique<Mesh>(std::move(builtVertices), std::move(builtIndices), std::vector<Texture>());
+    builtVertices.clear();
+    builtIndices.clear();
+}
+
+void ClusterLod::Draw(Shader& shader, const Frustum& frustum, const glm::vec3& viewPosition, float fovY, float viewportHeight)
+{
+    clustersDrawn = 0;
+    clustersCulled = 0;
+    trianglesDrawn = 0;
+    if (!renderMesh)
+        return;
+
+    // Pixels covered by one model unit at unit distance
+    float projection = viewportHeight / (2.0f * std::tan(fovY * 0.5f));
+    auto projectedError = [&](const LodBounds& bounds)
+    {
+        if (bounds.error == FLT_MAX)
+            return FLT_MAX;
+        float distance = std::max(glm::length(bounds.center - viewPosition) - bounds.radius, FLT_EPSILON);
+        return bounds.error * projection / distance;
+    };
+
+    // A cluster is part of the cut when it is accurate enough but its parent group isn't.
+    // The projected errors only grow towards the roots, so exactly one cluster of each part of the surface qualifies.
+    drawCounts.clear();
+    drawOffsets.clear();
+    unsigned int nextIndex = UINT32_MAX;
+    for (const Cluster& cluster : clusters)
+    {
+        if (projectedError(cluster.self) > pixelThreshold || projectedError(cluster.parent) <= pixelThreshold)
+            continue;
+        if (isMeshletCulled(cluster.meshlet, frustum, viewPosition))
+        {
+            clustersCulled++;
+            continue;
+        }
+
+        clustersDrawn++;
+        trianglesDrawn += cluster.meshlet.indexCount / 3;
+        if (cluster.meshlet.firstIndex == nextIndex)
+            drawCounts.back() += cluster.meshlet.indexCount;
+        else
+        {
+            drawCounts.push_back(cluster.meshlet.indexCount);
+            drawOffsets.push_back((const void*)(cluster.meshlet.firstIndex * sizeof(unsigned int)));
+        }
+        nextIndex = cluster.meshlet.firstIndex + cluster.meshlet.indexCount;
+    }
+
+    shader.setFloat("morphFactor", 0.0f);
+    renderMesh->DrawRanges(shader, drawCounts, drawOffsets);
+}
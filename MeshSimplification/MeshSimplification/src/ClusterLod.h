@@ -0,0 +1,82 @@
+#ifndef CLUSTERLOD_H
+#define CLUSTERLOD_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <memory>
+#include <vector>
+
+#include "Frustum.h"
+#include "Mesh.h"
+#include "Meshlet.h"
+#include "Shader.h"
+#include "ThreadPool.h"
+
+// Clusters merged into a group before it is simplified, the group boundary is what stays locked
+const size_t CLUSTER_GROUP_SIZE = 4;
+// A group that keeps more than this fraction of its triangles is stuck on its locked boundary, its clusters become roots
+const float CLUSTER_MIN_REDUCTION = 0.85f;
+const int CLUSTER_MAX_LEVELS = 32;
+
+// Error of a group of clusters in model units, with a sphere that holds the spheres of everything it was simplified from.
+// Both only grow going up the DAG, so the error projected on screen does too.
+struct LodBounds
+{
+	glm::vec3 center = glm::vec3(0.0f);
+	float radius = 0.0f;
+	float error = 0.0f;
+};
+
+struct Cluster
+{
+	Meshlet meshlet; // Triangles in the DAG index list, with the bounds used for culling
+	int level = 0;
+	LodBounds self; // The group this cluster was made from, zero error on level 0
+	LodBounds parent; // The group that replaces this cluster on the next level, infinite error for roots
+};
+
+// Nanite style cluster level of detail. The mesh is split into meshlets, neighbouring meshlets are grouped, and every
+// group is simplified to half with its boundary locked, then split into meshlets again. Repeating this up to a few roots
+// gives a DAG in which any cut between levels is crack free, since neighbouring groups agree on their shared boundary.
+// Each frame the cut is picked per cluster from the projected error, so detail follows the camera across the mesh.
+class ClusterLod
+{
+public:
+	float pixelThreshold = 1.0f; // Largest error on screen in pixels
+
+	// Statistics of the last build and draw
+	int levelCount = 0;
+	float buildTime = 0.0f; // Milliseconds
+	size_t clustersDrawn = 0;
+	size_t clustersCulled = 0;
+	size_t trianglesDrawn = 0;
+
+	ClusterLod() {};
+
+	// All meshes in one vertex and index list, copied on the thread that owns them so build can run on another
+	static void gatherMeshes(const std::vector<Mesh>& meshes, std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+	// Builds the DAG over the gathered meshes, the groups of each level are simplified in parallel on the pool.
+	// No GL calls, so it can run on a worker thread while the window keeps drawing.
+	bool build(std::vector<Vertex> vertices, std::vector<unsigned int> sourceIndices, ThreadPool& pool);
+	// Creates the buffers of a built DAG, on the thread that owns the GL context
+	void upload();
+	bool isBuilt() const { return renderMesh != nullptr; }
+	void clear();
+
+	// frustum and viewPosition are in model space, the model matrix must scale uniformly
+	void Draw(Shader& shader, const Frustum& frustum, const glm::vec3& viewPosition, float fovY, float viewportHeight);
+
+	const std::vector<Cluster>& getClusters() const { return clusters; }
+
+private:
+	std::vector<Cluster> clusters;
+	std::unique_ptr<Mesh> renderMesh; // Vertices of the source meshes with the indices of every level
+	std::vector<Vertex> builtVertices; // Left by build for upload
+	std::vector<unsigned int> builtIndices;
+	std::vector<GLsizei> drawCounts; // Per frame multi-draw lists
+	std::vector<const void*> drawOffsets;
+};
+
+#endif
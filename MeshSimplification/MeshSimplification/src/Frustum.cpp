@@ -0,0 +1,123 @@
+#include "Frustum.h"
+
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define FRUSTUM_SSE
+#include <xmmintrin.h>
+#endif
+
+Frustum::Frustum()
+{
+    // Accepts everything until set up from a matrix
+    for (int i = 0; i < 8; i++)
+        setPlane(i, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+}
+
+Frustum::Frustum(const glm::mat4& clipFromObject) : Frustum()
+{
+    // Rows of the matrix, glm is column major
+    glm::vec4 row[4];
+    for (int i = 0; i < 4; i++)
+        row[i] = glm::vec4(clipFromObject[0][i], clipFromObject[1][i], clipFromObject[2][i], clipFromObject[3][i]);
+
+    // -w <= x, y, z <= w for points inside the frustum
+    setPlane(0, row[3] + row[0]); // left
+    setPlane(1, row[3] - row[0]); // right
+    setPlane(2, row[3] + row[1]); // bottom
+    setPlane(3, row[3] - row[1]); // top
+    setPlane(4, row[3] + row[2]); // near
+    setPlane(5, row[3] - row[2]); // far
+}
+
+void Frustum::setPlane(int i, const glm::vec4& plane)
+{
+    // Normalised so the plane equation gives the distance in object units, which the sphere test needs
+    float length = glm::length(glm::vec3(plane));
+    glm::vec4 normalised = length > 0.0f ? plane / length : plane;
+
+    a[i] = normalised.x;
+    b[i] = normalised.y;
+    c[i] = normalised.z;
+    d[i] = normalised.w;
+}
+
+bool Frustum::intersectsSphere(const glm::vec3& center, float radius) const
+{
+#ifdef FRUSTUM_SSE
+    const __m128 cx = _mm_set1_ps(center.x);
+    const __m128 cy = _mm_set1_ps(center.y);
+    const __m128 cz = _mm_set1_ps(center.z);
+    const __m128 negRadius = _mm_set1_ps(-radius);
+
+    for (int i = 0; i < 8; i += 4)
+    {
+        __m128 distance = _mm_add_ps(_mm_mul_ps(_mm_load_ps(a + i), cx), _mm_load_ps(d + i));
+        distance = _mm_add_ps(distance, _mm_mul_ps(_mm_load_ps(b + i), cy));
+        distance = _mm_add_ps(distance, _mm_mul_ps(_mm_load_ps(c + i), cz));
+        if (_mm_movemask_ps(_mm_cmplt_ps(distance, negRadius)))
+            return false;
+    }
+    return true;
+#else
+    for (int i = 0; i < 6; i++)
+        if (a[i] * center.x + b[i] * center.y + c[i] * center.z + d[i] < -radius)
+            return false;
+    return true;
+#endif
+}
+
+bool Frustum::intersectsBox(const glm::vec3& boxMin, const glm::vec3& boxMax) const
+{
+    // The box is outside a plane when the corner furthest along the plane normal is behind it.
+    // That corner's distance is the center's distance plus the extents projected onto the absolute normal.
+    glm::vec3 center = (boxMin + boxMax) * 0.5f;
+    glm::vec3 extents = (boxMax - boxMin) * 0.5f;
+
+#ifdef FRUSTUM_SSE
+    const __m128 cx = _mm_set1_ps(center.x);
+    const __m128 cy = _mm_set1_ps(center.y);
+    const __m128 cz = _mm_set1_ps(center.z);
+    const __m128 ex = _mm_set1_ps(extents.x);
+    const __m128 ey = _mm_set1_ps(extents.y);
+    const __m128 ez = _mm_set1_ps(extents.z);
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+
+    for (int i = 0; i < 8; i += 4)
+    {
+        __m128 pa = _mm_load_ps(a + i);
+        __m128 pb = _mm_load_ps(b + i);
+        __m128 pc = _mm_load_ps(c + i);
+
+        __m128 distance = _mm_add_ps(_mm_mul_ps(pa, cx), _mm_load_ps(d + i));
+        distance = _mm_add_ps(distance, _mm_mul_ps(pb, cy));
+        distance = _mm_add_ps(distance, _mm_mul_ps(pc, cz));
+
+        __m128 reach = _mm_mul_ps(_mm_andnot_ps(signMask, pa), ex);
+        reach = _mm_add_ps(reach, _mm_mul_ps(_mm_andnot_ps(signMask, pb), ey));
+        reach = _mm_add_ps(reach, _mm_mul_ps(_mm_andnot_ps(signMask, pc), ez));
+
+        if (_mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, reach), _mm_setzero_ps())))
+            return false;
+    }
+    return true;
+#else
+    for (int i = 0; i < 6; i++)
+    {
+        float distance = a[i] * center.x + b[i] * center.y + c[i] * center.z + d[i];
+        float reach = std::abs(a[i]) * extents.x + std::abs(b[i]) * extents.y + std::abs(c[i]) * extents.z;
+        if (distance + reach < 0.0f)
+            return false;
+    }
+    return true;
+#endif
+}
+
+bool Frustum::intersects(const Bounds& bounds) const
+{
+    if (bounds.empty())
+        return false;
+
+    // The sphere rejects most things cheaply, the box is tighter for long thin meshes like scan tiles
+    return intersectsSphere(bounds.center, bounds.radius) && intersectsBox(bounds.boxMin, bounds.boxMax);
+}
@@ -0,0 +1,43 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+#include <cfloat>
+
+// Axis aligned box and bounding sphere of a set of points, in the space of the points
+struct Bounds
+{
+	glm::vec3 boxMin = glm::vec3(FLT_MAX);
+	glm::vec3 boxMax = glm::vec3(-FLT_MAX);
+	glm::vec3 center = glm::vec3(0.0f);
+	float radius = 0.0f;
+
+	bool empty() const { return boxMin.x > boxMax.x; }
+};
+
+// The six planes of a view frustum, extracted from a clip space matrix.
+// Extracting from projection * view * model gives the planes in model space, so bounds can be tested without transforming them.
+class Frustum
+{
+public:
+	Frustum();
+	explicit Frustum(const glm::mat4& clipFromObject);
+
+	// Conservative tests, false only when the volume is entirely outside one of the planes
+	bool intersectsSphere(const glm::vec3& center, float radius) const;
+	bool intersectsBox(const glm::vec3& boxMin, const glm::vec3& boxMax) const;
+	bool intersects(const Bounds& bounds) const;
+
+private:
+	// Plane i is a[i] * x + b[i] * y + c[i] * z + d[i] >= 0 on the inside.
+	// Stored per component so four planes are tested at once, the last two are padding that never rejects.
+	alignas(16) float a[8];
+	alignas(16) float b[8];
+	alignas(16) float c[8];
+	alignas(16) float d[8];
+
+	void setPlane(int i, const glm::vec4& plane);
+};
+
+#endif
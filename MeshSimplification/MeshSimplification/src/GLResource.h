@@ -0,0 +1,82 @@
+#ifndef GLRESOURCE_H
+#define GLRESOURCE_H
+
+#include <glad/glad.h>
+
+#include <utility>
+
+// Move-only owner of an OpenGL object name, the object is deleted when the owner goes out of scope.
+// Traits provide the matching glGen*/glDelete* calls for each kind of object.
+template<typename Traits>
+class GLResource
+{
+public:
+	GLResource() : id(0) {};
+	// Adopt an object that was created elsewhere
+	explicit GLResource(GLuint id) : id(id) {};
+	~GLResource() { release(); }
+
+	GLResource(const GLResource&) = delete;
+	GLResource& operator=(const GLResource&) = delete;
+
+	GLResource(GLResource&& other) noexcept : id(std::exchange(other.id, 0)) {};
+	GLResource& operator=(GLResource&& other) noexcept
+	{
+		if (this != &other)
+		{
+			release();
+			id = std::exchange(other.id, 0);
+		}
+		return *this;
+	}
+
+	static GLResource create()
+	{
+		GLuint newId;
+		Traits::create(1, &newId);
+		return GLResource(newId);
+	}
+
+	void release()
+	{
+		if (id != 0) Traits::destroy(1, &id);
+		id = 0;
+	}
+
+	GLuint get() const { return id; }
+	operator GLuint() const { return id; }
+
+private:
+	GLuint id;
+};
+
+struct GLBufferTraits
+{
+	static void create(GLsizei n, GLuint* ids) { glGenBuffers(n, ids); }
+	static void destroy(GLsizei n, const GLuint* ids) { glDeleteBuffers(n, ids); }
+};
+
+struct GLVertexArrayTraits
+{
+	static void create(GLsizei n, GLuint* ids) { glGenVertexArrays(n, ids); }
+	static void destroy(GLsizei n, const GLuint* ids) { glDeleteVertexArrays(n, ids); }
+};
+
+struct GLTextureTraits
+{
+	static void create(GLsizei n, GLuint* ids) { glGenTextures(n, ids); }
+	static void destroy(GLsizei n, const GLuint* ids) { glDeleteTextures(n, ids); }
+};
+
+struct GLQueryTraits
+{
+	static void create(GLsizei n, GLuint* ids) { glGenQueries(n, ids); }
+	static void destroy(GLsizei n, const GLuint* ids) { glDeleteQueries(n, ids); }
+};
+
+typedef GLResource<GLBufferTraits> GLBuffer;
+typedef GLResource<GLVertexArrayTraits> GLVertexArray;
+typedef GLResource<GLTextureTraits> GLTexture;
+typedef GLResource<GLQueryTraits> GLQuery;
+
+#endif
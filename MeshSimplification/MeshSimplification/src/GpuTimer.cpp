@@ -0,0 +1,100 @@
+#include "GpuTimer.h"
+
+#include <algorithm>
+
+// Weight of the newest sample in the per-section rolling averages
+const float SECTION_AVERAGE_WEIGHT = 0.05f;
+
+void GpuTimer::beginFrame(size_t markerCount)
+{
+    Frame& frame = frames[current];
+
+    // Still waiting on the GPU for the results stored in this slot, skip measuring this frame instead of blocking
+    recording = !frame.pending || collect(frame);
+    if (!recording)
+        return;
+
+    while (frame.queries.size() < markerCount)
+        frame.queries.push_back(GLQuery::create());
+    frame.used = markerCount;
+}
+
+void GpuTimer::mark(size_t marker)
+{
+    if (recording && marker < frames[current].used)
+        glQueryCounter(frames[current].queries[marker], GL_TIMESTAMP);
+}
+
+void GpuTimer::endFrame()
+{
+    if (recording)
+        frames[current].pending = frames[current].used > 0;
+
+    current = (current + 1) % GPU_TIMER_FRAMES;
+}
+
+float GpuTimer::averageTotal() const
+{
+    if (history.empty())
+        return 0.0f;
+
+    float sum = 0.0f;
+    for (float time : history)
+        sum += time;
+    return sum / history.size();
+}
+
+float GpuTimer::percentileTotal(float percentile) const
+{
+    if (history.empty())
+        return 0.0f;
+
+    sorted.assign(history.begin(), history.end());
+    size_t n = static_cast<size_t>(percentile / 100.0f * (sorted.size() - 1) + 0.5f);
+    std::nth_element(sorted.begin(), sorted.begin() + n, sorted.end());
+    return sorted[n];
+}
+
+bool GpuTimer::collect(Frame& frame)
+{
+    // Timestamps complete in order, so the last one being available means they all are
+    GLint available = 0;
+    glGetQueryObjectiv(frame.queries[frame.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+        return false;
+
+    GLuint64 previous = 0, first = 0, stamp = 0;
+    size_t sections = frame.used - 1;
+    if (sectionTimes.size() != sections)
+    {
+        sectionTimes.assign(sections, 0.0f);
+        sectionAverages.assign(sections, 0.0f);
+    }
+
+    for (size_t i = 0; i < frame.used; i++)
+    {
+        glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &stamp);
+        if (i == 0)
+            first = stamp;
+        else
+        {
+            float time = (stamp - previous) / 1000.0f;
+            sectionTimes[i - 1] = time;
+            if (sectionAverages[i - 1] == 0.0f)
+                sectionAverages[i - 1] = time;
+            else
+                sectionAverages[i - 1] += (time - sectionAverages[i - 1]) * SECTION_AVERAGE_WEIGHT;
+        }
+        previous = stamp;
+    }
+
+    total = (stamp - first) / 1000.0f;
+    if (history.size() < GPU_TIMER_HISTORY)
+        history.push_back(total);
+    else
+        history[historyNext] = total;
+    historyNext = (historyNext + 1) % GPU_TIMER_HISTORY;
+
+    frame.pending = false;
+    return true;
+}
@@ -0,0 +1,61 @@
+#ifndef GPUTIMER_H
+#define GPUTIMER_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <vector>
+
+#include "GLResource.h"
+
+// Number of frames a set of queries can stay in flight before it is needed again
+const int GPU_TIMER_FRAMES = 4;
+// Number of frames kept for the rolling average and percentiles
+const int GPU_TIMER_HISTORY = 240;
+
+// Measures GPU time between markers with timestamp queries without stalling the pipeline.
+// Queries are reused from a ring and read back GPU_TIMER_FRAMES frames later, only once the results are available.
+// Marker i starts section i, the last marker ends the last section.
+class GpuTimer
+{
+public:
+	GpuTimer() {};
+
+	// Collects the results of the oldest frame in the ring and starts recording a frame with the given number of markers
+	void beginFrame(size_t markerCount);
+	void mark(size_t marker);
+	void endFrame();
+
+	// All times are in microseconds
+	float lastTotal() const { return total; }
+	float averageTotal() const;
+	float percentileTotal(float percentile) const;
+
+	size_t sectionCount() const { return sectionTimes.size(); }
+	float lastSection(size_t section) const { return sectionTimes[section]; }
+	float averageSection(size_t section) const { return sectionAverages[section]; }
+
+private:
+	struct Frame
+	{
+		std::vector<GLQuery> queries;
+		size_t used = 0;
+		bool pending = false;
+	};
+
+	Frame frames[GPU_TIMER_FRAMES];
+	int current = 0;
+	bool recording = false;
+
+	float total = 0.0f;
+	std::vector<float> sectionTimes;
+	std::vector<float> sectionAverages;
+
+	std::vector<float> history;
+	size_t historyNext = 0;
+	mutable std::vector<float> sorted; // Scratch space for percentiles
+
+	bool collect(Frame& frame);
+};
+
+#endif
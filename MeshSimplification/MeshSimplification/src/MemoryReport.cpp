@@ -0,0 +1,151 @@
+#include "MemoryReport.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#endif
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+    std::atomic<int64_t> tagBytes[static_cast<size_t>(MemoryTag::Count)];
+
+    const char* const TAG_NAMES[] = { "Half-edge trial nodes", "Half-edge trial edge map" };
+    static_assert(sizeof(TAG_NAMES) / sizeof(TAG_NAMES[0]) == static_cast<size_t>(MemoryTag::Count), "A name for every tag");
+
+#ifdef __linux__
+    // A "Vm...:" line of /proc/self/status, given there in kB
+    uint64_t statusBytes(const char* field)
+    {
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        size_t length = std::strlen(field);
+        while (std::getline(status, line))
+            if (line.compare(0, length, field) == 0)
+                return std::strtoull(line.c_str() + length, nullptr, 10) * 1024;
+        return 0;
+    }
+#endif
+}
+
+const char* memoryTagName(MemoryTag tag)
+{
+    return TAG_NAMES[static_cast<size_t>(tag)];
+}
+
+uint64_t trackedBytes(MemoryTag tag)
+{
+    int64_t bytes = tagBytes[static_cast<size_t>(tag)].load(std::memory_order_relaxed);
+    return bytes > 0 ? static_cast<uint64_t>(bytes) : 0;
+}
+
+void trackBytes(MemoryTag tag, int64_t bytes)
+{
+    tagBytes[static_cast<size_t>(tag)].fetch_add(bytes, std::memory_order_relaxed);
+}
+
+uint64_t residentBytes()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.WorkingSetSize : 0;
+#elif defined(__linux__)
+    return statusBytes("VmRSS:");
+#else
+    return 0;
+#endif
+}
+
+uint64_t peakResidentBytes()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.PeakWorkingSetSize : 0;
+#elif defined(__linux__)
+    return statusBytes("VmHWM:");
+#else
+    return 0;
+#endif
+}
+
+bool resetPeakResident()
+{
+#ifdef __linux__
+    // Writing 5 to clear_refs sets VmHWM back to the current resident set
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    clearRefs << "5";
+    clearRefs.flush();
+    return static_cast<bool>(clearRefs);
+#else
+    return false;
+#endif
+}
+
+void MemoryStage::begin(const std::string& stageName)
+{
+    name = stageName;
+    structures.clear();
+    stagePeak = resetPeakResident();
+    residentBefore = residentBytes();
+}
+
+void MemoryStage::add(const std::string& structure, uint64_t bytes, bool tracked)
+{
+    for (MemoryStructure& existing : structures)
+    {
+        if (existing.name == structure)
+        {
+            existing.bytes += bytes;
+            return;
+        }
+    }
+    structures.push_back({ structure, bytes, tracked });
+}
+
+void MemoryStage::end()
+{
+    for (size_t i = 0; i < static_cast<size_t>(MemoryTag::Count); i++)
+    {
+        uint64_t bytes = trackedBytes(static_cast<MemoryTag>(i));
+        if (bytes > 0)
+            add(memoryTagName(static_cast<MemoryTag>(i)), bytes, true);
+    }
+    residentAfter = residentBytes();
+    peakResident = peakResidentBytes();
+}
+
+uint64_t MemoryStage::structureBytes() const
+{
+    uint64_t bytes = 0;
+    for (const MemoryStructure& structure : structures)
+        bytes += structure.bytes;
+    return bytes;
+}
+
+void writeMemoryJson(std::ostream& out, const std::vector<MemoryStage>& stages, const std::string& indent)
+{
+    out << "[";
+    for (size_t i = 0; i < stages.size(); i++)
+    {
+        const MemoryStage& stage = stages[i];
+        out << (i ? "," : "") << "\n" << indent << "  {\"name\": \"" << stage.name << "\", \"resident_before\": " << stage.residentBefore
+            << ", \"resident_after\": " << stage.residentAfter << ", \"peak_resident\": " << stage.peakResident
+            << ", \"stage_peak\": " << (stage.stagePeak ? "true" : "false") << ", \"structure_bytes\": " << stage.structureBytes()
+            << ",\n" << indent << "   \"structures\": [";
+        for (size_t j = 0; j < stage.structures.size(); j++)
+        {
+            const MemoryStructure& structure = stage.structures[j];
+            out << (j ? ", " : "") << "{\"name\": \"" << structure.name << "\", \"bytes\": " << structure.bytes
+                << ", \"tracked\": " << (structure.tracked ? "true" : "false") << "}";
+        }
+        out << "]}";
+    }
+    out << "\n" << indent << "]";
+}
@@ -0,0 +1,101 @@
+#ifndef MEMORYREPORT_H
+#define MEMORYREPORT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Where the memory of the pipeline goes, so machines for large meshes are sized from data. Each stage records the bytes
+// held by the data structures alive at its end and the resident set of the process around it. Our own allocations are
+// counted exactly under a tag (see TrackingAllocator), structures owned by Assimp and OpenMesh are sampled from their
+// element counts and capacities when the stage ends.
+
+enum class MemoryTag
+{
+	HalfEdgeNodes, // Hetest and Facetest of the half-edge trial
+	HalfEdgeMap, // Nodes of Mesh::etest
+	Count,
+};
+
+const char* memoryTagName(MemoryTag tag);
+// Bytes currently allocated under a tag, across all threads
+uint64_t trackedBytes(MemoryTag tag);
+void trackBytes(MemoryTag tag, int64_t bytes);
+
+// std::allocator that counts what it holds under Tag, for containers of our own whose size we want exactly
+template<typename T, MemoryTag Tag>
+class TrackingAllocator
+{
+public:
+	typedef T value_type;
+	template<typename U>
+	struct rebind { typedef TrackingAllocator<U, Tag> other; };
+
+	TrackingAllocator() = default;
+	template<typename U>
+	TrackingAllocator(const TrackingAllocator<U, Tag>&) {}
+
+	T* allocate(size_t count)
+	{
+		trackBytes(Tag, static_cast<int64_t>(count * sizeof(T)));
+		return static_cast<T*>(::operator new(count * sizeof(T)));
+	}
+	void deallocate(T* pointer, size_t count)
+	{
+		trackBytes(Tag, -static_cast<int64_t>(count * sizeof(T)));
+		::operator delete(pointer);
+	}
+
+	template<typename U>
+	bool operator==(const TrackingAllocator<U, Tag>&) const { return true; }
+	template<typename U>
+	bool operator!=(const TrackingAllocator<U, Tag>&) const { return false; }
+};
+
+// Heap bytes a vector holds, used or not
+template<typename T, typename A>
+uint64_t capacityBytes(const std::vector<T, A>& vector) { return vector.capacity() * sizeof(T); }
+template<typename A>
+uint64_t capacityBytes(const std::vector<bool, A>& vector) { return vector.capacity() / 8; }
+
+// Resident set of the process, zero where it can't be read
+uint64_t residentBytes();
+// Largest resident set since the last resetPeakResident, or since the process started where the OS can't reset it
+uint64_t peakResidentBytes();
+// False if the peak keeps counting from the start of the process (Windows, and Linux before 4.0)
+bool resetPeakResident();
+
+struct MemoryStructure
+{
+	std::string name;
+	uint64_t bytes = 0;
+	bool tracked = false; // Counted by a tracking allocator, sampled otherwise
+};
+
+struct MemoryStage
+{
+	std::string name;
+	// The resident set is the whole process's, stages running on other threads at the same time show up in it
+	uint64_t residentBefore = 0;
+	uint64_t residentAfter = 0;
+	uint64_t peakResident = 0;
+	bool stagePeak = false; // The peak is this stage's, otherwise the process's so far
+	std::vector<MemoryStructure> structures;
+
+	// Samples the resident set and resets its peak
+	void begin(const std::string& stageName);
+	// Structures added under a name already in the stage are summed, e.g. one per mesh of a model
+	void add(const std::string& structure, uint64_t bytes, bool tracked = false);
+	// Adds every tag with bytes in use and samples the resident set again
+	void end();
+
+	uint64_t structureBytes() const;
+};
+
+// {"name": ..., "resident_before": ..., "structures": [...]} per stage, as a JSON array. Lines after the first start
+// with indent, so the array can be nested in another document.
+void writeMemoryJson(std::ostream& out, const std::vector<MemoryStage>& stages, const std::string& indent = "");
+
+#endif
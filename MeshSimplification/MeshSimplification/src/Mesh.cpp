@@ -1,18 +1,184 @@
 #include "Mesh.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "Trace.h"
+
+// Unchanged gaps shorter than this are uploaded along with their neighbours instead of splitting into another call
+const size_t UPLOAD_MERGE_GAP = 64;
+
 Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures)
 {
-    this->vertices = vertices;
-    this->indices = indices;
-    this->textures = textures;
+    this->vertices = std::move(vertices);
+    this->indices = std::move(indices);
+    this->textures = std::move(textures);
 
     // now that we have all the required data, set the vertex buffers and its attribute pointers.
     setupMesh();
+    setupSamplerNames();
+    computeBounds();
 }
 
 void Mesh::Draw(Shader& shader)
+{
+    TRACE_ZONE("draw mesh");
+    bindTextures(shader);
+
+    // draw mesh
+    glBindVertexArray(VAO);
+    glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
+    glBindVertexArray(0);
+
+    // always good practice to set everything back to defaults once configured.
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void Mesh::DrawInstanced(Shader& shader, unsigned int instanceCount)
+{
+    bindTextures(shader);
+
+    // per instance data comes from the shader, see res/shaders/instanced.vert
+    glBindVertexArray(VAO);
+    glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0, instanceCount);
+    glBindVertexArray(0);
+
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void Mesh::DrawMeshlets(Shader& shader, const Frustum& frustum, const glm::vec3& viewPosition)
+{
+    ensureMeshlets();
+
+    // Visible meshlets become one multi-draw, consecutive ranges are merged into a single command
+    meshletCounts.clear();
+    meshletOffsets.clear();
+    meshletsCulled = 0;
+    size_t nextIndex = SIZE_MAX;
+    for (const Meshlet& meshlet : meshlets)
+    {
+        if (isMeshletCulled(meshlet, frustum, viewPosition))
+        {
+            meshletsCulled++;
+            continue;
+        }
+        if (meshlet.firstIndex == nextIndex)
+            meshletCounts.back() += meshlet.indexCount;
+        else
+        {
+            meshletCounts.push_back(meshlet.indexCount);
+            meshletOffsets.push_back((const void*)(meshlet.firstIndex * sizeof(unsigned int)));
+        }
+        nextIndex = meshlet.firstIndex + meshlet.indexCount;
+    }
+
+    drawRanges(shader, meshletVAO, meshletCounts, meshletOffsets);
+}
+
+void Mesh::DrawRanges(Shader& shader, const std::vector<GLsizei>& counts, const std::vector<const void*>& offsets)
+{
+    drawRanges(shader, VAO, counts, offsets);
+}
+
+void Mesh::drawRanges(Shader& shader, GLuint vertexArray, const std::vector<GLsizei>& counts, const std::vector<const void*>& offsets)
+{
+    if (counts.empty())
+        return;
+
+    bindTextures(shader);
+
+    glBindVertexArray(vertexArray);
+    glMultiDrawElements(GL_TRIANGLES, counts.data(), GL_UNSIGNED_INT, offsets.data(), static_cast<GLsizei>(counts.size()));
+    glBindVertexArray(0);
+
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void Mesh::ensureMeshlets()
+{
+    if (!meshletsDirty)
+        return;
+    meshletsDirty = false;
+
+    std::vector<glm::vec3> positions(vertices.size()), morphPositions(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        positions[i] = vertices[i].Position;
+        morphPositions[i] = vertices[i].MorphPosition;
+    }
+    meshletIndices = indices;
+    meshlets = buildMeshlets(positions, morphPositions, meshletIndices);
+
+    // The meshlet order goes into its own buffer, the main one stays in slot order for the partial updates
+    if (!meshletVAO)
+    {
+        meshletVAO = GLVertexArray::create();
+        meshletEBO = GLBuffer::create();
+        glBindVertexArray(meshletVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshletEBO);
+        setupAttributes();
+    }
+    else
+        glBindVertexArray(meshletVAO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, meshletIndices.size() * sizeof(unsigned int), meshletIndices.data(), GL_DYNAMIC_DRAW);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+MeshData Mesh::toMeshData()
+{
+    ensureMeshlets();
+
+    MeshData data;
+    data.positions.reserve(vertices.size());
+    data.normals.reserve(vertices.size());
+    data.texCoords.reserve(vertices.size());
+    for (const Vertex& vertex : vertices)
+    {
+        data.positions.push_back(vertex.Position);
+        data.normals.push_back(vertex.Normal);
+        data.texCoords.push_back(vertex.TexCoords);
+    }
+    data.indices = meshletIndices;
+    data.meshlets = meshlets;
+    return data;
+}
+
+void Mesh::reportMemory(MemoryStage& stage) const
+{
+    // The quadric is most of each vertex and only the trial uses it, so it is shown on its own
+    stage.add("Mesh::vertices", vertices.capacity() * (sizeof(Vertex) - sizeof(glm::mat4)));
+    stage.add("Mesh::vertices quadrics", vertices.capacity() * sizeof(glm::mat4));
+    stage.add("Mesh::indices", capacityBytes(indices));
+    stage.add("Meshlets", capacityBytes(meshlets) + capacityBytes(meshletIndices));
+    // Red-black tree nodes carry three pointers and a colour next to the value
+    const uint64_t mapNodeBytes = 4 * sizeof(void*);
+    stage.add("Half-edges", edges.size() * (sizeof(std::pair<TestFS, HalfEdge*>) + mapNodeBytes + sizeof(HalfEdge))
+        + capacityBytes(faces) + faces.size() * sizeof(Face));
+    stage.add("Half-edge trial arrays", capacityBytes(vtest) + capacityBytes(ntest) + capacityBytes(itest) + capacityBytes(ftest)
+        + capacityBytes(hetestNodes) + capacityBytes(facetestNodes));
+}
+
+void Mesh::bindTextures(Shader& shader)
 {
     // bind appropriate textures
+    for (unsigned int i = 0; i < textures.size(); i++)
+    {
+        glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
+        // now set the sampler to the correct texture unit
+        GLint location = shader.getUniformLocation(samplerNames[i]);
+        if (location >= 0)
+            glUniform1i(location, i);
+        // and finally bind the texture
+        glBindTexture(GL_TEXTURE_2D, textures[i].id);
+    }
+}
+
+void Mesh::setupSamplerNames()
+{
+    // Sampler uniform names only depend on the textures, so they are built once instead of every draw
     unsigned int diffuseNr = 1;
     unsigned int specularNr = 1;
     /* If want to process normal maps and height maps */
@@ -22,7 +188,6 @@ void Mesh::Draw(Shader& shader)
     */
     for (unsigned int i = 0; i < textures.size(); i++)
     {
-        glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
         // retrieve texture number (the N in diffuse_textureN)
         std::string number;
         std::string name = textures[i].type;
@@ -37,28 +202,17 @@ void Mesh::Draw(Shader& shader)
         else if (name == "texture_height")
             number = std::to_string(heightNr++); // transfer unsigned int to string
         */
-
-        // now set the sampler to the correct texture unit
-        glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-        // and finally bind the texture
-        glBindTexture(GL_TEXTURE_2D, textures[i].id);
+        samplerNames.push_back(name + number);
     }
-
-    // draw mesh
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
-
-    // always good practice to set everything back to defaults once configured.
-    glActiveTexture(GL_TEXTURE0);
 }
 
 void Mesh::setupMesh()
 {
+    TRACE_ZONE("upload");
     // create buffers/arrays
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
+    VAO = GLVertexArray::create();
+    VBO = GLBuffer::create();
+    EBO = GLBuffer::create();
 
     glBindVertexArray(VAO);
     // load data into vertex buffers
@@ -66,12 +220,23 @@ void Mesh::setupMesh()
     // A great thing about structs is that their memory layout is sequential for all its items.
     // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
     // again translates to 3/2 floats which translates to a byte array.
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+    // Buffers are dynamic since simplification patches them in place (see updateIndices/updateVertices)
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_DYNAMIC_DRAW);
+    vertexCapacity = vertices.size();
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_DYNAMIC_DRAW);
+    indexCapacity = indices.size();
+    indexCount = static_cast<unsigned int>(indices.size());
 
-    // set the vertex attribute pointers
+    setupAttributes();
+
+    glBindVertexArray(0);
+}
+
+void Mesh::setupAttributes()
+{
+    // Expects the VAO and the vertex buffer to be bound
     // vertex Positions
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
@@ -81,6 +246,104 @@ void Mesh::setupMesh()
     // vertex texture coords
     glEnableVertexAttribArray(2);
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+    // geomorph targets, location 3 is left for the draw id of batched draws
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, MorphPosition));
+    glEnableVertexAttribArray(5);
+    glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, MorphNormal));
+}
 
+void Mesh::updateIndices(const std::vector<unsigned int>& newIndices)
+{
+    TRACE_ZONE("upload indices");
+    // The element buffer binding is part of the VAO state, so bind the VAO before touching it
+    glBindVertexArray(VAO);
+    lastUploadBytes = uploadChangedRanges(GL_ELEMENT_ARRAY_BUFFER, EBO, indexCapacity, indices, newIndices);
     glBindVertexArray(0);
-}
\ No newline at end of file
+
+    indexCount = static_cast<unsigned int>(indices.size());
+    meshletsDirty = true;
+}
+
+void Mesh::updateVertices(const std::vector<Vertex>& newVertices)
+{
+    TRACE_ZONE("upload vertices");
+    lastUploadBytes = uploadChangedRanges(GL_ARRAY_BUFFER, VBO, vertexCapacity, vertices, newVertices);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    computeBounds();
+    // Bounds and cones of the meshlets depend on the positions
+    meshletsDirty = true;
+}
+
+void Mesh::computeBounds()
+{
+    bounds = Bounds();
+    for (const Vertex& vertex : vertices)
+    {
+        bounds.boxMin = glm::min(bounds.boxMin, vertex.Position);
+        bounds.boxMax = glm::max(bounds.boxMax, vertex.Position);
+    }
+    if (bounds.empty())
+        return;
+
+    // Sphere around the box center, tighter than the sphere around the box
+    bounds.center = (bounds.boxMin + bounds.boxMax) * 0.5f;
+    for (const Vertex& vertex : vertices)
+        bounds.radius = std::max(bounds.radius, glm::length(vertex.Position - bounds.center));
+}
+
+// Compares the new data against the CPU copy of what is on the GPU and only uploads the runs that changed.
+// The buffer is only reallocated when the new data doesn't fit, it then grows by half again to absorb later growth.
+template<typename T>
+size_t Mesh::uploadChangedRanges(GLenum target, GLuint buffer, size_t& capacity, std::vector<T>& current, const std::vector<T>& updated)
+{
+    glBindBuffer(target, buffer);
+
+    if (updated.size() > capacity)
+    {
+        capacity = updated.size() + updated.size() / 2;
+        glBufferData(target, capacity * sizeof(T), nullptr, GL_DYNAMIC_DRAW);
+        glBufferSubData(target, 0, updated.size() * sizeof(T), updated.data());
+        current = updated;
+        return updated.size() * sizeof(T);
+    }
+
+    size_t uploaded = 0;
+    size_t common = std::min(current.size(), updated.size());
+    size_t i = 0;
+    while (i < common)
+    {
+        if (std::memcmp(&current[i], &updated[i], sizeof(T)) == 0)
+        {
+            i++;
+            continue;
+        }
+
+        // Extend the run until a long enough stretch of unchanged elements is found
+        size_t start = i;
+        size_t lastChanged = i;
+        while (i < common && i - lastChanged <= UPLOAD_MERGE_GAP)
+        {
+            if (std::memcmp(&current[i], &updated[i], sizeof(T)) != 0)
+                lastChanged = i;
+            i++;
+        }
+
+        size_t count = lastChanged + 1 - start;
+        glBufferSubData(target, start * sizeof(T), count * sizeof(T), &updated[start]);
+        uploaded += count * sizeof(T);
+    }
+
+    // Anything past the old size is new data
+    if (updated.size() > common)
+    {
+        size_t count = updated.size() - common;
+        glBufferSubData(target, common * sizeof(T), count * sizeof(T), &updated[common]);
+        uploaded += count * sizeof(T);
+    }
+
+    // Reuses the existing allocation of the CPU copy
+    current.assign(updated.begin(), updated.end());
+
+    return uploaded;
+}
@@ -6,25 +6,22 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <map>
+#include <memory>
 #include <string>
 #include <vector>
-#include <map>
 
+#include "BinaryMesh.h"
+#include "Frustum.h"
+#include "GLResource.h"
+#include "MemoryReport.h"
+#include "Meshlet.h"
 #include "Shader.h"
+#include "Vertex.h"
 
 struct Face;
 struct Hetest;
 
-struct Vertex
-{
-	glm::vec3 Position;
-	glm::vec3 Normal;
-	glm::vec2 TexCoords;
-
-	unsigned int index;
-	glm::mat4 quadric = glm::mat4(0.0f);
-};
-
 struct HalfEdge
 {
 	Vertex* vertex;
@@ -71,6 +68,10 @@ struct Vertextest {
 struct Facetest {
 	Hetest* halfEdge;
 	bool removed = false;
+
+	// Counted, so the report shows what the trial holds
+	static void* operator new(size_t size) { trackBytes(MemoryTag::HalfEdgeNodes, size); return ::operator new(size); }
+	static void operator delete(void* pointer, size_t size) { trackBytes(MemoryTag::HalfEdgeNodes, -static_cast<int64_t>(size)); ::operator delete(pointer); }
 };
 
 struct Hetest
@@ -84,6 +85,9 @@ struct Hetest
 	bool removed = false;
 
 	float cost;
+
+	static void* operator new(size_t size) { trackBytes(MemoryTag::HalfEdgeNodes, size); return ::operator new(size); }
+	static void operator delete(void* pointer, size_t size) { trackBytes(MemoryTag::HalfEdgeNodes, -static_cast<int64_t>(size)); ::operator delete(pointer); }
 };
 
 struct Texture
@@ -101,24 +105,79 @@ public:
 	std::vector<Texture> textures;
 	std::map<TestFS, HalfEdge*> edges;
 	std::vector<Face*> faces;
-	unsigned int VAO;
+	GLVertexArray VAO;
 
 	// My trial of implementing the algorithm
 	std::vector<Vertextest> vtest;
 	std::vector<Normaltest> ntest;
 	std::vector<unsigned int> itest;
 	std::vector<Facetest*> ftest;
-	std::map<TestFS, Hetest*> etest;
+	std::map<TestFS, Hetest*, std::less<TestFS>, TrackingAllocator<std::pair<const TestFS, Hetest*>, MemoryTag::HalfEdgeMap>> etest;
+	// Every half-edge and face the trial made, etest and ftest only point at them so they go with the mesh
+	std::vector<std::unique_ptr<Hetest>> hetestNodes;
+	std::vector<std::unique_ptr<Facetest>> facetestNodes;
 
+	// Bounding box and sphere of the vertices in model space, for culling
+	Bounds bounds;
+
+	// Clusters of the current indices, built on first use and rebuilt after the indices change
+	std::vector<Meshlet> meshlets;
+	std::vector<unsigned int> meshletIndices; // The indices reordered so each meshlet is a contiguous range
+	size_t meshletsCulled = 0; // Meshlets skipped by the last DrawMeshlets
+
+	// Bytes sent to the GPU by the last update, used to check that uploads scale with the change
+	size_t lastUploadBytes = 0;
+
+	// Takes ownership of the data, move the vectors in to avoid copying them
 	Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures);
 
+	// Meshes own their GPU buffers, so they can only be moved
+	Mesh(const Mesh&) = delete;
+	Mesh& operator=(const Mesh&) = delete;
+	Mesh(Mesh&&) = default;
+	Mesh& operator=(Mesh&&) = default;
+
 	void Draw(Shader& shader);
+	void DrawInstanced(Shader& shader, unsigned int instanceCount);
+	// Draws parts of the index list in one call, offsets are in bytes
+	void DrawRanges(Shader& shader, const std::vector<GLsizei>& counts, const std::vector<const void*>& offsets);
+	// Draws only the meshlets that pass isMeshletCulled, frustum and view position are in model space
+	void DrawMeshlets(Shader& shader, const Frustum& frustum, const glm::vec3& viewPosition);
+
+	// Builds the meshlets if the indices changed since they were last built
+	void ensureMeshlets();
+	// Copy of the render data with meshlets, in the form written to the binary cache
+	MeshData toMeshData();
+	// Bytes of the CPU side arrays, GPU buffers aren't counted
+	void reportMemory(MemoryStage& stage) const;
+
+	// Patch the existing GPU buffers with new data, only the ranges that differ are uploaded
+	void updateIndices(const std::vector<unsigned int>& newIndices);
+	void updateVertices(const std::vector<Vertex>& newVertices);
 
 private:
 	// render data
-	unsigned int VBO, EBO;
+	GLBuffer VBO, EBO;
+	// Second index buffer holding meshletIndices, with a VAO sharing the vertex buffer
+	GLVertexArray meshletVAO;
+	GLBuffer meshletEBO;
+	bool meshletsDirty = true;
+	std::vector<GLsizei> meshletCounts; // Per frame multi-draw lists
+	std::vector<const void*> meshletOffsets;
+	unsigned int indexCount = 0; // Number of indices drawn
+	size_t vertexCapacity = 0; // Sizes of the GPU buffers in elements
+	size_t indexCapacity = 0;
+	std::vector<std::string> samplerNames; // Uniform name for each texture, e.g. texture_diffuse1
 
 	void setupMesh();
+	void setupAttributes();
+	void setupSamplerNames();
+	void computeBounds();
+	void bindTextures(Shader& shader);
+	void drawRanges(Shader& shader, GLuint vertexArray, const std::vector<GLsizei>& counts, const std::vector<const void*>& offsets);
+
+	template<typename T>
+	size_t uploadChangedRanges(GLenum target, GLuint buffer, size_t& capacity, std::vector<T>& current, const std::vector<T>& updated);
 };
 
 
@@ -0,0 +1,197 @@
+#include "MeshBatch.h"
+
+#include <glm/gtc/matrix_inverse.hpp>
+
+#include <algorithm>
+
+MeshBatch::MeshBatch()
+{
+    VAO = GLVertexArray::create();
+    vertexBuffer = GLBuffer::create();
+    indexBuffer = GLBuffer::create();
+    drawIdBuffer = GLBuffer::create();
+    commandBuffer = GLBuffer::create();
+    drawDataBuffer = GLBuffer::create();
+    materialBuffer = GLBuffer::create();
+
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+
+    // Same attribute locations as Mesh, so the usual vertex inputs work unchanged
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(BatchVertex), (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(BatchVertex), (void*)offsetof(BatchVertex, Normal));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(BatchVertex), (void*)offsetof(BatchVertex, TexCoords));
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(BatchVertex), (void*)offsetof(BatchVertex, MorphPosition));
+    glEnableVertexAttribArray(5);
+    glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, sizeof(BatchVertex), (void*)offsetof(BatchVertex, MorphNormal));
+
+    // One value per instance, the base instance of each command selects the draw
+    glBindBuffer(GL_ARRAY_BUFFER, drawIdBuffer);
+    glEnableVertexAttribArray(BATCH_DRAW_ID_ATTRIBUTE);
+    glVertexAttribIPointer(BATCH_DRAW_ID_ATTRIBUTE, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+    glVertexAttribDivisor(BATCH_DRAW_ID_ATTRIBUTE, 1);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void MeshBatch::clear()
+{
+    vertices.clear();
+    indices.clear();
+    ranges.clear();
+    materials.clear();
+    commands.clear();
+    drawData.clear();
+    uploadedVertices = 0;
+    uploadedIndices = 0;
+}
+
+void MeshBatch::truncate(size_t meshId)
+{
+    if (meshId >= ranges.size())
+        return;
+    vertices.resize(ranges[meshId].baseVertex);
+    indices.resize(ranges[meshId].firstIndex);
+    ranges.resize(meshId);
+    uploadedVertices = std::min(uploadedVertices, vertices.size());
+    uploadedIndices = std::min(uploadedIndices, indices.size());
+}
+
+size_t MeshBatch::addMesh(const Mesh& mesh)
+{
+    MeshRange range;
+    range.firstIndex = static_cast<GLuint>(indices.size());
+    range.indexCount = static_cast<GLuint>(mesh.indices.size());
+    range.baseVertex = static_cast<GLint>(vertices.size());
+
+    for (const Vertex& vertex : mesh.vertices)
+        vertices.push_back({ vertex.Position, vertex.Normal, vertex.TexCoords, vertex.MorphPosition, vertex.MorphNormal });
+    // Indices stay relative to the mesh, the base vertex of the draw offsets them
+    indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+
+    ranges.push_back(range);
+    return ranges.size() - 1;
+}
+
+size_t MeshBatch::addMaterial(float shininess)
+{
+    materials.push_back(glm::vec4(shininess, 0.0f, 0.0f, 0.0f));
+    return materials.size() - 1;
+}
+
+template<typename T>
+size_t MeshBatch::uploadTail(GLenum target, size_t& capacity, size_t& uploaded, const std::vector<T>& values)
+{
+    if (values.size() > capacity)
+    {
+        capacity = values.size() + values.size() / 2;
+        glBufferData(target, capacity * sizeof(T), nullptr, GL_DYNAMIC_DRAW);
+        uploaded = 0;
+    }
+
+    size_t bytes = (values.size() - uploaded) * sizeof(T);
+    if (bytes > 0)
+        glBufferSubData(target, uploaded * sizeof(T), bytes, values.data() + uploaded);
+    uploaded = values.size();
+    return bytes;
+}
+
+void MeshBatch::upload()
+{
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    uploadBytes = uploadTail(GL_ARRAY_BUFFER, vertexCapacity, uploadedVertices, vertices);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // The element buffer binding belongs to the VAO
+    glBindVertexArray(VAO);
+    uploadBytes += uploadTail(GL_ELEMENT_ARRAY_BUFFER, indexCapacity, uploadedIndices, indices);
+    glBindVertexArray(0);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, materialBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, materials.size() * sizeof(glm::vec4), materials.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void MeshBatch::beginFrame()
+{
+    commands.clear();
+    drawData.clear();
+}
+
+void MeshBatch::queueDraw(size_t meshId, const glm::mat4& model, unsigned int material, float morphFactor)
+{
+    const MeshRange& range = ranges[meshId];
+
+    DrawCommand command;
+    command.count = range.indexCount;
+    command.instanceCount = 1;
+    command.firstIndex = range.firstIndex;
+    command.baseVertex = range.baseVertex;
+    command.baseInstance = static_cast<GLuint>(commands.size());
+    commands.push_back(command);
+
+    DrawData data = {};
+    data.model = model;
+    data.normalMatrix = glm::mat3x4(glm::inverseTranspose(glm::mat3(model)));
+    data.material = material;
+    data.morphFactor = morphFactor;
+    drawData.push_back(data);
+}
+
+void MeshBatch::draw()
+{
+    if (commands.empty())
+        return;
+
+    reserveDraws(commands.size());
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands.size() * sizeof(DrawCommand), commands.data());
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawDataBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, drawData.size() * sizeof(DrawData), drawData.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BATCH_DRAW_BUFFER_BINDING, drawDataBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BATCH_MATERIAL_BUFFER_BINDING, materialBuffer);
+
+    gpuTimer.beginFrame(2);
+    gpuTimer.mark(0);
+    glBindVertexArray(VAO);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)0, static_cast<GLsizei>(commands.size()), 0);
+    glBindVertexArray(0);
+    gpuTimer.mark(1);
+    gpuTimer.endFrame();
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void MeshBatch::reserveDraws(size_t count)
+{
+    if (count <= drawCapacity)
+        return;
+
+    drawCapacity = count + count / 2;
+
+    // Draw ids are fixed, draw i always reads element i
+    std::vector<GLuint> drawIds(drawCapacity);
+    for (size_t i = 0; i < drawCapacity; i++)
+        drawIds[i] = static_cast<GLuint>(i);
+    glBindBuffer(GL_ARRAY_BUFFER, drawIdBuffer);
+    glBufferData(GL_ARRAY_BUFFER, drawCapacity * sizeof(GLuint), drawIds.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, drawCapacity * sizeof(DrawCommand), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawDataBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, drawCapacity * sizeof(DrawData), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
@@ -0,0 +1,113 @@
+#ifndef MESHBATCH_H
+#define MESHBATCH_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "GLResource.h"
+#include "GpuTimer.h"
+#include "Mesh.h"
+
+// Shader storage binding points used by res/shaders/batched.vert
+const GLuint BATCH_DRAW_BUFFER_BINDING = 0;
+const GLuint BATCH_MATERIAL_BUFFER_BINDING = 1;
+// Vertex attribute holding the index of the draw, fed through the base instance of each command
+const GLuint BATCH_DRAW_ID_ATTRIBUTE = 3;
+
+// Packs many meshes into shared vertex and index buffers behind one VAO and draws all of them
+// with a single glMultiDrawElementsIndirect call. Per draw transforms and material indices are
+// read from a shader storage buffer, so the CPU cost of a frame doesn't grow with the mesh count.
+class MeshBatch
+{
+public:
+	MeshBatch();
+
+	// Removes all meshes and materials
+	void clear();
+	// Removes the meshes from meshId on, so the model added last can be replaced without touching the ones before it
+	void truncate(size_t meshId);
+	// Appends the geometry of the mesh and returns the id used to queue draws of it
+	size_t addMesh(const Mesh& mesh);
+	size_t addMaterial(float shininess);
+	// Sends the geometry added since the last upload to the GPU, call once after adding meshes.
+	// The buffers are only reallocated when they are outgrown, they then grow by half again.
+	void upload();
+
+	// Per frame list of draws
+	void beginFrame();
+	void queueDraw(size_t meshId, const glm::mat4& model, unsigned int material, float morphFactor = 0.0f);
+	void draw();
+
+	size_t drawCount() const { return commands.size(); }
+	size_t meshCount() const { return ranges.size(); }
+	size_t lastUploadBytes() const { return uploadBytes; }
+	// GPU time of the whole multi-draw, the meshes in it can't be timed one by one
+	const GpuTimer& getGpuTimer() const { return gpuTimer; }
+
+private:
+	// Layout expected by glMultiDrawElementsIndirect
+	struct DrawCommand
+	{
+		GLuint count;
+		GLuint instanceCount;
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;
+	};
+
+	// std430 layout of DrawData in batched.vert
+	struct DrawData
+	{
+		glm::mat4 model;
+		glm::mat3x4 normalMatrix; // mat3 columns are padded to vec4
+		GLuint material;
+		float morphFactor;
+		GLuint padding[2];
+	};
+	static_assert(sizeof(DrawData) == 128, "DrawData must match the std430 layout");
+
+	// Only what the shaders read, without the simplification data stored in Vertex
+	struct BatchVertex
+	{
+		glm::vec3 Position;
+		glm::vec3 Normal;
+		glm::vec2 TexCoords;
+		glm::vec3 MorphPosition;
+		glm::vec3 MorphNormal;
+	};
+
+	struct MeshRange
+	{
+		GLuint firstIndex;
+		GLuint indexCount;
+		GLint baseVertex;
+	};
+
+	GLVertexArray VAO;
+	GLBuffer vertexBuffer, indexBuffer, drawIdBuffer, commandBuffer, drawDataBuffer, materialBuffer;
+
+	std::vector<BatchVertex> vertices;
+	std::vector<unsigned int> indices;
+	std::vector<MeshRange> ranges;
+	std::vector<glm::vec4> materials; // x holds the shininess
+
+	std::vector<DrawCommand> commands;
+	std::vector<DrawData> drawData;
+	size_t drawCapacity = 0; // Number of draws the per draw buffers can hold
+	// Elements of the arrays already on the GPU and sizes of the GPU buffers
+	size_t uploadedVertices = 0, uploadedIndices = 0;
+	size_t vertexCapacity = 0, indexCapacity = 0;
+	size_t uploadBytes = 0;
+
+	GpuTimer gpuTimer;
+
+	void reserveDraws(size_t count);
+	// Uploads the values past the uploaded count, returns the bytes sent
+	template<typename T>
+	size_t uploadTail(GLenum target, size_t& capacity, size_t& uploaded, const std::vector<T>& values);
+};
+
+#endif
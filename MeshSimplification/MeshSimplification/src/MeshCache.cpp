@@ -0,0 +1,281 @@
+#include "MeshCache.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "Trace.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    const char* const ENTRY_EXTENSION = ".msbm";
+    // Temporary files this old are left by interrupted stores, younger ones may still be written by another process
+    const std::chrono::minutes STALE_TEMPORARY_AGE(10);
+
+    // 64 bit multiply and xor-shift hash, eight bytes per step so hashing a large mesh costs about as much as reading it
+    class Hasher
+    {
+    public:
+        void add(const char* bytes, size_t count)
+        {
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8)
+            {
+                uint64_t word;
+                std::memcpy(&word, bytes + i, 8);
+                mix(word);
+            }
+            uint64_t tail = 0;
+            std::memcpy(&tail, bytes + i, count - i);
+            mix(tail ^ (static_cast<uint64_t>(count - i) << 56));
+            length += count;
+        }
+
+        void add(const std::string& text)
+        {
+            add(text.data(), text.size());
+        }
+
+        uint64_t finish() const
+        {
+            uint64_t h = state ^ length;
+            h ^= h >> 33;
+            h *= 0xff51afd7ed558ccdull;
+            h ^= h >> 33;
+            h *= 0xc4ceb9fe1a85ec53ull;
+            h ^= h >> 33;
+            return h;
+        }
+
+    private:
+        uint64_t state = 0x9e3779b97f4a7c15ull;
+        uint64_t length = 0;
+
+        void mix(uint64_t word)
+        {
+            word *= 0x87c37b91114253d5ull;
+            word = (word << 31) | (word >> 33);
+            state ^= word * 0x4cf5ad432745937full;
+            state = ((state << 27) | (state >> 37)) * 5 + 0x52dce729;
+        }
+    };
+
+    std::string toHex(uint64_t value)
+    {
+        char text[17];
+        snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(value));
+        return text;
+    }
+}
+
+MeshCache::MeshCache(const std::string& directory, uint64_t capacityBytes)
+    : root(directory), capacityBytes(capacityBytes)
+{
+    std::error_code error;
+    fs::create_directories(root, error);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    evict();
+}
+
+void MeshCache::scan()
+{
+    // Entries of earlier runs and other processes, with temporary files of interrupted stores cleaned up
+    entries.clear();
+    totalBytes = 0;
+    fs::file_time_type now = fs::file_time_type::clock::now();
+    std::error_code error;
+    for (fs::directory_iterator it(root, error), end; it != end; it.increment(error))
+    {
+        if (!it->is_regular_file(error))
+            continue;
+        const fs::path& path = it->path();
+        if (path.extension() != ENTRY_EXTENSION)
+        {
+            if (path.extension() == ".tmp" && now - it->last_write_time(error) > STALE_TEMPORARY_AGE)
+                fs::remove(path, error);
+            continue;
+        }
+
+        Entry entry;
+        entry.bytes = it->file_size(error);
+        entry.lastUse = it->last_write_time(error);
+        entries[path.stem().string()] = entry;
+        totalBytes += entry.bytes;
+    }
+}
+
+uint64_t MeshCache::hashFile(const std::string& path)
+{
+    TRACE_ZONE("hash input");
+    std::error_code error;
+    uintmax_t size = fs::file_size(path, error);
+    if (error)
+        return 0;
+    fs::file_time_type modified = fs::last_write_time(path, error);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = fileHashes.find(path);
+        if (found != fileHashes.end() && found->second.size == size && found->second.modified == modified)
+            return found->second.hash;
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return 0;
+
+    Hasher hasher;
+    std::vector<char> buffer(1 << 20);
+    while (file)
+    {
+        file.read(buffer.data(), buffer.size());
+        hasher.add(buffer.data(), static_cast<size_t>(file.gcount()));
+    }
+    uint64_t hash = hasher.finish();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    fileHashes[path] = { size, modified, hash };
+    return hash;
+}
+
+std::string MeshCache::makeKey(uint64_t geometryHash, const std::string& engine, const std::string& target, const std::string& parameters)
+{
+    // Separators keep ("ab", "c") and ("a", "bc") apart
+    Hasher hasher;
+    hasher.add(engine + '\n' + target + '\n' + parameters + '\n');
+    std::string version = std::to_string(BINARY_MESH_VERSION);
+    hasher.add(version);
+    return toHex(geometryHash) + '-' + toHex(hasher.finish());
+}
+
+fs::path MeshCache::entryPath(const std::string& key) const
+{
+    return fs::path(root) / (key + ENTRY_EXTENSION);
+}
+
+bool MeshCache::load(const std::string& key, MeshData& data)
+{
+    TRACE_ZONE("cache load");
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (entries.find(key) == entries.end())
+        {
+            // Another process sharing the directory may have stored it since the last scan
+            std::error_code error;
+            fs::path path = entryPath(key);
+            uintmax_t bytes = fs::file_size(path, error);
+            fs::file_time_type lastUse = fs::last_write_time(path, error);
+            if (error)
+            {
+                missCount++;
+                return false;
+            }
+            entries[key] = { bytes, lastUse };
+            totalBytes += bytes;
+        }
+    }
+
+    fs::path path = entryPath(key);
+    if (!readBinaryMesh(path.string(), data))
+    {
+        // Removed by another process, or written by an older version
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = entries.find(key);
+        if (found != entries.end())
+        {
+            totalBytes -= found->second.bytes;
+            entries.erase(found);
+        }
+        std::error_code error;
+        fs::remove(path, error);
+        missCount++;
+        return false;
+    }
+
+    std::error_code error;
+    fs::file_time_type now = fs::file_time_type::clock::now();
+    fs::last_write_time(path, now, error);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = entries.find(key);
+    if (found != entries.end())
+        found->second.lastUse = now;
+    hitCount++;
+    return true;
+}
+
+bool MeshCache::store(const std::string& key, const MeshData& data)
+{
+    TRACE_ZONE("cache store");
+    fs::path path = entryPath(key);
+    fs::path temporary = path;
+    temporary += "." + toHex(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+    if (!writeBinaryMesh(temporary.string(), data))
+        return false;
+
+    std::error_code error;
+    uintmax_t bytes = fs::file_size(temporary, error);
+    fs::rename(temporary, path, error);
+    if (error)
+    {
+        std::cerr << "ERROR::MESH_CACHE::Could not store " << path.string() << ": " << error.message() << std::endl;
+        fs::remove(temporary, error);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry& entry = entries[key];
+    totalBytes -= entry.bytes;
+    entry.bytes = bytes;
+    entry.lastUse = fs::file_time_type::clock::now();
+    totalBytes += entry.bytes;
+    evict();
+    return true;
+}
+
+void MeshCache::setCapacity(uint64_t capacityBytes)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    this->capacityBytes = capacityBytes;
+    evict();
+}
+
+size_t MeshCache::entryCount()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
+
+uint64_t MeshCache::sizeBytes()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return totalBytes;
+}
+
+void MeshCache::evict()
+{
+    // Other processes may have stored, removed or used entries since the last scan, so the size and the use order
+    // are taken from the directory. A listing per store and a linear search per eviction, the cache holds hundreds of
+    // entries rather than millions.
+    scan();
+    while (totalBytes > capacityBytes && !entries.empty())
+    {
+        auto oldest = entries.begin();
+        for (auto it = entries.begin(); it != entries.end(); ++it)
+            if (it->second.lastUse < oldest->second.lastUse)
+                oldest = it;
+
+        std::error_code error;
+        fs::remove(entryPath(oldest->first), error);
+        totalBytes -= oldest->second.bytes;
+        entries.erase(oldest);
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "BinaryMesh.h"
+
+const uint64_t MESH_CACHE_DEFAULT_CAPACITY = 1024ull * 1024 * 1024;
+
+// On disk cache of simplification results, one binary mesh per key in a single directory.
+// Keys are made from the content of the input file and every setting that changes the result, so renamed or copied inputs
+// share their entries and a changed input never returns a stale one.
+// Entries are evicted least recently used first once the directory grows past the capacity. The use time is the file's
+// modification time, so the order survives restarts and several processes can share a directory: a miss looks for an
+// entry another process stored, and every store scans the directory again before evicting.
+// Safe to use from several threads at once.
+class MeshCache
+{
+public:
+	explicit MeshCache(const std::string& directory, uint64_t capacityBytes = MESH_CACHE_DEFAULT_CAPACITY);
+
+	// Hash of the bytes of a file, 0 if it can't be read.
+	// Remembered per path, size and modification time, so asking again for an unchanged file doesn't read it.
+	uint64_t hashFile(const std::string& path);
+	// Key of a result, target and parameters are free form but have to describe the request exactly (e.g. "f5000", "r0.5")
+	static std::string makeKey(uint64_t geometryHash, const std::string& engine, const std::string& target, const std::string& parameters);
+
+	// False on a miss, a hit marks the entry as the most recently used
+	bool load(const std::string& key, MeshData& data);
+	// Written to a temporary file and renamed, so readers never see half an entry
+	bool store(const std::string& key, const MeshData& data);
+
+	void setCapacity(uint64_t capacityBytes);
+	uint64_t capacity() const { return capacityBytes; }
+	const std::string& directory() const { return root; }
+
+	size_t hits() const { return hitCount; }
+	size_t misses() const { return missCount; }
+	size_t entryCount();
+	uint64_t sizeBytes();
+
+private:
+	struct Entry
+	{
+		uint64_t bytes;
+		std::filesystem::file_time_type lastUse;
+	};
+
+	struct FileHash
+	{
+		uintmax_t size;
+		std::filesystem::file_time_type modified;
+		uint64_t hash;
+	};
+
+	std::string root;
+	std::atomic<uint64_t> capacityBytes;
+
+	std::mutex mutex;
+	std::unordered_map<std::string, Entry> entries;
+	std::unordered_map<std::string, FileHash> fileHashes;
+	uint64_t totalBytes = 0;
+	std::atomic<size_t> hitCount{ 0 };
+	std::atomic<size_t> missCount{ 0 };
+
+	std::filesystem::path entryPath(const std::string& key) const;
+	// Rebuilds the entries from the directory. Expects the mutex to be held, as does evict.
+	void scan();
+	void evict();
+};
+
+#endif
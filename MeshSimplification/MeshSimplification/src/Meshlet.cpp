@@ -0,0 +1,207 @@
+#include "Meshlet.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "Trace.h"
+
+// Below this the normal cone is wider than a hemisphere give or take, and the cluster is never culled by facing
+const float MESHLET_MIN_CONE_DOT = 0.1f;
+
+namespace
+{
+    void computeBounds(Meshlet& meshlet, const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& morphPositions, const unsigned int* triangles,
+        std::vector<glm::vec3>& normals)
+    {
+        size_t indexCount = meshlet.indexCount;
+
+        // Sphere around the box center of the referenced vertices, morph targets included so it holds while blending
+        glm::vec3 boxMin(FLT_MAX), boxMax(-FLT_MAX);
+        for (size_t i = 0; i < indexCount; i++)
+        {
+            boxMin = glm::min(boxMin, positions[triangles[i]]);
+            boxMax = glm::max(boxMax, positions[triangles[i]]);
+            if (!morphPositions.empty())
+            {
+                boxMin = glm::min(boxMin, morphPositions[triangles[i]]);
+                boxMax = glm::max(boxMax, morphPositions[triangles[i]]);
+            }
+        }
+        meshlet.center = (boxMin + boxMax) * 0.5f;
+        meshlet.radius = 0.0f;
+        for (size_t i = 0; i < indexCount; i++)
+        {
+            meshlet.radius = std::max(meshlet.radius, glm::length(positions[triangles[i]] - meshlet.center));
+            if (!morphPositions.empty())
+                meshlet.radius = std::max(meshlet.radius, glm::length(morphPositions[triangles[i]] - meshlet.center));
+        }
+
+        // Normal cone over the triangles at both ends of the morph
+        normals.clear();
+        for (int pass = 0; pass < (morphPositions.empty() ? 1 : 2); pass++)
+        {
+            const std::vector<glm::vec3>& points = pass == 0 ? positions : morphPositions;
+            for (size_t i = 0; i < indexCount; i += 3)
+            {
+                glm::vec3 normal = glm::cross(points[triangles[i + 1]] - points[triangles[i]], points[triangles[i + 2]] - points[triangles[i]]);
+                float length = glm::length(normal);
+                // Collapsed triangles have no direction and can't be seen either
+                if (length > 0.0f)
+                    normals.push_back(normal / length);
+            }
+        }
+
+        glm::vec3 axis(0.0f);
+        for (const glm::vec3& normal : normals)
+            axis += normal;
+        float axisLength = glm::length(axis);
+
+        meshlet.coneAxis = axisLength > 0.0f ? axis / axisLength : glm::vec3(0.0f, 0.0f, 1.0f);
+        meshlet.coneCutoff = 1.0f;
+        if (axisLength == 0.0f)
+            return;
+
+        float minDot = 1.0f;
+        for (const glm::vec3& normal : normals)
+            minDot = std::min(minDot, glm::dot(normal, meshlet.coneAxis));
+        if (minDot > MESHLET_MIN_CONE_DOT)
+            meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+    }
+}
+
+std::vector<Meshlet> buildMeshlets(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& morphPositions, std::vector<unsigned int>& indices,
+    size_t maxVertices, size_t maxTriangles)
+{
+    std::vector<Meshlet> meshlets;
+    MeshletScratch scratch;
+    buildMeshlets(positions, morphPositions, indices, meshlets, scratch, maxVertices, maxTriangles);
+    return meshlets;
+}
+
+void buildMeshlets(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& morphPositions, std::vector<unsigned int>& indices,
+    std::vector<Meshlet>& meshlets, MeshletScratch& scratch, size_t maxVertices, size_t maxTriangles)
+{
+    TRACE_ZONE("meshlets");
+    meshlets.clear();
+    size_t triangleCount = indices.size() / 3;
+    size_t vertexCount = positions.size();
+    if (triangleCount == 0)
+        return;
+
+    // Triangles around each vertex, stored as one list with an offset per vertex
+    std::vector<unsigned int>& adjacencyOffsets = scratch.adjacencyOffsets;
+    adjacencyOffsets.assign(vertexCount + 1, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+        adjacencyOffsets[indices[i] + 1]++;
+    for (size_t v = 0; v < vertexCount; v++)
+        adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+    std::vector<unsigned int>& adjacency = scratch.adjacency;
+    adjacency.resize(triangleCount * 3);
+    std::vector<unsigned int>& fill = scratch.fill;
+    fill.assign(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+        adjacency[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+
+    std::vector<bool>& emitted = scratch.emitted;
+    emitted.assign(triangleCount, false);
+    // Last meshlet each vertex or triangle was counted in, so nothing has to be cleared between meshlets
+    std::vector<size_t>& vertexStamp = scratch.vertexStamp;
+    std::vector<size_t>& candidateStamp = scratch.candidateStamp;
+    vertexStamp.assign(vertexCount, SIZE_MAX);
+    candidateStamp.assign(triangleCount, SIZE_MAX);
+
+    std::vector<unsigned int>& reordered = scratch.reordered;
+    reordered.clear();
+    reordered.reserve(triangleCount * 3);
+    std::vector<unsigned int>& candidates = scratch.candidates;
+    size_t nextSeed = 0;
+
+    while (true)
+    {
+        // Each meshlet starts at the first triangle left in the original order, which keeps the cache order of the input
+        while (nextSeed < triangleCount && emitted[nextSeed])
+            nextSeed++;
+        if (nextSeed == triangleCount)
+            break;
+
+        size_t id = meshlets.size();
+        Meshlet meshlet = {};
+        meshlet.firstIndex = static_cast<unsigned int>(reordered.size());
+        candidates.clear();
+
+        size_t triangle = nextSeed;
+        while (true)
+        {
+            emitted[triangle] = true;
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int vertex = indices[triangle * 3 + k];
+                reordered.push_back(vertex);
+                if (vertexStamp[vertex] == id)
+                    continue;
+
+                vertexStamp[vertex] = id;
+                meshlet.vertexCount++;
+                for (unsigned int a = adjacencyOffsets[vertex]; a < adjacencyOffsets[vertex + 1]; a++)
+                {
+                    unsigned int neighbour = adjacency[a];
+                    if (!emitted[neighbour] && candidateStamp[neighbour] != id)
+                    {
+                        candidateStamp[neighbour] = id;
+                        candidates.push_back(neighbour);
+                    }
+                }
+            }
+            meshlet.indexCount += 3;
+            if (meshlet.indexCount / 3 >= maxTriangles)
+                break;
+
+            // Grow by the neighbour that adds the fewest new vertices, which keeps the cluster round
+            size_t best = SIZE_MAX;
+            unsigned int bestAdded = 4;
+            for (size_t c = 0; c < candidates.size();)
+            {
+                unsigned int candidate = candidates[c];
+                if (emitted[candidate])
+                {
+                    candidates[c] = candidates.back();
+                    candidates.pop_back();
+                    continue;
+                }
+
+                unsigned int added = 0;
+                for (int k = 0; k < 3; k++)
+                    added += vertexStamp[indices[candidate * 3 + k]] != id;
+                if (added < bestAdded)
+                {
+                    best = candidate;
+                    bestAdded = added;
+                    if (added == 0)
+                        break;
+                }
+                c++;
+            }
+
+            if (best == SIZE_MAX || meshlet.vertexCount + bestAdded > maxVertices)
+                break;
+            triangle = best;
+        }
+
+        computeBounds(meshlet, positions, morphPositions, &reordered[meshlet.firstIndex], scratch.normals);
+        meshlets.push_back(meshlet);
+    }
+
+    // The old index buffer becomes the next call's reordering buffer
+    indices.swap(reordered);
+}
+
+bool isMeshletCulled(const Meshlet& meshlet, const Frustum& frustum, const glm::vec3& viewPosition)
+{
+    if (!frustum.intersectsSphere(meshlet.center, meshlet.radius))
+        return true;
+
+    // Back facing when the viewer is inside the cone mirrored behind the cluster, widened by the sphere
+    glm::vec3 toCenter = meshlet.center - viewPosition;
+    return glm::dot(toCenter, meshlet.coneAxis) >= meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius;
+}
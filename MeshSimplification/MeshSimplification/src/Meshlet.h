@@ -0,0 +1,60 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "Frustum.h"
+
+// Limits of a cluster, the sizes mesh shading hardware is built around
+const size_t MESHLET_MAX_VERTICES = 64;
+const size_t MESHLET_MAX_TRIANGLES = 124;
+
+// A small cluster of neighbouring triangles, stored as a contiguous range of a reordered index list.
+// Carries enough bounds to be culled on its own, against the frustum and by the directions its triangles face.
+struct Meshlet
+{
+	unsigned int firstIndex;
+	unsigned int indexCount;
+	unsigned int vertexCount; // Distinct vertices referenced by the cluster
+
+	glm::vec3 center;
+	float radius;
+
+	// Every triangle normal is within the cone around the axis, whose half angle has the sine coneCutoff.
+	// A cutoff of 1 means the triangles face too many ways for the cluster to ever be back facing as a whole.
+	glm::vec3 coneAxis;
+	float coneCutoff;
+};
+
+// Splits the triangles into meshlets, growing each one through shared vertices so clusters stay compact.
+// The indices are reordered in place so each meshlet is a contiguous range, the winding of each triangle is kept.
+// morphPositions may be empty; when given, the bounds also hold the geomorph targets of the vertices.
+std::vector<Meshlet> buildMeshlets(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& morphPositions, std::vector<unsigned int>& indices,
+	size_t maxVertices = MESHLET_MAX_VERTICES, size_t maxTriangles = MESHLET_MAX_TRIANGLES);
+
+// Working arrays of buildMeshlets, kept by callers that build meshlets over and over so the arrays are only
+// allocated until they reach the size of the largest mesh
+struct MeshletScratch
+{
+	std::vector<unsigned int> adjacencyOffsets;
+	std::vector<unsigned int> adjacency;
+	std::vector<unsigned int> fill;
+	std::vector<bool> emitted;
+	std::vector<size_t> vertexStamp;
+	std::vector<size_t> candidateStamp;
+	std::vector<unsigned int> reordered;
+	std::vector<unsigned int> candidates;
+	std::vector<glm::vec3> normals;
+};
+
+// Same, into an existing meshlet list with the caller's working arrays
+void buildMeshlets(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& morphPositions, std::vector<unsigned int>& indices,
+	std::vector<Meshlet>& meshlets, MeshletScratch& scratch, size_t maxVertices = MESHLET_MAX_VERTICES, size_t maxTriangles = MESHLET_MAX_TRIANGLES);
+
+// True when the meshlet can't contribute to the image: outside the frustum, or all its triangles face away from the viewer.
+// The frustum and view position are in the space of the mesh.
+bool isMeshletCulled(const Meshlet& meshlet, const Frustum& frustum, const glm::vec3& viewPosition);
+
+#endif
@@ -45,28 +45,70 @@ Model::Model(const std::string& path, bool gamma) : gammaCorrection(gamma)
     loadModel(path);
 }
 
-void Model::Draw(Shader& shader)
+void Model::Draw(Shader& shader, const Frustum* frustum, const glm::vec3* viewPosition)
 {
-    GLuint64 startTime, stopTime;
-    unsigned int queryID[2];
+    TRACE_ZONE("draw");
+    std::vector<Mesh>& drawMeshes = lodMeshes(currentLod);
+    meshesCulled = 0;
+    meshletsDrawn = 0;
+    meshletsCulled = 0;
 
-    // generate two queries
-    glGenQueries(2, queryID);
-    glQueryCounter(queryID[0], GL_TIMESTAMP);
+    // One timestamp before each mesh and one after the last
+    gpuTimer.beginFrame(drawMeshes.size() + 1);
 
-    for (unsigned int i = 0; i < meshes.size(); i++)
-        meshes[i].Draw(shader);
+    shader.setFloat("morphFactor", morphFactor);
 
-    glQueryCounter(queryID[1], GL_TIMESTAMP);
-    // get query results
-    glGetQueryObjectui64v(queryID[0], GL_QUERY_RESULT, &startTime);
-    glGetQueryObjectui64v(queryID[1], GL_QUERY_RESULT, &stopTime);
+    // Whole model outside, skip testing each mesh
+    bool modelVisible = !frustum || frustum->intersectsSphere(boundsCenter, boundsRadius);
 
-    timeTaken = (stopTime - startTime) / 1000.0;
+    for (unsigned int i = 0; i < drawMeshes.size(); i++)
+    {
+        gpuTimer.mark(i);
+        if (!modelVisible || (frustum && !frustum->intersects(drawMeshes[i].bounds)))
+        {
+            meshesCulled++;
+            continue;
+        }
+
+        if (frustum && viewPosition)
+        {
+            drawMeshes[i].DrawMeshlets(shader, *frustum, *viewPosition);
+            meshletsCulled += static_cast<int>(drawMeshes[i].meshletsCulled);
+            meshletsDrawn += static_cast<int>(drawMeshes[i].meshlets.size() - drawMeshes[i].meshletsCulled);
+        }
+        else
+            drawMeshes[i].Draw(shader);
+    }
+
+    gpuTimer.mark(drawMeshes.size());
+    gpuTimer.endFrame();
+
+    timeTaken = gpuTimer.lastTotal();
+}
+
+// Heap bytes of the arrays Assimp holds for a scene, textures and materials aside
+static uint64_t sceneBytes(const aiScene* scene)
+{
+    uint64_t bytes = 0;
+    for (unsigned int i = 0; i < scene->mNumMeshes; i++)
+    {
+        const aiMesh* mesh = scene->mMeshes[i];
+        uint64_t perVertex = sizeof(aiVector3D) * (1 + mesh->HasNormals() + 2 * mesh->HasTangentsAndBitangents());
+        for (unsigned int channel = 0; channel < AI_MAX_NUMBER_OF_TEXTURECOORDS; channel++)
+            perVertex += mesh->HasTextureCoords(channel) ? sizeof(aiVector3D) : 0;
+        for (unsigned int channel = 0; channel < AI_MAX_NUMBER_OF_COLOR_SETS; channel++)
+            perVertex += mesh->HasVertexColors(channel) ? sizeof(aiColor4D) : 0;
+        bytes += mesh->mNumVertices * perVertex + mesh->mNumFaces * sizeof(aiFace);
+        for (unsigned int face = 0; face < mesh->mNumFaces; face++)
+            bytes += mesh->mFaces[face].mNumIndices * sizeof(unsigned int);
+    }
+    return bytes;
 }
 
 void Model::loadModel(const std::string& path)
 {
+    TRACE_ZONE("load");
+    importMemory.begin("import");
     // read file via ASSIMP
     Assimp::Importer importer;
     const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
@@ -84,6 +126,21 @@ void Model::loadModel(const std::string& path)
 
     // process ASSIMP's root node recursively
     processNode(scene->mRootNode, scene);
+
+    updateBounds();
+
+    importMemory.add("Assimp scene", sceneBytes(scene));
+    reportMemory(importMemory);
+    importMemory.end();
+}
+
+void Model::reportMemory(MemoryStage& stage) const
+{
+    for (const Mesh& mesh : meshes)
+        mesh.reportMemory(stage);
+    for (const ModelLod& lod : lods)
+        for (const Mesh& mesh : lod.meshes)
+            mesh.reportMemory(stage);
 }
 
 void Model::processNode(aiNode* node, const aiScene* scene)
@@ -140,6 +197,9 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
         }
         else
             vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+        // no morph until a LOD chain is generated
+        vertex.MorphPosition = vertex.Position;
+        vertex.MorphNormal = vertex.Normal;
 
         vertices.push_back(vertex);
     }
@@ -181,7 +241,7 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
     indexCount += faceCount / 3.0f;
 
     // return a mesh object created from the extracted mesh data
-    return Mesh(vertices, indices, textures);
+    return Mesh(std::move(vertices), std::move(indices), std::move(textures));
 }
 
 std::vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName)
@@ -210,6 +270,7 @@ std::vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType
             texture.path = str.C_Str();
             textures.push_back(texture);
             textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecessary load duplicate textures.
+            textureHandles.emplace_back(texture.id);
         }
     }
     return textures;
@@ -277,7 +338,131 @@ std::vector<glm::mat4> Model::calcModelMatrix()
 
 void Model::addMesh(Mesh mesh)
 {
-    this->meshes.push_back(mesh);
+    this->meshes.push_back(std::move(mesh));
+    updateBounds();
+}
+
+void Model::addLod(std::vector<Mesh> lodMeshes, float error)
+{
+    ModelLod lod;
+    for (const Mesh& mesh : lodMeshes)
+        lod.faceCount += static_cast<int>(mesh.indices.size() / 3);
+    lod.meshes = std::move(lodMeshes);
+    lod.error = error;
+
+    // Keep the chain ordered from fine to coarse
+    auto position = std::upper_bound(lods.begin(), lods.end(), error, [](float e, const ModelLod& l) { return e < l.error; });
+    lods.insert(position, std::move(lod));
+}
+
+void Model::addToBatch(MeshBatch& batch)
+{
+    batchMeshes.assign(lodCount(), {});
+    for (const Mesh& mesh : meshes)
+        batchMeshes[0].push_back(batch.addMesh(mesh));
+    for (size_t lod = 0; lod < lods.size(); lod++)
+        for (const Mesh& mesh : lods[lod].meshes)
+            batchMeshes[lod + 1].push_back(batch.addMesh(mesh));
+}
+
+void Model::queueBatchDraws(MeshBatch& batch, const glm::mat4& modelMatrix, unsigned int material, const Frustum* frustum)
+{
+    meshesCulled = 0;
+
+    // Nothing to draw until the model has been added to the batch
+    if (currentLod >= static_cast<int>(batchMeshes.size()))
+        return;
+
+    const std::vector<Mesh>& drawMeshes = lodMeshes(currentLod);
+    if (frustum && !frustum->intersectsSphere(boundsCenter, boundsRadius))
+    {
+        meshesCulled = static_cast<int>(drawMeshes.size());
+        return;
+    }
+
+    size_t count = std::min(batchMeshes[currentLod].size(), drawMeshes.size());
+    for (size_t i = 0; i < count; i++)
+    {
+        if (frustum && !frustum->intersects(drawMeshes[i].bounds))
+        {
+            meshesCulled++;
+            continue;
+        }
+        batch.queueDraw(batchMeshes[currentLod][i], modelMatrix, material, morphFactor);
+    }
+}
+
+float Model::pixelsPerUnit(const glm::mat4& modelMatrix, const glm::vec3& cameraPos, float fovY, float viewportHeight) const
+{
+    // Largest scale of the model matrix, so the error is never underestimated
+    float scale = std::max(glm::length(glm::vec3(modelMatrix[0])), std::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+    glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(boundsCenter, 1.0f));
+
+    // Distance to the nearest point of the bounding sphere, inside it everything is as close as it gets
+    float distance = std::max(glm::length(cameraPos - center) - boundsRadius * scale, 0.001f);
+
+    return scale * viewportHeight / (2.0f * std::tan(fovY * 0.5f) * distance);
+}
+
+int Model::coarsestLodWithin(float pixelsPerUnit, float pixelThreshold) const
+{
+    for (int lod = static_cast<int>(lods.size()); lod > 0; lod--)
+        if (lods[lod - 1].error * pixelsPerUnit <= pixelThreshold)
+            return lod;
+    return 0;
+}
+
+void Model::selectLod(const glm::mat4& modelMatrix, const glm::vec3& cameraPos, float fovY, float viewportHeight, float pixelThreshold, bool geomorph)
+{
+    float pixels = pixelsPerUnit(modelMatrix, cameraPos, fovY, viewportHeight);
+    currentLod = std::min(currentLod, static_cast<int>(lods.size()));
+    morphFactor = 0.0f;
+
+    if (geomorph)
+    {
+        // The next level is faded in as its error drops from the threshold to the bottom of the hysteresis band.
+        // A fully morphed level looks the same as the next one, so switching either way at the bottom of the band is seamless.
+        float coarsenAt = pixelThreshold * (1.0f - LOD_HYSTERESIS);
+        currentLod = coarsestLodWithin(pixels, coarsenAt);
+        if (currentLod < static_cast<int>(lods.size()))
+            morphFactor = glm::clamp((pixelThreshold - lods[currentLod].error * pixels) / (pixelThreshold - coarsenAt), 0.0f, 1.0f);
+        return;
+    }
+
+    int target = coarsestLodWithin(pixels, pixelThreshold);
+
+    // Refine straight away, but only coarsen once the error is well below the threshold
+    if (target < currentLod)
+        currentLod = target;
+    else
+    {
+        for (int lod = target; lod > currentLod; lod--)
+        {
+            if (lods[lod - 1].error * pixels <= pixelThreshold * (1.0f - LOD_HYSTERESIS))
+            {
+                currentLod = lod;
+                break;
+            }
+        }
+    }
+}
+
+void Model::updateBounds()
+{
+    glm::vec3 minPos(FLT_MAX), maxPos(-FLT_MAX);
+    for (const Mesh& mesh : meshes)
+    {
+        minPos = glm::min(minPos, mesh.bounds.boxMin);
+        maxPos = glm::max(maxPos, mesh.bounds.boxMax);
+    }
+    if (minPos.x > maxPos.x)
+        return;
+
+    boundsCenter = (minPos + maxPos) * 0.5f;
+    boundsRadius = 0.0f;
+    for (const Mesh& mesh : meshes)
+        for (const Vertex& vertex : mesh.vertices)
+            boundsRadius = std::max(boundsRadius, glm::length(vertex.Position - boundsCenter));
 }
 
 // MY TRIAL IMPLEMENTATION OF THE QEM
@@ -287,6 +472,8 @@ void loadObj(const std::string& filename, Mesh& mesh) {
     // Initiate edges and faces
     mesh.etest = {};
     mesh.ftest = {};
+    mesh.hetestNodes.clear();
+    mesh.facetestNodes.clear();
 
     std::ifstream file(filename);
     std::string line;
@@ -338,11 +525,24 @@ void loadObj(const std::string& filename, Mesh& mesh) {
 
 
 
+// Nodes are owned by the mesh, the map and face list of the trial only point at them
+Hetest* addHetest(Mesh& mesh)
+{
+    mesh.hetestNodes.push_back(std::make_unique<Hetest>());
+    return mesh.hetestNodes.back().get();
+}
+
+Facetest* addFacetest(Mesh& mesh)
+{
+    mesh.facetestNodes.push_back(std::make_unique<Facetest>());
+    return mesh.facetestNodes.back().get();
+}
+
 void connectFace(Mesh& mesh, unsigned int v1, unsigned int v2, unsigned int v3)
 {
-    Hetest* he1 = new Hetest;
-    Hetest* he2 = new Hetest;
-    Hetest* he3 = new Hetest;
+    Hetest* he1 = addHetest(mesh);
+    Hetest* he2 = addHetest(mesh);
+    Hetest* he3 = addHetest(mesh);
 
     // Setup vertex, the next edge and the face it belongs to
     he1->vertex = &mesh.vtest[v1];
@@ -353,7 +553,7 @@ void connectFace(Mesh& mesh, unsigned int v1, unsigned int v2, unsigned int v3)
     he2->next = he3;
     he3->next = he1;
 
-    Facetest* face = new Facetest;
+    Facetest* face = addFacetest(mesh);
     face->halfEdge = he1;
     he1->face = face;
     he2->face = face;
@@ -372,6 +572,7 @@ void connectFace(Mesh& mesh, unsigned int v1, unsigned int v2, unsigned int v3)
 
 void createHalfEdges(Mesh& mesh)
 {
+    TRACE_ZONE("half-edge build");
     int count = 0;
     printf("here");
     // Populate edges and faces
@@ -493,7 +694,7 @@ void collapseEdge(Hetest* edge, Mesh& mesh)
     e1->next->next = currEdge->next->next->twin->next;
     e1->next->next->next = e1;
 
-    Facetest* newFace = new Facetest;
+    Facetest* newFace = addFacetest(mesh);
     newFace->halfEdge = e1;
     mesh.ftest.push_back(newFace); // Add new face
 
@@ -517,7 +718,7 @@ void collapseEdge(Hetest* edge, Mesh& mesh)
     currEdge->face->removed = true;
 
     // Create new edge
-    Hetest* newHalfEdge = new Hetest;
+    Hetest* newHalfEdge = addHetest(mesh);
 
     newHalfEdge->vertex = currEdge->next->vertex;
     newHalfEdge->next = e2->next;
@@ -525,7 +726,7 @@ void collapseEdge(Hetest* edge, Mesh& mesh)
     currEdge->next = newHalfEdge;
 
     // Create new face
-    newFace = new Facetest;
+    newFace = addFacetest(mesh);
     newFace->halfEdge = e2;
     mesh.ftest.push_back(newFace); // Add new face
 
@@ -548,8 +749,8 @@ void collapseEdge(Hetest* edge, Mesh& mesh)
         currEdge->face->removed = true;
 
         // Create half edges
-        newHalfEdge = new Hetest;
-        Hetest* newHE2 = new Hetest;
+        newHalfEdge = addHetest(mesh);
+        Hetest* newHE2 = addHetest(mesh);
 
         newHalfEdge->vertex = currEdge->next->vertex;
         newHalfEdge->next = newHE2;
@@ -558,7 +759,7 @@ void collapseEdge(Hetest* edge, Mesh& mesh)
         currEdge->next = newHalfEdge;
 
         // New face
-        newFace = new Facetest;
+        newFace = addFacetest(mesh);
         newFace->halfEdge = currEdge;
         mesh.ftest.push_back(newFace);
 
@@ -625,13 +826,21 @@ Mesh extractIndices(Mesh& mesh)
     return { mesh.vertices, indices, {} };;
 }
 
-Model Model::simplifyModel(const Model& oldModel, const int vertThreshold)
+Model Model::simplifyModel(const Model& oldModel, const int vertThreshold, SimplifyProgress* progress, const CancellationToken* cancellation)
  {
-    // Don't change the original model
-    Model newModel = oldModel;
+    // Don't change the original model, the new meshes get their own copy of the data and GPU buffers.
+    // Textures stay owned by the original model.
+    Model newModel;
+    newModel.directory = oldModel.directory;
+    newModel.modelName = oldModel.modelName;
+    newModel.gammaCorrection = oldModel.gammaCorrection;
+    newModel.faceCount = oldModel.faceCount;
+    newModel.indexCount = oldModel.indexCount;
+    for (const Mesh& oldMesh : oldModel.meshes)
+        newModel.addMesh(Mesh(oldMesh.vertices, oldMesh.indices, oldMesh.textures));
 
     // For each mesh in the model
-    for (Mesh mesh : newModel.meshes)
+    for (Mesh& mesh : newModel.meshes)
     {
         loadObj("res/models/bunny/bunny.obj", mesh);
 
@@ -658,15 +867,24 @@ Model Model::simplifyModel(const Model& oldModel, const int vertThreshold)
 
         newModel.indexCount--;
 
-        while (newModel.indexCount != vertThreshold)
+        // Progress counts down the same count the loop does. Every collapse is a full search of the edges,
+        // so checking for cancellation each time costs nothing.
+        size_t collapses = 1;
+        if (progress)
+            progress->begin(newModel.indexCount + 1, vertThreshold);
+        while (newModel.indexCount != vertThreshold && !(cancellation && cancellation->cancelled()))
         {
             leastCostEdge = findLeastCostEdge(mesh);
 
             collapseEdge(leastCostEdge, mesh);
             newModel.indexCount--;
+            collapses++;
 
-            printf("%d\n", newModel.indexCount);
+            if (progress)
+                progress->report(collapses, newModel.indexCount, leastCostEdge->cost);
         }
+        if (progress)
+            progress->end();
 
         // Extract the new indices and create mesh out of it
         mesh = extractIndices(mesh);
@@ -16,18 +16,38 @@
 #include <iostream>
 #include <vector>
 #include <chrono>
+#include <algorithm>
+#include <cfloat>
 
+#include "Frustum.h"
+#include "GpuTimer.h"
+#include "MemoryReport.h"
 #include "Mesh.h"
+#include "MeshBatch.h"
 #include "Shader.h"
+#include "SimplifyProgress.h"
+#include "Trace.h"
 
 unsigned int TextureFromFile(const char* path, const std::string& directory, bool gamma = false);
 
 struct HalfEdge;
 
+// A coarser level is only switched to once its projected error is this fraction below the threshold, to avoid popping
+const float LOD_HYSTERESIS = 0.25f;
+
+// Simplified version of a model, tagged with its geometric error in model units
+struct ModelLod
+{
+	std::vector<Mesh> meshes;
+	float error = 0.0f;
+	int faceCount = 0;
+};
+
 class Model
 {
 public:
 	std::vector<Texture> textures_loaded; // Stores all textures loaded so far, optimization to make sure texures aren't loaded more than once
+	std::vector<GLTexture> textureHandles; // Owns the GL textures listed in textures_loaded
 	std::vector<Mesh> meshes;
 	std::string directory;
 	std::string modelName;
@@ -35,24 +55,75 @@ public:
 	int faceCount = 0;
 	int indexCount = 0;
 
-	float timeTaken = 0.0f;
+	// Coarser levels in order of increasing error, the model's own meshes are level 0
+	std::vector<ModelLod> lods;
+	int currentLod = 0;
+	float morphFactor = 0.0f; // How far the current level is blended towards the next coarser one
+
+	// Bounding sphere of the model's own meshes, in model space
+	glm::vec3 boundsCenter = glm::vec3(0.0f);
+	float boundsRadius = 0.0f;
+
+	// Ids of the meshes of each LOD level in the batch the model was last added to
+	std::vector<std::vector<size_t>> batchMeshes;
+
+	int meshesCulled = 0; // Meshes skipped by the last culled draw
+	// Meshlets drawn and skipped by the last draw, when drawn by meshlet
+	int meshletsDrawn = 0;
+	int meshletsCulled = 0;
+
+	float timeTaken = 0.0f; // GPU time of the last measured draw in microseconds
+	MemoryStage importMemory; // Measured while loading, with the Assimp scene still alive
+	GpuTimer gpuTimer; // Per mesh GPU draw times, read back a few frames late
 
 	// Constructor, expects a filepath to the 3D model
 	Model(const std::string& path, bool gamma = false);
 
 	Model() : gammaCorrection(false) {};
 
-	void Draw(Shader& shader);
+	// Models own the GPU resources of their meshes and textures, so they can only be moved
+	Model(const Model&) = delete;
+	Model& operator=(const Model&) = delete;
+	Model(Model&&) = default;
+	Model& operator=(Model&&) = default;
+
+	// Meshes outside the frustum are skipped, it has to be extracted from projection * view * model.
+	// Given the camera position in model space as well, the meshes are drawn meshlet by meshlet and those culled are skipped.
+	void Draw(Shader& shader, const Frustum* frustum = nullptr, const glm::vec3* viewPosition = nullptr);
 
 	void addMesh(Mesh mesh);
 
-	Model simplifyModel(const Model& oldModel, const int vertThreshold);
+	void addLod(std::vector<Mesh> lodMeshes, float error);
+
+	// Add the meshes of every LOD level to the batch, then queue draws of the current level each frame
+	void addToBatch(MeshBatch& batch);
+	void queueBatchDraws(MeshBatch& batch, const glm::mat4& modelMatrix, unsigned int material, const Frustum* frustum = nullptr);
+	int lodCount() const { return static_cast<int>(lods.size()) + 1; }
+	float lodError(int lod) const { return lod == 0 ? 0.0f : lods[lod - 1].error; }
+	int lodFaceCount(int lod) const { return lod == 0 ? faceCount : lods[lod - 1].faceCount; }
+	std::vector<Mesh>& lodMeshes(int lod) { return lod == 0 ? meshes : lods[lod - 1].meshes; }
+
+	// Screen size in pixels of one model unit at the model's closest point to the camera
+	float pixelsPerUnit(const glm::mat4& modelMatrix, const glm::vec3& cameraPos, float fovY, float viewportHeight) const;
+	// Coarsest level whose error projects to less than pixelThreshold pixels on screen
+	int coarsestLodWithin(float pixelsPerUnit, float pixelThreshold) const;
+	// Pick the level to draw from its error on screen, with hysteresis against popping.
+	// With geomorphing the level is instead blended into the next one over the hysteresis band, so switching doesn't pop.
+	void selectLod(const glm::mat4& modelMatrix, const glm::vec3& cameraPos, float fovY, float viewportHeight, float pixelThreshold, bool geomorph = false);
+
+	// Half-edge trial on the hardcoded bunny. Stops early, with the collapses done so far, when cancellation is set.
+	Model simplifyModel(const Model& oldModel, const int vertThreshold, SimplifyProgress* progress = nullptr, const CancellationToken* cancellation = nullptr);
 
 	std::vector<glm::mat4> calcModelMatrix();
 
+	// Bytes of the CPU side arrays of every mesh and LOD level
+	void reportMemory(MemoryStage& stage) const;
+
 private:
 	void loadModel(const std::string& path);
 
+	void updateBounds();
+
 	void processNode(aiNode* node, const aiScene* scene);
 
 	Mesh processMesh(aiMesh* mesh, const aiScene* scene);
@@ -1,8 +1,19 @@
 #include "MyImGui.h"
 
+#include <chrono>
+
+#include "Trace.h"
+
+// Number of levels generated for the LOD chain, each has half the faces of the previous one
+const int LOD_CHAIN_LEVELS = 5;
+// Written next to the executable, for chrome://tracing or ui.perfetto.dev
+const char* const TRACE_PATH = "trace.json";
+
 MyImGui::MyImGui(std::string& originalModelPath)
 {
     filePathName = originalModelPath;
+    // The cache keeps the collapses that produced each result
+    simpMesh.recordCollapses = true;
 }
 
 MyImGui::~MyImGui()
@@ -54,33 +65,121 @@ void MyImGui::showControlsWindow()
     }
 }
 
-void MyImGui::showOptionsWindow()
+void MyImGui::showOptionsWindow(bool building)
 {
     // Options window
-    ImGui::SetNextWindowSize(ImVec2(250, 100));
+    ImGui::SetNextWindowSize(ImVec2(250, 340));
     ImGui::Begin("Options:");
     ImGui::Checkbox("C: Toggle controls", &bShowControls);
     ImGui::Checkbox("P: Toggle wireframe mode", &bPolygonMode);
     ImGui::Checkbox("M: Show import menu", &bShowImportMenu);
+    ImGui::Checkbox("Automatic LOD", &bAutoLod);
+    ImGui::Checkbox("Geomorph LOD transitions", &bGeomorph);
+    ImGui::Checkbox("Batched draws (multi-draw indirect)", &bBatchedDraws);
+    ImGui::Checkbox("Benchmark scene", &bBenchmarkScene);
+    ImGui::Checkbox("Frustum culling", &bFrustumCulling);
+    ImGui::Checkbox("Meshlet culling", &bMeshletCulling);
+    ImGui::Checkbox("View-dependent refinement", &bViewDependent);
+    ImGui::Checkbox("Cluster LOD (DAG)", &bClusterLod);
+    ImGui::SliderFloat("Max error (px)", &lodPixelThreshold, 0.1f, 20.0f, "%.1f");
+    bool recording = Trace::enabled();
+    if (ImGui::Checkbox("Record trace", &recording))
+        Trace::setEnabled(recording);
+    ImGui::SameLine();
+    // Pausing only stops new zones, ones already open on other threads still record when they close
+    ImGui::BeginDisabled(building);
+    if (ImGui::Button("Save"))
+    {
+        Trace::setEnabled(false);
+        if (Trace::writeChromeTrace(TRACE_PATH))
+            printf("Trace written to %s\n", TRACE_PATH);
+        Trace::setEnabled(recording);
+    }
+    ImGui::EndDisabled();
+    if (building && ImGui::IsItemHovered(ImGuiHoveredFlags_AllowWhenDisabled))
+        ImGui::SetTooltip("Waiting for the builds in progress");
     ImGui::End();
 }
 
-void MyImGui::showMeshInfoWindow(const Model& originalModel, const Model& newModel)
+void MyImGui::showMeshInfoWindow(const Model& originalModel, const Model& newModel, const MeshBatch& batch)
 {
     // Mesh info window
-    ImGui::SetNextWindowSize(ImVec2(250, 250));
+    ImGui::SetNextWindowSize(ImVec2(300, 460));
     ImGui::Begin("Mesh Info:");
     ImGui::Text("Original mesh:\nVertex count: %i", originalModel.indexCount);
     ImGui::Text("Face count: %i", originalModel.faceCount);
-    ImGui::Text("Time taken to load: %.1f us", originalModel.timeTaken);
+    if (originalModel.currentLod > 0)
+        ImGui::Text("LOD %i/%i: %i faces, error %.4f", originalModel.currentLod, originalModel.lodCount() - 1,
+            originalModel.lods[originalModel.currentLod - 1].faceCount, originalModel.lodError(originalModel.currentLod));
+    else
+        ImGui::Text("LOD 0/%i: full detail", originalModel.lodCount() - 1);
+    if (originalModel.morphFactor > 0.0f)
+        ImGui::Text("Morphing to LOD %i: %.0f%%", originalModel.currentLod + 1, originalModel.morphFactor * 100.0f);
+    // Batched, both models go out in one call and only that call is timed
+    if (!bBatchedDraws)
+        showDrawTimes(originalModel);
     ImGui::Text("\nSimplified mesh:\nVertex count: %i", newModel.indexCount);
     ImGui::Text("Face count: %i", newModel.faceCount);
-    ImGui::Text("Time taken to load: %.1f us", newModel.timeTaken);
+    if (!bBatchedDraws)
+        showDrawTimes(newModel);
     ImGui::Text("\nSimplification percent: %.1f%%", ((float)newModel.indexCount / (float)originalModel.indexCount) * 100.f);
     ImGui::Text("Time taken to simplify: %.1f ms", timeTaken);
+    ImGui::Text("GPU upload: %.1f KB", uploadBytes / 1024.f);
+    ImGui::Text("Cache: %s, %i hits, %i misses, %.1f MB", bCacheHit ? "hit" : "miss", (int)meshCache.hits(), (int)meshCache.misses(),
+        meshCache.sizeBytes() / (1024.f * 1024.f));
+    if (bBatchedDraws)
+    {
+        const GpuTimer& timer = batch.getGpuTimer();
+        ImGui::Text("Batched: %i draws in 1 call, last upload %.1f KB", (int)batch.drawCount(), batch.lastUploadBytes() / 1024.f);
+        ImGui::Text("Textures aren't bound when batched");
+        ImGui::Text("Time taken to draw both: %.1f us", timer.lastTotal());
+        ImGui::Text("Avg: %.1f us  p95: %.1f us", timer.averageTotal(), timer.percentileTotal(95.0f));
+    }
+    if (bFrustumCulling)
+        ImGui::Text("Meshes culled: %i", originalModel.meshesCulled + newModel.meshesCulled);
+    if (bFrustumCulling && bMeshletCulling)
+        ImGui::Text("Meshlets culled: %i of %i", originalModel.meshletsCulled + newModel.meshletsCulled,
+            originalModel.meshletsCulled + newModel.meshletsCulled + originalModel.meshletsDrawn + newModel.meshletsDrawn);
+    if (ImGui::TreeNode("Memory"))
+    {
+        showMemoryStage(originalModel.importMemory);
+        for (const MemoryStage& stage : memoryStages)
+            showMemoryStage(stage);
+        ImGui::TreePop();
+    }
     ImGui::End();
 }
 
+void MyImGui::showMemoryStage(const MemoryStage& stage)
+{
+    if (stage.name.empty())
+        return;
+    const float MB = 1024.f * 1024.f;
+    if (ImGui::TreeNode(&stage, "%s: %.1f MB", stage.name.c_str(), stage.structureBytes() / MB))
+    {
+        ImGui::Text("Resident: %.1f -> %.1f MB", stage.residentBefore / MB, stage.residentAfter / MB);
+        ImGui::Text("Peak: %.1f MB%s", stage.peakResident / MB, stage.stagePeak ? "" : " (process)");
+        for (const MemoryStructure& structure : stage.structures)
+            ImGui::Text("%s: %.2f MB%s", structure.name.c_str(), structure.bytes / MB, structure.tracked ? "" : " (sampled)");
+        ImGui::TreePop();
+    }
+}
+
+void MyImGui::showDrawTimes(const Model& model)
+{
+    const GpuTimer& timer = model.gpuTimer;
+    ImGui::Text("Time taken to draw: %.1f us", timer.lastTotal());
+    ImGui::Text("Avg: %.1f us  p95: %.1f us", timer.averageTotal(), timer.percentileTotal(95.0f));
+
+    // Break the time down per mesh for multi mesh models
+    if (timer.sectionCount() > 1 && ImGui::TreeNode(&model, "Per mesh (%i)", (int)timer.sectionCount()))
+    {
+        for (size_t i = 0; i < timer.sectionCount(); i++)
+            ImGui::Text("%i: %.1f us (avg %.1f us)", (int)i, timer.lastSection(i), timer.averageSection(i));
+        ImGui::TreePop();
+    }
+}
+
 void MyImGui::showImportWindow(Model& originalModel, Model& newModel)
 {
     if(bShowImportMenu)
@@ -105,6 +204,9 @@ void MyImGui::showImportWindow(Model& originalModel, Model& newModel)
                 // action
                 originalModel = Model(filePathName);
                 newModel = Model(filePathName);
+                bSimpModelResident = false;
+                bBatchDirty = true;
+                bClusterLodDirty = true;
                 vertexCount = 0;
                 ImGui::Text("Loaded OBJ file located at: %s", filePathName.c_str());
             }
@@ -122,19 +224,267 @@ void MyImGui::showImportWindow(Model& originalModel, Model& newModel)
             if (vertexCount != 0 && vertexCount != newModel.indexCount && vertexCount != newModel.indexCount-1 && vertexCount != newModel.indexCount+1)
             {
                 printf("Started simplification...\n");
-                MyOpenMesh simpMesh;
-                simpMesh.loadMesh(filePathName);
-                simpMesh.simplifyMesh(vertexCount);
-                simpMesh.writeMesh("res/models/simplified_mesh.obj");
-                timeTaken = simpMesh.timeTaken;
-                newModel = Model("res/models/simplified_mesh.obj");
+                updateSimplifiedModel(originalModel, newModel);
             }
         }
         ImGui::Text("Simplification percent: %.1f%%", ((float)vertexCount / (float)originalModel.indexCount) * 100.f);
+
+        // LOD chain for the original model, picked from by the automatic LOD selection
+        if (ImGui::Button("Generate LOD chain"))
+            generateLodChain(originalModel);
+        ImGui::SameLine();
+        ImGui::Text("%i levels", originalModel.lodCount() - 1);
         ImGui::End();
     }
 }
 
+void MyImGui::showBenchmarkWindow(BenchmarkScene& scene)
+{
+    if (!bBenchmarkScene)
+        return;
+
+    ImGui::SetNextWindowSize(ImVec2(330, 370));
+    ImGui::Begin("Benchmark:");
+    ImGui::SliderInt("Rows", &scene.rows, 1, 100);
+    ImGui::SliderInt("Columns", &scene.columns, 1, 100);
+    ImGui::SliderFloat("Spacing", &scene.spacing, 0.5f, 10.0f, "%.1f");
+
+    const char* policies[] = { "Finest", "Level per column", "Screen-space error" };
+    int policy = scene.policy;
+    if (ImGui::Combo("LOD policy", &policy, policies, IM_ARRAYSIZE(policies)))
+        scene.policy = static_cast<LodPolicy>(policy);
+    if (scene.policy == LOD_POLICY_SCREEN_SPACE)
+        ImGui::SliderFloat("Max error (px)", &scene.pixelThreshold, 0.1f, 20.0f, "%.1f");
+    ImGui::Checkbox("Normal matrix per vertex (old)", &scene.perVertexNormalMatrix);
+
+    ImGui::Text("----------");
+    ImGui::Text("Frame time: %.2f ms (p95 %.2f ms)", scene.averageFrameTime(), scene.percentileFrameTime(95.0f));
+    ImGui::Text("GPU time: %.1f us (p95 %.1f us)", scene.getGpuTimer().averageTotal(), scene.getGpuTimer().percentileTotal(95.0f));
+    ImGui::Text("Instances: %i (%i culled)  Draw calls: %i", (int)scene.instancesDrawn, (int)scene.instancesCulled, (int)scene.drawCalls);
+    ImGui::Text("Triangles: %.2f M/frame, %.1f M/s", scene.trianglesDrawn / 1e6, scene.trianglesPerSecond() / 1e6);
+    ImGui::Text("Vertices: %.2f M/frame", scene.verticesDrawn / 1e6);
+
+    // Fixed length runs appended to a CSV, for comparing settings
+    if (scene.isRecording())
+        ImGui::Text("Recording...");
+    else if (ImGui::Button("Record 300 frames"))
+        scene.startRecording(300, "benchmark_results.csv");
+    ImGui::End();
+}
+
+void MyImGui::showViewDependentWindow(ViewDependentMesh* vdMesh, bool building)
+{
+    if (!bViewDependent)
+        return;
+
+    ImGui::SetNextWindowSize(ImVec2(300, 200));
+    ImGui::Begin("View-dependent mesh:");
+    if (building)
+        ImGui::Text("Building the hierarchy...");
+    if (vdMesh)
+    {
+        ImGui::SliderFloat("Max error (px)", &vdMesh->pixelTolerance, 0.1f, 20.0f, "%.1f");
+        ImGui::SliderFloat("Budget (ms)", &vdMesh->timeBudget, 0.1f, 10.0f, "%.1f");
+        ImGui::Text("Faces: %i", (int)vdMesh->faceCount());
+        ImGui::Text("Active vertices: %i of %i nodes", (int)vdMesh->activeVertices(), (int)vdMesh->nodeCount());
+        ImGui::Text("Splits: %i  Collapses: %i", (int)vdMesh->refinements, (int)vdMesh->coarsenings);
+    }
+    ImGui::End();
+}
+
+void MyImGui::showClusterLodWindow(ClusterLod* clusterLod, bool building)
+{
+    if (!bClusterLod || bViewDependent)
+        return;
+
+    ImGui::SetNextWindowSize(ImVec2(300, 180));
+    ImGui::Begin("Cluster LOD:");
+    if (building)
+        ImGui::Text("Building the cluster DAG...");
+    if (clusterLod && !clusterLod->isBuilt())
+        ImGui::Text("Couldn't build the cluster DAG");
+    else if (clusterLod)
+    {
+        ImGui::SliderFloat("Max error (px)", &clusterLod->pixelThreshold, 0.1f, 20.0f, "%.1f");
+        ImGui::Text("DAG: %i clusters in %i levels", (int)clusterLod->getClusters().size(), clusterLod->levelCount);
+        ImGui::Text("Built in %.0f ms", clusterLod->buildTime);
+        ImGui::Text("Drawn: %i clusters (%i culled)", (int)clusterLod->clustersDrawn, (int)clusterLod->clustersCulled);
+        ImGui::Text("Triangles: %i", (int)clusterLod->trianglesDrawn);
+    }
+    ImGui::End();
+}
+
+void MyImGui::updateSimplifiedModel(const Model& originalModel, Model& newModel)
+{
+    // Same key as meshsimp with the same target, so results from either one are found by the other
+    auto startTime = std::chrono::steady_clock::now();
+    std::string cacheKey = MeshCache::makeKey(meshCache.hashFile(filePathName), "quadric", "f" + std::to_string(vertexCount * 3), "ModQuadric");
+    MeshData meshData;
+    memoryStages.clear();
+    beginMemoryStage("cache read");
+    bCacheHit = meshCache.load(cacheKey, meshData);
+    if (bCacheHit)
+    {
+        // The same files a miss leaves behind, written before the indices are moved into the mesh. A miss doesn't
+        // count its writes in the time taken either.
+        auto writeStart = std::chrono::steady_clock::now();
+        MyOpenMesh::writeMesh("res/models/simplified_mesh.obj", meshData);
+        writeBinaryMesh("res/models/simplified_mesh.msbm", meshData);
+        startTime += std::chrono::steady_clock::now() - writeStart;
+
+        std::vector<Vertex> vertices(meshData.positions.size());
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            vertices[i].Position = vertices[i].MorphPosition = meshData.positions[i];
+            vertices[i].Normal = vertices[i].MorphNormal = meshData.normals[i];
+            vertices[i].TexCoords = meshData.texCoords[i];
+            vertices[i].index = static_cast<unsigned int>(i);
+        }
+        uploadBytes = vertices.size() * sizeof(Vertex) + meshData.indices.size() * sizeof(unsigned int);
+
+        newModel = Model();
+        newModel.modelName = originalModel.modelName;
+        newModel.addMesh(Mesh(std::move(vertices), std::move(meshData.indices), {}));
+        newModel.faceCount = static_cast<int>(newModel.meshes[0].indices.size() / 3);
+        newModel.indexCount = newModel.faceCount / 3;
+        endMemoryStage(newModel);
+        // The model no longer matches the state of simpMesh, the next miss starts over from the file
+        bSimpModelResident = false;
+        bNewModelBatchDirty = true;
+        timeTaken = static_cast<float>(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count());
+        printf("Simplified mesh read from the cache in %.1f ms\n", timeTaken);
+        return;
+    }
+
+    // The decimater can't add detail back, so going up in vertex count starts over from the file.
+    // A newly imported file also has to be loaded first.
+    // Only the stages that ran this time are shown
+    memoryStages.clear();
+    if (!bSimpModelResident || simpMesh.needsReload(vertexCount))
+    {
+        beginMemoryStage("OpenMesh load");
+        simpMesh.loadMesh(filePathName);
+        endMemoryStage(newModel);
+    }
+
+    beginMemoryStage("simplify");
+    simpMesh.simplifyMesh(vertexCount);
+    endMemoryStage(newModel);
+    simpMesh.writeMesh("res/models/simplified_mesh.obj");
+    timeTaken = simpMesh.timeTaken;
+
+    beginMemoryStage("extract and upload");
+
+    std::vector<unsigned int> indices;
+    simpMesh.extractIndices(indices);
+
+    if (!bSimpModelResident)
+    {
+        // First simplification of this file, build the GPU buffers once from the OpenMesh data
+        std::vector<Vertex> vertices;
+        simpMesh.extractVertices(vertices);
+        uploadBytes = vertices.size() * sizeof(Vertex) + indices.size() * sizeof(unsigned int);
+
+        // Replacing the model frees the GPU buffers of the previous one
+        newModel = Model();
+        newModel.modelName = originalModel.modelName;
+        newModel.addMesh(Mesh(std::move(vertices), std::move(indices), {}));
+        bSimpModelResident = true;
+    }
+    else
+    {
+        // Vertex handles are stable, only the faces that changed get uploaded
+        newModel.meshes[0].updateIndices(indices);
+        uploadBytes = newModel.meshes[0].lastUploadBytes;
+    }
+
+    newModel.faceCount = static_cast<int>(newModel.meshes[0].indices.size() / 3);
+    newModel.indexCount = newModel.faceCount / 3;
+    bNewModelBatchDirty = true;
+
+    // The render ready form with meshlets and the collapse log, so it can be loaded without parsing or simplifying again
+    simpMesh.extractMeshData(meshData);
+    memoryStages.back().add("Binary mesh", meshData.memoryBytes());
+    endMemoryStage(newModel);
+    writeBinaryMesh("res/models/simplified_mesh.msbm", meshData);
+    meshCache.store(cacheKey, meshData);
+}
+
+void MyImGui::beginMemoryStage(const std::string& name)
+{
+    memoryStages.emplace_back();
+    memoryStages.back().begin(name);
+}
+
+void MyImGui::endMemoryStage(const Model& newModel)
+{
+    simpMesh.reportMemory(memoryStages.back());
+    newModel.reportMemory(memoryStages.back());
+    memoryStages.back().end();
+}
+
+void MyImGui::generateLodChain(Model& model)
+{
+    printf("Generating LOD chain...\n");
+    model.lods.clear();
+    model.currentLod = 0;
+
+    // Each level continues decimating from the previous one, so the errors only grow along the chain
+    MyOpenMesh lodMesh;
+    lodMesh.loadMesh(filePathName);
+    size_t faces = lodMesh.faceCount;
+
+    // A level is only added once the next one is simplified, which tells where its vertices collapse to for geomorphing
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    std::vector<int> sourceVertices;
+    float error = 0.0f;
+
+    for (int level = 1; level <= LOD_CHAIN_LEVELS; level++)
+    {
+        faces /= 2;
+        if (faces < 12)
+            break;
+
+        // Halves the live faces of the previous level, the mesh isn't compacted in between
+        lodMesh.simplifyToFaces(faces);
+        if (lodMesh.faceCount > faces)
+            printf("LOD %i stopped at %zu faces, short of its target of %zu\n", level, lodMesh.faceCount, faces);
+
+        if (level == 1)
+        {
+            // The model's own meshes come from Assimp, their vertices are found in the OpenMesh mesh by position
+            for (Mesh& mesh : model.meshes)
+            {
+                std::vector<Vertex> meshVertices = mesh.vertices;
+                lodMesh.setMorphTargetsByPosition(meshVertices);
+                mesh.updateVertices(meshVertices);
+            }
+        }
+        else
+        {
+            lodMesh.setMorphTargets(vertices, sourceVertices);
+            addLodLevel(model, std::move(vertices), std::move(indices), error);
+        }
+
+        lodMesh.extractCompactMesh(vertices, indices, &sourceVertices);
+        error = static_cast<float>(lodMesh.geometricError());
+        printf("LOD %i: %zu faces, error %f\n", level, lodMesh.faceCount, error);
+    }
+
+    // The coarsest level has nothing to morph to
+    if (!indices.empty())
+        addLodLevel(model, std::move(vertices), std::move(indices), error);
+    bBatchDirty = true;
+}
+
+void MyImGui::addLodLevel(Model& model, std::vector<Vertex> vertices, std::vector<unsigned int> indices, float error)
+{
+    std::vector<Mesh> lodMeshes;
+    lodMeshes.push_back(Mesh(std::move(vertices), std::move(indices), {}));
+    model.addLod(std::move(lodMeshes), error);
+}
+
 void MyImGui::toggleWireframe()
 {
     // Wireframe mode
@@ -10,8 +10,13 @@
 
 #include <file_browser/ImGuiFileDialog.h>
 
+#include "BenchmarkScene.h"
+#include "ClusterLod.h"
+#include "MeshBatch.h"
+#include "MeshCache.h"
 #include "Model.h"
 #include "MyOpenMesh.h"
+#include "ViewDependentMesh.h"
 
 class MyImGui
 {
@@ -20,12 +25,37 @@ public:
 	bool bShowControls = true;
 	bool bPolygonMode = false;
 	bool bShowImportMenu = true;
+	bool bAutoLod = true;
+	bool bGeomorph = true; // Blend towards the next coarser level instead of popping
+	bool bBatchedDraws = false;
+	bool bBenchmarkScene = false;
+	bool bFrustumCulling = true;
+	bool bMeshletCulling = false; // Also cull each meshlet by frustum and facing, in the direct draw path
+	bool bViewDependent = false; // Draw the original mesh refined for the view instead of with whole mesh LODs
+	bool bClusterLod = false; // Draw the original mesh from its cluster DAG, LOD picked per cluster
+	bool bClusterLodDirty = true; // Set when a new file is loaded, the DAG has to be rebuilt
+	bool bBatchDirty = true; // Set when the original model changes, the scene batch has to be rebuilt
+	bool bNewModelBatchDirty = false; // Set when only the simplified model changes, only its part of the batch is replaced
+
+	float lodPixelThreshold = 1.0f; // Largest error on screen allowed by the automatic LOD selection
 
 	std::string filePath;
 	std::string filePathName;
 
 	int vertexCount = 0;
 	float timeTaken = 0.0f; // Time to simplify mesh
+	size_t uploadBytes = 0; // Bytes uploaded to the GPU by the last simplification
+
+	// Kept alive between simplifications so the simplified model can be patched instead of rebuilt
+	MyOpenMesh simpMesh;
+	bool bSimpModelResident = false;
+
+	// Results of earlier simplifications, shared with meshsimp --cache res/cache
+	MeshCache meshCache{ "res/cache" };
+	bool bCacheHit = false; // The last simplification was read from the cache
+
+	// Stages of the last simplification, shown under Memory in the mesh info window next to the import of the original
+	std::vector<MemoryStage> memoryStages;
 
 	MyImGui(std::string& originalModelPath);
 	~MyImGui();
@@ -33,11 +63,27 @@ public:
 	void setup(GLFWwindow* window);
 	void newFrame();
 	void showControlsWindow();
-	void showOptionsWindow();
-	void showMeshInfoWindow(const Model& originalModel, const Model& newModel);
+	// Saving the trace waits for building to be false, the build threads' zones could still be writing their ring slots
+	void showOptionsWindow(bool building);
+	void showMeshInfoWindow(const Model& originalModel, const Model& newModel, const MeshBatch& batch);
+	void showDrawTimes(const Model& model);
+	void showMemoryStage(const MemoryStage& stage);
 	void showImportWindow(Model& originalModel, Model& newModel);
+	void showBenchmarkWindow(BenchmarkScene& scene);
+	// vdMesh is null until a build succeeds
+	void showViewDependentWindow(ViewDependentMesh* vdMesh, bool building);
+	// clusterLod is null until a build finishes
+	void showClusterLodWindow(ClusterLod* clusterLod, bool building);
 	void toggleWireframe();
+	void updateSimplifiedModel(const Model& originalModel, Model& newModel);
+	void generateLodChain(Model& model);
 	void render();
+
+private:
+	void addLodLevel(Model& model, std::vector<Vertex> vertices, std::vector<unsigned int> indices, float error);
+	// Adds a stage to memoryStages, ended with what simpMesh and the simplified model hold
+	void beginMemoryStage(const std::string& name);
+	void endMemoryStage(const Model& newModel);
 };
 
 #endif
\ No newline at end of file
@@ -1,51 +1,531 @@
 #include "MyOpenMesh.h"
 
-void MyOpenMesh::loadMesh(const std::string& path)
+#include <chrono>
+
+#include "Trace.h"
+
+// Collapses between two progress reports and cancellation checks, well under a millisecond of work
+const size_t PROGRESS_INTERVAL = 256;
+
+MyOpenMesh::ProgressObserver::ProgressObserver(MyOpenMesh& owner)
+    : OpenMesh::Decimater::Observer(PROGRESS_INTERVAL), owner(owner)
+{
+}
+
+void MyOpenMesh::ProgressObserver::notify(size_t step)
+{
+    if (!owner.progress)
+        return;
+    const ModQuadricErrorT<oMesh>& module = owner.decimater->module(owner.quadricModule);
+    owner.progress->report(step, module.remainingFaces(), static_cast<float>(module.geometricError()));
+}
+
+bool MyOpenMesh::ProgressObserver::abort() const
+{
+    return owner.cancellation && owner.cancellation->cancelled();
+}
+
+void MyOpenMesh::resetMesh()
+{
+    // Elements are added back with new_vertex and the like, which shrink the property arrays to the new element
+    // and grow them from there, so every property starts out fresh without giving up its memory.
+    // The decimater's and the module's properties stay on the mesh for the next initialize.
+    mesh.clean_keep_reservation();
+    decimaterReady = false;
+    slotFaces.clear();
+    faceCount = 0;
+}
+
+std::mutex& MyOpenMesh::ioMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+bool MyOpenMesh::loadMesh(const std::string& path)
+{
+    TRACE_ZONE("load");
+    resetMesh();
+
+    OpenMesh::IO::Options options;
+    bool read;
+    {
+        std::lock_guard<std::mutex> lock(ioMutex());
+        read = OpenMesh::IO::read_mesh(mesh, path, options, false);
+    }
+    if (!read) {
+        if (printErrors)
+            std::cerr << "Error loading mesh: " << path << std::endl;
+        faceCount = 0;
+        return false;
+    }
+
+    // Normals are needed for rendering the mesh straight from OpenMesh
+    mesh.request_face_normals();
+    mesh.request_vertex_normals();
+    mesh.update_normals();
+
+    faceCount = mesh.n_faces();
+
+    if (verbose)
+        printf("Openmesh mesh load complete.\n");
+    return true;
+}
+
+void MyOpenMesh::loadMesh(const oMesh& source)
 {
-    if (!OpenMesh::IO::read_mesh(mesh, path)) {
-        std::cerr << "Error loading mesh: " << path << std::endl;
+    TRACE_ZONE("copy resident mesh");
+    resetMesh();
+
+    // Copies the elements into the arrays already there, where assigning the whole mesh would clone every property.
+    // The arrays are only resized, so what isn't copied is cleared by hand.
+    mesh.assign(source);
+    mesh.request_face_normals();
+    mesh.request_vertex_normals();
+    // Meshes loaded by the path overload already carry their normals
+    if (source.has_vertex_normals() && source.has_face_normals())
+    {
+        for (oMesh::VertexHandle vh : mesh.all_vertices())
+            mesh.set_normal(vh, source.normal(vh));
+        for (oMesh::FaceHandle fh : mesh.all_faces())
+            mesh.set_normal(fh, source.normal(fh));
     }
-    printf("Openmesh mesh load complete.\n");
+    else
+        mesh.update_normals();
+    if (mesh.has_vertex_status())
+        for (oMesh::VertexHandle vh : mesh.all_vertices())
+            mesh.status(vh).set_bits(0);
+    if (mesh.has_halfedge_status())
+        for (oMesh::HalfedgeHandle heh : mesh.all_halfedges())
+            mesh.status(heh).set_bits(0);
+    if (mesh.has_edge_status())
+        for (oMesh::EdgeHandle eh : mesh.all_edges())
+            mesh.status(eh).set_bits(0);
+    if (mesh.has_face_status())
+        for (oMesh::FaceHandle fh : mesh.all_faces())
+            mesh.status(fh).set_bits(0);
+    faceCount = mesh.n_faces();
+}
+
+bool MyOpenMesh::loadMesh(const float* positions, size_t vertexCount, const uint32_t* indices, size_t indexCount)
+{
+    TRACE_ZONE("build mesh");
+    for (size_t i = 0; i < indexCount; i++)
+    {
+        if (indices[i] >= vertexCount)
+        {
+            if (printErrors)
+                std::cerr << "Error loading mesh: index " << indices[i] << " is out of range" << std::endl;
+            resetMesh();
+            return false;
+        }
+    }
+
+    beginMesh(vertexCount, indexCount / 3);
+    addVertices(positions, vertexCount);
+    addTriangles(indices, indexCount / 3);
+    endMesh();
+    return true;
+}
+
+void MyOpenMesh::beginMesh(size_t vertexCount, size_t triangleCount)
+{
+    resetMesh();
+    droppedFaces = 0;
+    // Euler's formula puts the edges at about vertices plus faces
+    mesh.reserve(vertexCount, vertexCount + triangleCount, triangleCount);
+}
+
+void MyOpenMesh::addVertices(const float* positions, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        mesh.add_vertex(oMesh::Point(positions[3 * i], positions[3 * i + 1], positions[3 * i + 2]));
+}
+
+bool MyOpenMesh::addTriangles(const uint32_t* indices, size_t count)
+{
+    size_t vertexCount = mesh.n_vertices();
+    for (size_t i = 0; i < 3 * count; i += 3)
+    {
+        if (indices[i] >= vertexCount || indices[i + 1] >= vertexCount || indices[i + 2] >= vertexCount)
+        {
+            if (printErrors)
+                std::cerr << "Error loading mesh: triangle " << i / 3 << " of the chunk is out of range" << std::endl;
+            return false;
+        }
+        oMesh::FaceHandle face = mesh.add_face(mesh.vertex_handle(indices[i]), mesh.vertex_handle(indices[i + 1]), mesh.vertex_handle(indices[i + 2]));
+        droppedFaces += !face.is_valid();
+    }
+    return true;
+}
+
+void MyOpenMesh::endMesh()
+{
+    if (droppedFaces > 0 && verbose)
+        printf("%zu non-manifold faces dropped.\n", droppedFaces);
+
+    mesh.request_face_normals();
+    mesh.request_vertex_normals();
+    mesh.update_normals();
+
+    faceCount = mesh.n_faces();
 }
 
 void MyOpenMesh::simplifyMesh(const int& targetVertices)
 {
-    printf("Simplifying mesh...\n");
+    simplifyToFaces(static_cast<size_t>(targetVertices) * 3);
+}
+
+void MyOpenMesh::simplifyToFaces(size_t targetFaces)
+{
+    if (verbose)
+        printf("Simplifying mesh...\n");
 
-    const clock_t begin_time = clock();
+    auto startTime = std::chrono::steady_clock::now();
 
-    // Define the decimater type
-    typedef OpenMesh::Decimater::DecimaterT<oMesh> Decimater;
+    if (!decimater)
+    {
+        // Create the decimater
+        decimater = std::make_unique<Decimater>(mesh);
 
-    // Define the quadric module type
-    typedef OpenMesh::Decimater::ModQuadricT<oMesh>::Handle QuadricModule;
+        // Add the quadric module to the decimater
+        decimater->add(quadricModule);
 
-    // Initialize the decimater
-    Decimater decimater(mesh);
+        observer = std::make_unique<ProgressObserver>(*this);
+        decimater->set_observer(observer.get());
+    }
+    // Initializing can't be interrupted, so a token already set skips it
+    cancelled = false;
+    if (cancellation && cancellation->cancelled())
+    {
+        cancelled = true;
+        timeTaken = 0.0;
+        return;
+    }
+    if (!decimaterReady)
+    {
+        // Initialize the decimater, again after every load since the module works out its quadrics from the mesh
+        TRACE_ZONE("quadric init");
+        decimater->module(quadricModule).setRecordCollapses(recordCollapses);
+        decimater->reinitialize();
+        decimaterReady = true;
+    }
 
-    // Add the quadric module to the decimater
-    QuadricModule quadric_module;
-    decimater.add(quadric_module);
+    const ModQuadricErrorT<oMesh>& module = decimater->module(quadricModule);
+    if (progress)
+        progress->begin(module.remainingFaces(), targetFaces);
 
-    // Initialize the decimater
-    decimater.initialize();
+    // Simplify the mesh to the target number of faces, unless cancelled while initializing
+    size_t collapses = 0;
+    if (!cancellation || !cancellation->cancelled())
+    {
+        // The heap is built inside the decimater, so this zone has both
+        TRACE_ZONE("heap build and decimate");
+        // The decimater counts down from n_faces, which still includes the faces deleted by earlier calls since the
+        // mesh isn't garbage collected in between. The target is offset by them so it applies to the live faces.
+        size_t deletedFaces = mesh.n_faces() - module.remainingFaces();
+        if (targetFaces < module.remainingFaces())
+            collapses = decimater->decimate_to_faces(0, targetFaces + deletedFaces);
+    }
+    faceCount = std::distance(mesh.faces_sbegin(), mesh.faces_end());
+    cancelled = cancellation && cancellation->cancelled() && faceCount > targetFaces;
 
-    double startTime = glfwGetTime();
-    // Simplify the mesh to the target number of vertices
-    decimater.decimate_to_faces(0Ui64, targetVertices*3);
-    timeTaken = glfwGetTime() - startTime;
+    if (progress)
+    {
+        progress->report(collapses, faceCount, static_cast<float>(module.geometricError()));
+        progress->end();
+    }
 
-    // Clean up unused vertices
-    mesh.garbage_collection();
+    // Garbage collection is left to writeMesh, so vertex and face handles stay valid for the next call
 
-    timeTaken = (1000 * float(clock() - begin_time)) / CLOCKS_PER_SEC;
+    timeTaken = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
 
-    printf("Simplification complete.\n");
+    if (verbose)
+        printf(cancelled ? "Simplification cancelled.\n" : "Simplification complete.\n");
 }
 
-void MyOpenMesh::writeMesh(const std::string& path)
+bool MyOpenMesh::writeMesh(const std::string& path)
 {
-    printf("Saving to file...\n");
-    OpenMesh::IO::write_mesh(mesh, path);
-    printf("Saved!\n\n");
+    TRACE_ZONE("write");
+    if (verbose)
+        printf("Saving to file...\n");
+    // Clean up unused vertices on a copy, the working mesh keeps its handles
+    oMesh compacted = mesh;
+    {
+        TRACE_ZONE("garbage collection");
+        compacted.garbage_collection();
+    }
+    std::lock_guard<std::mutex> lock(ioMutex());
+    if (!OpenMesh::IO::write_mesh(compacted, path))
+    {
+        if (printErrors)
+            std::cerr << "Error saving mesh: " << path << std::endl;
+        return false;
+    }
+    if (verbose)
+        printf("Saved!\n\n");
+    return true;
+}
+
+bool MyOpenMesh::writeMesh(const std::string& path, const MeshData& data)
+{
+    TRACE_ZONE("write");
+    oMesh out;
+    std::vector<oMesh::VertexHandle> handles(data.positions.size());
+    for (size_t i = 0; i < data.positions.size(); i++)
+        handles[i] = out.add_vertex(oMesh::Point(data.positions[i].x, data.positions[i].y, data.positions[i].z));
+    for (size_t i = 0; i + 2 < data.indices.size(); i += 3)
+        out.add_face(handles[data.indices[i]], handles[data.indices[i + 1]], handles[data.indices[i + 2]]);
+
+    std::lock_guard<std::mutex> lock(ioMutex());
+    if (!OpenMesh::IO::write_mesh(out, path))
+    {
+        std::cerr << "Error saving mesh: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool MyOpenMesh::needsReload(const int& targetVertices) const
+{
+    return !decimaterReady || static_cast<size_t>(targetVertices) * 3 > faceCount;
+}
+
+double MyOpenMesh::geometricError()
+{
+    return decimaterReady ? decimater->module(quadricModule).geometricError() : 0.0;
+}
+
+void MyOpenMesh::reportMemory(MemoryStage& stage)
+{
+    // The array kernel keeps an outgoing halfedge per vertex, a halfedge per face, and vertex, face, next and previous
+    // per halfedge. Everything else, the quadrics and the decimater's heap positions among it, is a property.
+    stage.add("OpenMesh connectivity", mesh.n_vertices() * sizeof(int) + mesh.n_faces() * sizeof(int) + mesh.n_halfedges() * 4 * sizeof(int));
+    uint64_t properties = 0;
+    auto addProperties = [&](auto begin, auto end)
+    {
+        for (auto property = begin; property != end; ++property)
+            if (*property && (*property)->size_of() != OpenMesh::BaseProperty::UnknownSize)
+                properties += (*property)->size_of();
+    };
+    addProperties(mesh.vprops_begin(), mesh.vprops_end());
+    addProperties(mesh.hprops_begin(), mesh.hprops_end());
+    addProperties(mesh.eprops_begin(), mesh.eprops_end());
+    addProperties(mesh.fprops_begin(), mesh.fprops_end());
+    stage.add("OpenMesh properties", properties);
+
+    if (decimaterReady)
+    {
+        // The heap only lives while decimating, reserved for every vertex, so this is its size at its peak
+        stage.add("Decimater heap", mesh.n_vertices() * sizeof(oMesh::VertexHandle));
+        stage.add("Collapse log", decimater->module(quadricModule).memoryBytes());
+    }
+
+    uint64_t scratch = capacityBytes(remap) + capacityBytes(slotFaces);
+    scratch += capacityBytes(meshletScratch.adjacencyOffsets) + capacityBytes(meshletScratch.adjacency) + capacityBytes(meshletScratch.fill)
+        + capacityBytes(meshletScratch.emitted) + capacityBytes(meshletScratch.vertexStamp) + capacityBytes(meshletScratch.candidateStamp)
+        + capacityBytes(meshletScratch.reordered) + capacityBytes(meshletScratch.candidates) + capacityBytes(meshletScratch.normals);
+    stage.add("Extraction scratch", scratch);
+}
+
+void MyOpenMesh::extractVertices(std::vector<Vertex>& vertices) const
+{
+    vertices.resize(mesh.n_vertices());
+    for (unsigned int i = 0; i < mesh.n_vertices(); i++)
+    {
+        oMesh::VertexHandle vh = mesh.vertex_handle(i);
+        const oMesh::Point& p = mesh.point(vh);
+        const oMesh::Normal& n = mesh.normal(vh);
+
+        vertices[i].Position = glm::vec3(p[0], p[1], p[2]);
+        vertices[i].Normal = glm::vec3(n[0], n[1], n[2]);
+        vertices[i].TexCoords = glm::vec2(0.0f, 0.0f);
+        vertices[i].MorphPosition = vertices[i].Position;
+        vertices[i].MorphNormal = vertices[i].Normal;
+        vertices[i].index = i;
+    }
+}
+
+void MyOpenMesh::extractIndices(std::vector<unsigned int>& indices)
+{
+    // First call after a load, every face gets the slot of its handle
+    if (slotFaces.empty())
+    {
+        for (unsigned int i = 0; i < mesh.n_faces(); i++)
+            if (!mesh.status(mesh.face_handle(i)).deleted()) slotFaces.push_back(i);
+    }
+
+    // Fill the holes left by removed faces with the last face in the list
+    size_t count = slotFaces.size();
+    size_t slot = 0;
+    while (slot < count)
+    {
+        if (mesh.status(mesh.face_handle(slotFaces[slot])).deleted())
+            slotFaces[slot] = slotFaces[--count];
+        else
+            slot++;
+    }
+    slotFaces.resize(count);
+
+    indices.resize(count * 3);
+    for (size_t i = 0; i < count; i++)
+    {
+        // Collapses can also change the vertices of faces that survive, so always take them from the mesh
+        oMesh::ConstFaceVertexIter fv = mesh.cfv_iter(mesh.face_handle(slotFaces[i]));
+        indices[i * 3] = fv->idx(); ++fv;
+        indices[i * 3 + 1] = fv->idx(); ++fv;
+        indices[i * 3 + 2] = fv->idx();
+    }
+}
+
+void MyOpenMesh::extractCompactMesh(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, std::vector<int>* sourceVertices) const
+{
+    // Remap the vertices that are still in use to a dense range
+    std::vector<int> remap(mesh.n_vertices(), -1);
+    vertices.clear();
+    if (sourceVertices)
+        sourceVertices->clear();
+    for (oMesh::VertexHandle vh : mesh.vertices())
+    {
+        const oMesh::Point& p = mesh.point(vh);
+        const oMesh::Normal& n = mesh.normal(vh);
+
+        Vertex vertex;
+        vertex.Position = glm::vec3(p[0], p[1], p[2]);
+        vertex.Normal = glm::vec3(n[0], n[1], n[2]);
+        vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+        vertex.MorphPosition = vertex.Position;
+        vertex.MorphNormal = vertex.Normal;
+        vertex.index = static_cast<unsigned int>(vertices.size());
+
+        remap[vh.idx()] = vertex.index;
+        vertices.push_back(vertex);
+        if (sourceVertices)
+            sourceVertices->push_back(vh.idx());
+    }
+
+    indices.clear();
+    for (oMesh::FaceHandle fh : mesh.faces())
+        for (oMesh::VertexHandle vh : mesh.fv_range(fh))
+            indices.push_back(remap[vh.idx()]);
+}
+
+void MyOpenMesh::extractMeshData(MeshData& data)
+{
+    TRACE_ZONE("extract");
+    // Same as extractCompactMesh, straight into the arrays of data
+    remap.assign(mesh.n_vertices(), -1);
+    data.positions.clear();
+    data.normals.clear();
+    for (oMesh::VertexHandle vh : mesh.vertices())
+    {
+        const oMesh::Point& p = mesh.point(vh);
+        const oMesh::Normal& n = mesh.normal(vh);
+        remap[vh.idx()] = static_cast<int>(data.positions.size());
+        data.positions.push_back(glm::vec3(p[0], p[1], p[2]));
+        data.normals.push_back(glm::vec3(n[0], n[1], n[2]));
+    }
+    data.texCoords.assign(data.positions.size(), glm::vec2(0.0f, 0.0f));
+
+    data.indices.clear();
+    for (oMesh::FaceHandle fh : mesh.faces())
+        for (oMesh::VertexHandle vh : mesh.fv_range(fh))
+            data.indices.push_back(remap[vh.idx()]);
+
+    buildMeshlets(data.positions, {}, data.indices, data.meshlets, meshletScratch);
+    data.error = static_cast<float>(geometricError());
+
+    data.collapses.clear();
+    if (decimaterReady)
+        for (const ModQuadricErrorT<oMesh>::Collapse& collapse : decimater->module(quadricModule).collapses())
+            data.collapses.push_back({ collapse.v0, collapse.v1, collapse.vl, collapse.vr, collapse.error });
+}
+
+int MyOpenMesh::currentVertex(int vertex)
+{
+    if (!decimaterReady)
+        return vertex;
+
+    const ModQuadricErrorT<oMesh>& module = decimater->module(quadricModule);
+    while (vertex >= 0 && mesh.status(mesh.vertex_handle(vertex)).deleted())
+        vertex = module.collapseTarget(vertex);
+    return vertex;
+}
+
+void MyOpenMesh::setMorphTarget(Vertex& vertex, int source)
+{
+    // Vertices that are still in the mesh stay where they are, with their own normal
+    int target = source >= 0 ? currentVertex(source) : -1;
+    if (target < 0 || target == source)
+    {
+        vertex.MorphPosition = vertex.Position;
+        vertex.MorphNormal = vertex.Normal;
+        return;
+    }
+
+    // Halfedge collapses keep the remaining vertex where it is, so its point is also its position at the coarser level
+    const oMesh::Point& p = mesh.point(mesh.vertex_handle(target));
+    const oMesh::Normal& n = mesh.normal(mesh.vertex_handle(target));
+    vertex.MorphPosition = glm::vec3(p[0], p[1], p[2]);
+    vertex.MorphNormal = glm::vec3(n[0], n[1], n[2]);
+}
+
+void MyOpenMesh::setMorphTargets(std::vector<Vertex>& vertices, const std::vector<int>& sourceVertices)
+{
+    for (size_t i = 0; i < vertices.size() && i < sourceVertices.size(); i++)
+        setMorphTarget(vertices[i], sourceVertices[i]);
+}
+
+void MyOpenMesh::setMorphTargetsByPosition(std::vector<Vertex>& vertices)
+{
+    if (mesh.n_vertices() == 0)
+        return;
+
+    // The two loaders can parse the same file to slightly different floats, so points are matched on a fine grid
+    // instead of exactly, looking in the neighbouring cells as well. Removed vertices keep their points, so all are included.
+    oMesh::Point minPoint = mesh.point(mesh.vertex_handle(0)), maxPoint = minPoint;
+    for (unsigned int i = 0; i < mesh.n_vertices(); i++)
+    {
+        minPoint.minimize(mesh.point(mesh.vertex_handle(i)));
+        maxPoint.maximize(mesh.point(mesh.vertex_handle(i)));
+    }
+    float cellSize = std::max((maxPoint - minPoint).max() * 1e-5f, 1e-12f);
+
+    auto cellKey = [](int64_t x, int64_t y, int64_t z) {
+        return static_cast<uint64_t>(x & 0x1FFFFF) | static_cast<uint64_t>(y & 0x1FFFFF) << 21 | static_cast<uint64_t>(z & 0x1FFFFF) << 42;
+    };
+    auto cellOf = [&](float coordinate) { return static_cast<int64_t>(std::floor(coordinate / cellSize)); };
+
+    std::unordered_multimap<uint64_t, int> grid;
+    grid.reserve(mesh.n_vertices());
+    for (unsigned int i = 0; i < mesh.n_vertices(); i++)
+    {
+        const oMesh::Point& p = mesh.point(mesh.vertex_handle(i));
+        grid.emplace(cellKey(cellOf(p[0]), cellOf(p[1]), cellOf(p[2])), i);
+    }
+
+    for (Vertex& vertex : vertices)
+    {
+        int64_t cx = cellOf(vertex.Position.x), cy = cellOf(vertex.Position.y), cz = cellOf(vertex.Position.z);
+        int closest = -1;
+        float closestDistance = FLT_MAX;
+        for (int64_t x = cx - 1; x <= cx + 1; x++)
+            for (int64_t y = cy - 1; y <= cy + 1; y++)
+                for (int64_t z = cz - 1; z <= cz + 1; z++)
+                {
+                    auto range = grid.equal_range(cellKey(x, y, z));
+                    for (auto it = range.first; it != range.second; ++it)
+                    {
+                        const oMesh::Point& p = mesh.point(mesh.vertex_handle(it->second));
+                        float distance = glm::length(glm::vec3(p[0], p[1], p[2]) - vertex.Position);
+                        if (distance < closestDistance)
+                        {
+                            closestDistance = distance;
+                            closest = it->second;
+                        }
+                    }
+                }
+
+        setMorphTarget(vertex, closest);
+    }
 }
@@ -1,29 +1,146 @@
 #ifndef MYOPENMESH_H
 #define MYOPENMESH_H
 
-#include "GLFW/glfw3.h"
-
 #include "OpenMesh/Core/IO/MeshIO.hh"
 #include "OpenMesh/Core/Mesh/TriMesh_ArrayKernelT.hh"
 #include "OpenMesh/Tools/Decimater/DecimaterT.hh"
 #include "OpenMesh/Tools/Decimater/ModQuadricT.hh"
+#include "OpenMesh/Tools/Decimater/Observer.hh"
 
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "BinaryMesh.h"
+#include "MemoryReport.h"
+#include "Meshlet.h"
+#include "QuadricErrorModule.h"
+#include "SimplifyProgress.h"
+#include "Vertex.h"
 
 class MyOpenMesh
 {
 public:
 	// OpenMesh type
 	typedef OpenMesh::TriMesh_ArrayKernelT<> oMesh;
+	// Decimater that can start over on a reloaded mesh, keeping its module and the properties both added to the mesh
+	class Decimater : public OpenMesh::Decimater::DecimaterT<oMesh>
+	{
+	public:
+		// The base is virtual, so it is constructed here as well
+		explicit Decimater(oMesh& mesh) : OpenMesh::Decimater::BaseDecimaterT<oMesh>(mesh), OpenMesh::Decimater::DecimaterT<oMesh>(mesh) {}
+		bool reinitialize() { set_uninitialized(); return initialize(); }
+	};
+	// Define the quadric module type, it also tracks the error of the simplified mesh
+	typedef ModQuadricErrorT<oMesh>::Handle QuadricModule;
+
 	oMesh mesh;
 
-	double timeTaken = 0.0f;
+	double timeTaken = 0.0f; // Milliseconds spent in the last simplification
+	size_t faceCount = 0; // Faces left after simplification
+	bool verbose = true; // Print the progress of each step, off for tools running many meshes at once
+	bool printErrors = true; // Report failures on stderr too, off for library callers that only get the return value
+	bool recordCollapses = false; // Keep the collapse log for extractMeshData, set before the first simplification
+	// Watched and stopped through these while simplifying, either may be null. They have to outlive the call.
+	SimplifyProgress* progress = nullptr;
+	const CancellationToken* cancellation = nullptr;
+	bool cancelled = false; // The last simplification was stopped by the token before it reached its target
 
 	MyOpenMesh() {};
 
-	void loadMesh(const std::string& path);
+	// Every loader reuses the storage of the previous mesh and keeps the decimater, so a simplifier used over and over
+	// (see SimplifierWorkspace) stops allocating once it has held its largest mesh
+	bool loadMesh(const std::string& path);
+	// Starts over from a copy of a mesh loaded earlier, for services that keep their inputs resident
+	void loadMesh(const oMesh& source);
+	// Builds the mesh from caller owned arrays, xyz per vertex and three indices per triangle.
+	// False if an index is out of range. Faces OpenMesh can't add without breaking the manifold are dropped.
+	bool loadMesh(const float* positions, size_t vertexCount, const uint32_t* indices, size_t indexCount);
+	// The same a chunk at a time, for meshes that are generated or streamed rather than held in arrays (see SyntheticMesh).
+	// All vertices come before the triangles, the counts are only used to reserve. addTriangles is false if an index
+	// is out of range, the triangles before it are kept.
+	void beginMesh(size_t vertexCount, size_t triangleCount);
+	void addVertices(const float* positions, size_t count);
+	bool addTriangles(const uint32_t* indices, size_t count);
+	void endMesh();
+	// Decimation continues from the current state, so repeated calls only pay for the new collapses.
+	// A cancelled call leaves a valid mesh with the collapses done so far, a later call carries on from there.
+	// The token is checked before and after initializing the decimater and every PROGRESS_INTERVAL collapses. The
+	// quadric initialization and the heap build in between can't be stopped, on meshes of tens of millions of faces
+	// they take a few seconds.
 	void simplifyMesh(const int& targetVertices);
-	void writeMesh(const std::string& path);
+	void simplifyToFaces(size_t targetFaces);
+	// The format follows the extension, as in OpenMesh::IO::write_mesh
+	bool writeMesh(const std::string& path);
+	// Writes a mesh that never went through OpenMesh, e.g. one read back from the cache, in any format OpenMesh writes
+	static bool writeMesh(const std::string& path, const MeshData& data);
+	// OpenMesh's readers and writers are process wide singletons that keep state per call, so every read_mesh and
+	// write_mesh of the program holds this. Parallel jobs only overlap in decimation.
+	static std::mutex& ioMutex();
+
+	// True if the mesh has to be reloaded to reach the target, the decimater can only coarsen
+	bool needsReload(const int& targetVertices) const;
+
+	// Largest distance the simplified surface is estimated to be from the original, in model units
+	double geometricError();
+	// Non-manifold faces the last load from arrays or chunks left out
+	size_t droppedFaceCount() const { return droppedFaces; }
+
+	// Bytes held by the mesh, the decimater and the extraction scratch, sampled from their sizes
+	void reportMemory(MemoryStage& stage);
+
+	// Render data for the current state. Vertices keep their handle index, so they stay valid across simplifications
+	void extractVertices(std::vector<Vertex>& vertices) const;
+	// Faces keep their slot in the index list until removed, then the last face is moved into the hole.
+	// Consecutive calls only differ where faces actually changed, which keeps GPU updates small.
+	void extractIndices(std::vector<unsigned int>& indices);
+	// Render data without the removed vertices, for meshes that won't be patched later (e.g. LOD levels).
+	// sourceVertices receives the OpenMesh vertex each compact vertex came from, for setMorphTargets.
+	void extractCompactMesh(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, std::vector<int>* sourceVertices = nullptr) const;
+	// Compact mesh split into meshlets with the collapse log, in the form written to the binary cache.
+	// The arrays of data are overwritten in place, passing the same data each time reuses them.
+	void extractMeshData(MeshData& data);
+
+	// Point the morph targets of vertices extracted before the last simplification at the vertices they collapsed into
+	void setMorphTargets(std::vector<Vertex>& vertices, const std::vector<int>& sourceVertices);
+	// Same for vertices loaded by something else (e.g. Assimp), matched to the mesh by position
+	void setMorphTargetsByPosition(std::vector<Vertex>& vertices);
+
+private:
+	// Passes the decimater's state to progress and stops it on cancellation, every few hundred collapses
+	class ProgressObserver : public OpenMesh::Decimater::Observer
+	{
+	public:
+		explicit ProgressObserver(MyOpenMesh& owner);
+		void notify(size_t step) override;
+		bool abort() const override;
+
+	private:
+		MyOpenMesh& owner;
+	};
+
+	std::unique_ptr<Decimater> decimater;
+	QuadricModule quadricModule;
+	std::unique_ptr<ProgressObserver> observer;
+	bool decimaterReady = false; // Initialized on the current mesh, false from a load until the first simplification
+
+	// Scratch of extractMeshData
+	std::vector<int> remap;
+	MeshletScratch meshletScratch;
+
+	std::vector<unsigned int> slotFaces; // Face handle index stored at each slot of the index list
+	size_t droppedFaces = 0; // Non-manifold faces left out by the mesh being built
+
+	// Empties the mesh for the next load, keeping its memory
+	void resetMesh();
+	// Vertex that the given vertex has been collapsed into, itself if it is still in the mesh
+	int currentVertex(int vertex);
+	void setMorphTarget(Vertex& vertex, int source);
 };
 
-#endif
\ No newline at end of file
+#endif
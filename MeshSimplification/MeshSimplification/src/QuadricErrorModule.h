@@ -0,0 +1,80 @@
+#ifndef QUADRICERRORMODULE_H
+#define QUADRICERRORMODULE_H
+
+#include "OpenMesh/Tools/Decimater/ModQuadricT.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Quadric decimation module that also keeps track of the largest quadric error of the collapses done so far.
+// The collapses are done in order of increasing error, so this is a bound on the error of the whole mesh
+// that only grows as the mesh gets coarser, which is what LOD selection needs.
+template <class MeshT>
+class ModQuadricErrorT : public OpenMesh::Decimater::ModQuadricT<MeshT>
+{
+public:
+	typedef ModQuadricErrorT<MeshT> Self;
+	typedef OpenMesh::Decimater::ModHandleT<Self> Handle;
+	typedef OpenMesh::Decimater::ModQuadricT<MeshT> Quadric;
+	typedef typename Quadric::CollapseInfo CollapseInfo;
+
+	DECIMATER_MODNAME(QuadricError)
+
+	// One collapse of vertex v0 into v1, vl and vr are the third vertices of the removed faces (-1 on a boundary)
+	struct Collapse
+	{
+		int v0, v1, vl, vr;
+		float error; // Geometric error of this collapse in model units
+	};
+
+	explicit ModQuadricErrorT(MeshT& _mesh) : Quadric(_mesh) {};
+
+	void initialize() override
+	{
+		Quadric::initialize();
+		maxError = 0.0;
+		initialFaces = this->mesh().n_faces();
+		removedFaces = 0;
+		collapsedInto.assign(this->mesh().n_vertices(), -1);
+		collapseLog.clear();
+	}
+
+	void preprocess_collapse(const CollapseInfo& _ci) override
+	{
+		// Same error the collapse was prioritised with, the quadrics aren't merged until postprocess
+		double error = static_cast<double>(Quadric::collapse_priority(_ci));
+		maxError = std::max(maxError, error);
+		collapsedInto[_ci.v0.idx()] = _ci.v1.idx();
+		// A collapse removes the faces on either side of the edge, only one on a boundary
+		removedFaces += _ci.fl.is_valid() + _ci.fr.is_valid();
+		if (recordCollapses)
+			collapseLog.push_back({ _ci.v0.idx(), _ci.v1.idx(), _ci.vl.idx(), _ci.vr.idx(), static_cast<float>(std::sqrt(std::max(error, 0.0))) });
+		Quadric::preprocess_collapse(_ci);
+	}
+
+	// Quadric error is a sum of squared distances to planes, so its root is a distance in model units
+	double geometricError() const { return std::sqrt(maxError); }
+	// Faces left, counted as the collapses go, for progress reports while the decimater runs
+	size_t remainingFaces() const { return initialFaces - removedFaces; }
+
+	// Vertex the given vertex was collapsed into, -1 if it is still in the mesh.
+	// That vertex may have been collapsed later as well, follow the chain to find where it is now.
+	int collapseTarget(int vertex) const { return collapsedInto[vertex]; }
+
+	// Keep every collapse in order, for building vertex hierarchies (see ViewDependentMesh)
+	void setRecordCollapses(bool record) { recordCollapses = record; }
+	const std::vector<Collapse>& collapses() const { return collapseLog; }
+	// Heap bytes of the collapse targets and the log, the quadrics themselves are a property of the mesh
+	size_t memoryBytes() const { return collapsedInto.capacity() * sizeof(int) + collapseLog.capacity() * sizeof(Collapse); }
+
+private:
+	double maxError = 0.0;
+	size_t initialFaces = 0;
+	size_t removedFaces = 0;
+	std::vector<int> collapsedInto;
+	bool recordCollapses = false;
+	std::vector<Collapse> collapseLog;
+};
+
+#endif
@@ -1,6 +1,6 @@
 #include "Shader.h"
 
-Shader::Shader(const char* vertexPath, const char* fragmentPath)
+Shader::Shader(const char* vertexPath, const char* fragmentPath, const std::string& defines)
 {
     // 1. retrieve the vertex/fragment source code from filePath
     std::string vertexCode;
@@ -30,6 +30,8 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath)
     {
         std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
     }
+    vertexCode = insertDefines(vertexCode, defines);
+    fragmentCode = insertDefines(fragmentCode, defines);
     const char* vShaderCode = vertexCode.c_str();
     const char* fShaderCode = fragmentCode.c_str();
 
@@ -57,6 +59,8 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath)
     // delete the shaders as they're linked into our program now and no longer necessary
     glDeleteShader(vertex);
     glDeleteShader(fragment);
+
+    cacheUniformLocations();
 }
 
 Shader::~Shader()
@@ -69,59 +73,120 @@ void Shader::Activate()
     glUseProgram(ID);
 }
 
+GLint Shader::getUniformLocation(const std::string& name) const
+{
+    auto it = uniformLocations.find(name);
+    return it != uniformLocations.end() ? it->second : -1;
+}
+
+void Shader::bindUniformBlock(const std::string& blockName, GLuint binding)
+{
+    GLuint index = glGetUniformBlockIndex(ID, blockName.c_str());
+    if (index != GL_INVALID_INDEX)
+        glUniformBlockBinding(ID, index, binding);
+}
+
 void Shader::setFloat(const std::string& name, float value)
 {
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1f(getUniformLocation(name), value);
 }
 
 void Shader::setInt(const std::string& name, int value)
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1i(getUniformLocation(name), value);
 }
 
 void Shader::setVec2(const std::string& name, const glm::vec2& vec)
 {
-    glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, glm::value_ptr(vec));
+    glUniform2fv(getUniformLocation(name), 1, glm::value_ptr(vec));
 }
 
 void Shader::setVec2(const std::string& name, const float& v1, const float& v2)
 {
-    glUniform2f(glGetUniformLocation(ID, name.c_str()), v1, v2);
+    glUniform2f(getUniformLocation(name), v1, v2);
 }
 
 void Shader::setVec3(const std::string& name, const glm::vec3& vec)
 {
-    glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, glm::value_ptr(vec));
+    glUniform3fv(getUniformLocation(name), 1, glm::value_ptr(vec));
 }
 
 void Shader::setVec3(const std::string& name, const float& v1, const float& v2, const float& v3)
 {
-    glUniform3f(glGetUniformLocation(ID, name.c_str()), v1, v2, v3);
+    glUniform3f(getUniformLocation(name), v1, v2, v3);
 }
 
 void Shader::setVec4(const std::string& name, const glm::vec4& vec)
 {
-    glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, glm::value_ptr(vec));
+    glUniform4fv(getUniformLocation(name), 1, glm::value_ptr(vec));
 }
 
 void Shader::setVec4(const std::string& name, const float& v1, const float& v2, const float& v3, const float& v4)
 {
-    glUniform4f(glGetUniformLocation(ID, name.c_str()), v1, v2, v3, v4);
+    glUniform4f(getUniformLocation(name), v1, v2, v3, v4);
 }
 
 void Shader::setMat2(const std::string& name, const glm::mat2& mat)
 {
-    glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(mat));
+    glUniformMatrix2fv(getUniformLocation(name), 1, GL_FALSE, glm::value_ptr(mat));
 }
 
 void Shader::setMat3(const std::string& name, const glm::mat3& mat)
 {
-    glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(mat));
+    glUniformMatrix3fv(getUniformLocation(name), 1, GL_FALSE, glm::value_ptr(mat));
 }
 
 void Shader::setMat4(const std::string& name, const glm::mat4& mat)
 {
-    glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(mat));
+    glUniformMatrix4fv(getUniformLocation(name), 1, GL_FALSE, glm::value_ptr(mat));
+}
+
+void Shader::cacheUniformLocations()
+{
+    GLint count = 0, maxLength = 0;
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+    std::string name(maxLength, '\0');
+    for (GLint i = 0; i < count; i++)
+    {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(ID, i, maxLength, &length, &size, &type, &name[0]);
+
+        std::string uniformName = name.substr(0, length);
+        GLint location = glGetUniformLocation(ID, uniformName.c_str());
+        if (location < 0) // Uniforms inside blocks have no location
+            continue;
+
+        uniformLocations[uniformName] = location;
+
+        // Arrays are reported once as "name[0]", add their plain name and the other elements too
+        size_t bracket = uniformName.rfind("[0]");
+        if (bracket != std::string::npos && bracket + 3 == uniformName.size())
+        {
+            std::string baseName = uniformName.substr(0, bracket);
+            uniformLocations[baseName] = location;
+            for (GLint element = 1; element < size; element++)
+            {
+                std::string elementName = baseName + "[" + std::to_string(element) + "]";
+                uniformLocations[elementName] = glGetUniformLocation(ID, elementName.c_str());
+            }
+        }
+    }
+}
+
+std::string Shader::insertDefines(const std::string& code, const std::string& defines)
+{
+    if (defines.empty())
+        return code;
+
+    // #version has to stay the first line
+    size_t lineEnd = code.find('\n', code.find("#version"));
+    if (lineEnd == std::string::npos)
+        return code;
+    return code.substr(0, lineEnd + 1) + defines + code.substr(lineEnd + 1);
 }
 
 void Shader::checkCompileErrors(unsigned int shader, std::string type)
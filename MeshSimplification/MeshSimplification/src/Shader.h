@@ -10,17 +10,28 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
 
 class Shader
 {
 public:
 	unsigned int ID;
 
-	Shader(const char* vertexPath, const char* fragmentPath);
+	// defines are inserted after the #version line of both shaders, e.g. "#define BATCHED\n"
+	Shader(const char* vertexPath, const char* fragmentPath, const std::string& defines = "");
 	~Shader();
 
+	// The shader owns its program, copies would delete it twice
+	Shader(const Shader&) = delete;
+	Shader& operator=(const Shader&) = delete;
+
 	void Activate();
 
+	// Location from the cache filled after linking, -1 if the uniform isn't active
+	GLint getUniformLocation(const std::string& name) const;
+	// Connect a uniform block in the program to a uniform buffer binding point
+	void bindUniformBlock(const std::string& blockName, GLuint binding);
+
 	// Set uniform helpers
 	void setFloat(const std::string& name, float value);
 	void setInt(const std::string& name, int value);
@@ -39,6 +50,13 @@ public:
 	void setMat4(const std::string& name, const glm::mat4& mat);
 
 private:
+	std::unordered_map<std::string, GLint> uniformLocations;
+
+	// Look up every active uniform once so the setters don't have to query GL by name
+	void cacheUniformLocations();
+
+	// utility function for adding defines to shader source
+	std::string insertDefines(const std::string& code, const std::string& defines);
 	// utility function for checking shader compilation/linking errors.
 	void checkCompileErrors(unsigned int shader, std::string type);
 };
@@ -0,0 +1,7 @@
+#include "SimplifierWorkspace.h"
+
+SimplifierWorkspace& SimplifierWorkspace::local()
+{
+    static thread_local SimplifierWorkspace workspace;
+    return workspace;
+}
@@ -0,0 +1,28 @@
+#ifndef SIMPLIFIERWORKSPACE_H
+#define SIMPLIFIERWORKSPACE_H
+
+#include "BinaryMesh.h"
+#include "MyOpenMesh.h"
+
+// Everything simplifying a mesh needs besides the input: the working mesh with its decimater, quadrics and heap
+// positions, the meshlet builder's arrays and the staging for the result. Nothing is freed between calls, the arrays
+// only grow, so once a workspace has held its largest mesh the next meshes are simplified in memory it already has.
+// A workspace keeps that memory until it is destroyed, and is used by one thread at a time.
+class SimplifierWorkspace
+{
+public:
+	MyOpenMesh simplifier;
+	// Result of the last call, for extractMeshData and the cache, valid until the next call
+	MeshData result;
+
+	SimplifierWorkspace() { simplifier.verbose = false; }
+
+	SimplifierWorkspace(const SimplifierWorkspace&) = delete;
+	SimplifierWorkspace& operator=(const SimplifierWorkspace&) = delete;
+
+	// Workspace of the calling thread, made on first use. Pool workers run until their pool goes, so every job
+	// of a worker shares one.
+	static SimplifierWorkspace& local();
+};
+
+#endif
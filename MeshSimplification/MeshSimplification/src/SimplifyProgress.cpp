@@ -0,0 +1,51 @@
+#include "SimplifyProgress.h"
+
+#include <algorithm>
+#include <chrono>
+
+static int64_t steadyNanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void SimplifyProgress::begin(size_t startFaces, size_t targetFaces)
+{
+    collapseCount.store(0, std::memory_order_relaxed);
+    startFaceCount.store(startFaces, std::memory_order_relaxed);
+    targetFaceCount.store(targetFaces, std::memory_order_relaxed);
+    faceCount.store(startFaces, std::memory_order_relaxed);
+    maxError.store(0.0f, std::memory_order_relaxed);
+    startTime.store(steadyNanoseconds(), std::memory_order_relaxed);
+    finished.store(false, std::memory_order_relaxed);
+}
+
+void SimplifyProgress::report(size_t collapses, size_t faces, float error)
+{
+    collapseCount.store(collapses, std::memory_order_relaxed);
+    faceCount.store(faces, std::memory_order_relaxed);
+    maxError.store(error, std::memory_order_relaxed);
+}
+
+float SimplifyProgress::fraction() const
+{
+    if (done())
+        return 1.0f;
+    size_t start = startFaceCount.load(std::memory_order_relaxed);
+    size_t target = targetFaceCount.load(std::memory_order_relaxed);
+    size_t faces = faceCount.load(std::memory_order_relaxed);
+    if (start <= target)
+        return 0.0f;
+    float removed = static_cast<float>(start - std::min(std::max(faces, target), start));
+    return removed / static_cast<float>(start - target);
+}
+
+double SimplifyProgress::secondsRemaining() const
+{
+    if (done())
+        return 0.0;
+    float progress = fraction();
+    if (progress <= 0.0f)
+        return -1.0;
+    double elapsed = (steadyNanoseconds() - startTime.load(std::memory_order_relaxed)) * 1e-9;
+    return elapsed * (1.0 - progress) / progress;
+}
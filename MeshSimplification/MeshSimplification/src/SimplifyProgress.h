@@ -0,0 +1,51 @@
+#ifndef SIMPLIFYPROGRESS_H
+#define SIMPLIFYPROGRESS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Stops a simplification from any thread. The engines check it every few hundred collapses, which is a few
+// milliseconds at most, and stop between two collapses, so the mesh they leave is valid, only less simplified.
+// One token may be shared by several simplifications to stop them all at once.
+class CancellationToken
+{
+public:
+	void cancel() { flag.store(true, std::memory_order_relaxed); }
+	bool cancelled() const { return flag.load(std::memory_order_relaxed); }
+
+private:
+	std::atomic<bool> flag{ false };
+};
+
+// State of a running simplification, written by the engine as it goes and polled from any thread, e.g. once a frame.
+// Counters only, so reporting costs the engine a few relaxed stores.
+class SimplifyProgress
+{
+public:
+	// Called by the engine before the first collapse
+	void begin(size_t startFaces, size_t targetFaces);
+	void report(size_t collapses, size_t faces, float error);
+	void end() { finished.store(true, std::memory_order_relaxed); }
+
+	size_t collapses() const { return collapseCount.load(std::memory_order_relaxed); }
+	size_t faces() const { return faceCount.load(std::memory_order_relaxed); }
+	// Largest geometric error so far, in model units
+	float error() const { return maxError.load(std::memory_order_relaxed); }
+	bool done() const { return finished.load(std::memory_order_relaxed); }
+	// Share of the faces to remove that are gone, from 0 to 1
+	float fraction() const;
+	// Extrapolated from the rate so far, negative until there is a rate
+	double secondsRemaining() const;
+
+private:
+	std::atomic<size_t> collapseCount{ 0 };
+	std::atomic<size_t> startFaceCount{ 0 };
+	std::atomic<size_t> targetFaceCount{ 0 };
+	std::atomic<size_t> faceCount{ 0 };
+	std::atomic<float> maxError{ 0.0f };
+	std::atomic<int64_t> startTime{ 0 }; // Nanoseconds on the steady clock
+	std::atomic<bool> finished{ false };
+};
+
+#endif
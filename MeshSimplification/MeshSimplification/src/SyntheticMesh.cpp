@@ -0,0 +1,837 @@
+#include "SyntheticMesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#include "MyOpenMesh.h"
+#include "Trace.h"
+
+namespace
+{
+    const char* const SHAPE_NAMES[] = { "icosphere", "terrain", "torus", "holes", "nonmanifold" };
+    // Vertices or triangles handed to the sink at once
+    const size_t CHUNK_SIZE = 1 << 16;
+
+    // Fractal value noise, the displacement of every shape
+    const int NOISE_OCTAVES = 5;
+    const float ICOSPHERE_FREQUENCY = 2.0f;
+    const float ICOSPHERE_AMPLITUDE = 0.05f;
+    const float TERRAIN_FREQUENCY = 3.0f;
+    const float TERRAIN_AMPLITUDE = 0.25f;
+    const float PLATE_FREQUENCY = 1.5f;
+    const float PLATE_AMPLITUDE = 0.15f;
+
+    // Torus: every block of HOLE_PERIOD by HOLE_PERIOD cells has a hole of the middle two by two cells
+    const uint64_t HOLE_PERIOD = 4;
+    // Holes: a round hole in every block of ROUND_HOLE_PERIOD cells that lies inside the terrain, sized and moved
+    // off the block's center by these fractions of the block. Holes never touch, so every vertex stays manifold.
+    const uint64_t ROUND_HOLE_PERIOD = 16;
+    const float ROUND_HOLE_RADIUS = 0.3f;
+    const float ROUND_HOLE_JITTER = 0.1f;
+    // Nonmanifold: a fin on every FIN_PERIOD-th cell and a bowtie on every BOWTIE_PERIOD-th vertex, from an offset
+    // picked by the seed. Primes, so they don't line up with the rows.
+    const uint64_t FIN_PERIOD = 61;
+    const uint64_t BOWTIE_PERIOD = 67;
+
+    // splitmix64 finalizer
+    uint64_t mixBits(uint64_t x)
+    {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ull;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebull;
+        x ^= x >> 31;
+        return x;
+    }
+
+    // Uniform in [0, 1) for every lattice point and seed
+    float latticeValue(int64_t x, int64_t y, int64_t z, uint64_t seed)
+    {
+        // Odd multipliers spread the coordinates over the word, one finalizer then decorrelates neighbours
+        uint64_t h = mixBits(seed + static_cast<uint64_t>(x) * 0x9e3779b97f4a7c15ull + static_cast<uint64_t>(y) * 0xc2b2ae3d27d4eb4full
+            + static_cast<uint64_t>(z) * 0x165667b19e3779f9ull);
+        return static_cast<float>(h >> 40) / static_cast<float>(1 << 24);
+    }
+
+    // Smoothly interpolated lattice values, in [-1, 1]
+    float valueNoise(const glm::vec3& p, uint64_t seed)
+    {
+        glm::vec3 cell = glm::floor(p);
+        glm::vec3 f = p - cell;
+        glm::vec3 s = f * f * (3.0f - 2.0f * f);
+        int64_t x = static_cast<int64_t>(cell.x), y = static_cast<int64_t>(cell.y), z = static_cast<int64_t>(cell.z);
+
+        float corners[2][2];
+        for (int dz = 0; dz < 2; dz++)
+            for (int dy = 0; dy < 2; dy++)
+                corners[dz][dy] = glm::mix(latticeValue(x, y + dy, z + dz, seed), latticeValue(x + 1, y + dy, z + dz, seed), s.x);
+        float value = glm::mix(glm::mix(corners[0][0], corners[0][1], s.y), glm::mix(corners[1][0], corners[1][1], s.y), s.z);
+        return 2.0f * value - 1.0f;
+    }
+
+    float fractalNoise(glm::vec3 p, uint64_t seed)
+    {
+        float sum = 0.0f, amplitude = 0.5f;
+        for (int octave = 0; octave < NOISE_OCTAVES; octave++)
+        {
+            sum += amplitude * valueNoise(p, seed + octave);
+            p *= 2.0f;
+            amplitude *= 0.5f;
+        }
+        return sum;
+    }
+
+    // Gathers vertices and triangles into chunks for the sink. The first triangle sends the last vertices.
+    class Emitter
+    {
+    public:
+        bool ok = true;
+
+        explicit Emitter(SyntheticMeshSink& sink) : sink(sink)
+        {
+            vertices.reserve(CHUNK_SIZE);
+            indices.reserve(3 * CHUNK_SIZE);
+        }
+
+        void vertex(const glm::vec3& position)
+        {
+            vertices.push_back(position);
+            if (vertices.size() == CHUNK_SIZE)
+                flushVertices();
+        }
+
+        void triangle(uint64_t a, uint64_t b, uint64_t c)
+        {
+            if (!vertices.empty())
+                flushVertices();
+            indices.push_back(static_cast<uint32_t>(a));
+            indices.push_back(static_cast<uint32_t>(b));
+            indices.push_back(static_cast<uint32_t>(c));
+            if (indices.size() == 3 * CHUNK_SIZE)
+                flushTriangles();
+        }
+
+        bool finish()
+        {
+            flushVertices();
+            flushTriangles();
+            return ok && sink.end();
+        }
+
+    private:
+        SyntheticMeshSink& sink;
+        std::vector<glm::vec3> vertices;
+        std::vector<uint32_t> indices;
+
+        void flushVertices()
+        {
+            if (ok && !vertices.empty())
+                ok = sink.addVertices(vertices.data(), vertices.size());
+            vertices.clear();
+        }
+
+        void flushTriangles()
+        {
+            if (ok && !indices.empty())
+                ok = sink.addTriangles(indices.data(), indices.size() / 3);
+            indices.clear();
+        }
+    };
+
+    // Elements of [0, total) with (element + offset) % period == 0, in order
+    uint64_t firstPeriodic(uint64_t period, uint64_t offset)
+    {
+        return (period - offset % period) % period;
+    }
+
+    uint64_t countPeriodic(uint64_t total, uint64_t period, uint64_t offset)
+    {
+        uint64_t first = firstPeriodic(period, offset);
+        return first < total ? (total - 1 - first) / period + 1 : 0;
+    }
+
+    uint64_t gridCells(uint64_t triangles)
+    {
+        return std::max<uint64_t>(1, static_cast<uint64_t>(std::llround(std::sqrt(triangles / 2.0))));
+    }
+
+    // Flat shapes map the lattice onto the xz plane, counter-clockwise in the lattice faces +y
+    glm::vec3 flatPoint(float u, float v, float height)
+    {
+        return glm::vec3(u, height, -v);
+    }
+
+    float latticeCoordinate(uint64_t i, uint64_t cells)
+    {
+        return 2.0f * static_cast<float>(i) / static_cast<float>(cells) - 1.0f;
+    }
+
+    glm::vec3 terrainPoint(uint64_t x, uint64_t y, uint64_t cells, uint64_t seed)
+    {
+        float u = latticeCoordinate(x, cells), v = latticeCoordinate(y, cells);
+        return flatPoint(u, v, TERRAIN_AMPLITUDE * fractalNoise(glm::vec3(u, v, 0.0f) * TERRAIN_FREQUENCY, seed));
+    }
+
+    // Icosphere
+
+    const float GOLDEN = 1.6180339887f;
+    const glm::vec3 ICOSAHEDRON_CORNERS[12] = {
+        { -1, GOLDEN, 0 }, { 1, GOLDEN, 0 }, { -1, -GOLDEN, 0 }, { 1, -GOLDEN, 0 },
+        { 0, -1, GOLDEN }, { 0, 1, GOLDEN }, { 0, -1, -GOLDEN }, { 0, 1, -GOLDEN },
+        { GOLDEN, 0, -1 }, { GOLDEN, 0, 1 }, { -GOLDEN, 0, -1 }, { -GOLDEN, 0, 1 } };
+    const int ICOSAHEDRON_FACES[20][3] = {
+        { 0, 11, 5 }, { 0, 5, 1 }, { 0, 1, 7 }, { 0, 7, 10 }, { 0, 10, 11 },
+        { 1, 5, 9 }, { 5, 11, 4 }, { 11, 10, 2 }, { 10, 7, 6 }, { 7, 1, 8 },
+        { 3, 9, 4 }, { 3, 4, 2 }, { 3, 2, 6 }, { 3, 6, 8 }, { 3, 8, 9 },
+        { 4, 9, 5 }, { 2, 4, 11 }, { 6, 2, 10 }, { 8, 6, 7 }, { 9, 8, 1 } };
+
+    uint64_t icosphereFrequency(uint64_t triangles)
+    {
+        return std::max<uint64_t>(1, static_cast<uint64_t>(std::llround(std::sqrt(triangles / 20.0))));
+    }
+
+    void countIcosphere(uint64_t n, uint64_t& vertices, uint64_t& triangles)
+    {
+        vertices = 10 * n * n + 2;
+        triangles = 20 * n * n;
+    }
+
+    // Vertices are numbered corners first, then the inner vertices of every edge from its lower corner, then the inner
+    // vertices of every face row by row, so vertices shared by faces are only made once
+    void generateIcosphere(uint64_t n, uint64_t seed, Emitter& emit)
+    {
+        int edgeIndex[12][12];
+        std::fill(&edgeIndex[0][0], &edgeIndex[0][0] + 144, -1);
+        std::vector<std::pair<int, int>> edges;
+        for (const int* face : ICOSAHEDRON_FACES)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                int lo = std::min(face[k], face[(k + 1) % 3]), hi = std::max(face[k], face[(k + 1) % 3]);
+                if (edgeIndex[lo][hi] < 0)
+                {
+                    edgeIndex[lo][hi] = static_cast<int>(edges.size());
+                    edges.push_back({ lo, hi });
+                }
+            }
+        }
+
+        auto place = [&](glm::vec3 p)
+        {
+            p = glm::normalize(p);
+            return p * (1.0f + ICOSPHERE_AMPLITUDE * fractalNoise(p * ICOSPHERE_FREQUENCY, seed));
+        };
+        float step = 1.0f / static_cast<float>(n);
+
+        for (const glm::vec3& corner : ICOSAHEDRON_CORNERS)
+            emit.vertex(place(corner));
+        for (const std::pair<int, int>& edge : edges)
+            for (uint64_t k = 1; k < n; k++)
+                emit.vertex(place(glm::mix(ICOSAHEDRON_CORNERS[edge.first], ICOSAHEDRON_CORNERS[edge.second], k * step)));
+        for (const int* face : ICOSAHEDRON_FACES)
+        {
+            glm::vec3 a = ICOSAHEDRON_CORNERS[face[0]], ab = ICOSAHEDRON_CORNERS[face[1]] - a, ac = ICOSAHEDRON_CORNERS[face[2]] - a;
+            for (uint64_t j = 1; j + 1 < n && emit.ok; j++)
+                for (uint64_t i = 1; i + j < n; i++)
+                    emit.vertex(place(a + ab * (i * step) + ac * (j * step)));
+        }
+
+        uint64_t faceBase = 12 + edges.size() * (n - 1);
+        uint64_t perFace = n >= 2 ? (n - 1) * (n - 2) / 2 : 0;
+        auto edgeVertex = [&](int from, int to, uint64_t k)
+        {
+            int lo = std::min(from, to), hi = std::max(from, to);
+            uint64_t along = from == lo ? k : n - k;
+            return 12 + edgeIndex[lo][hi] * (n - 1) + along - 1;
+        };
+        // Point i steps towards the second corner and j towards the third of face f
+        auto vertexId = [&](int f, uint64_t i, uint64_t j) -> uint64_t
+        {
+            const int* face = ICOSAHEDRON_FACES[f];
+            if (i == 0 && j == 0)
+                return face[0];
+            if (i == n)
+                return face[1];
+            if (j == n)
+                return face[2];
+            if (j == 0)
+                return edgeVertex(face[0], face[1], i);
+            if (i == 0)
+                return edgeVertex(face[0], face[2], j);
+            if (i + j == n)
+                return edgeVertex(face[1], face[2], j);
+            return faceBase + f * perFace + (j - 1) * (n - 1) - (j - 1) * j / 2 + (i - 1);
+        };
+
+        for (int f = 0; f < 20; f++)
+        {
+            for (uint64_t j = 0; j < n && emit.ok; j++)
+            {
+                for (uint64_t i = 0; i + j < n; i++)
+                {
+                    emit.triangle(vertexId(f, i, j), vertexId(f, i + 1, j), vertexId(f, i, j + 1));
+                    if (i + j + 1 < n)
+                        emit.triangle(vertexId(f, i + 1, j), vertexId(f, i + 1, j + 1), vertexId(f, i, j + 1));
+                }
+            }
+        }
+    }
+
+    // Terrain and the grid under the nonmanifold shape
+
+    void emitGrid(uint64_t cells, uint64_t seed, Emitter& emit)
+    {
+        for (uint64_t y = 0; y <= cells && emit.ok; y++)
+            for (uint64_t x = 0; x <= cells; x++)
+                emit.vertex(terrainPoint(x, y, cells, seed));
+    }
+
+    void emitGridTriangles(uint64_t cells, Emitter& emit)
+    {
+        uint64_t row = cells + 1;
+        for (uint64_t y = 0; y < cells && emit.ok; y++)
+        {
+            for (uint64_t x = 0; x < cells; x++)
+            {
+                uint64_t a = y * row + x;
+                emit.triangle(a, a + 1, a + row + 1);
+                emit.triangle(a, a + row + 1, a + row);
+            }
+        }
+    }
+
+    // Nonmanifold
+
+    struct NonManifoldLayout
+    {
+        uint64_t cells;
+        uint64_t finOffset, fins;
+        uint64_t bowtieOffset, bowties;
+    };
+
+    NonManifoldLayout nonManifoldLayout(uint64_t triangles, uint64_t seed)
+    {
+        NonManifoldLayout layout;
+        layout.cells = gridCells(triangles);
+        uint64_t hash = mixBits(seed);
+        layout.finOffset = hash % FIN_PERIOD;
+        layout.bowtieOffset = (hash >> 32) % BOWTIE_PERIOD;
+        layout.fins = countPeriodic(layout.cells * layout.cells, FIN_PERIOD, layout.finOffset);
+        layout.bowties = countPeriodic((layout.cells + 1) * (layout.cells + 1), BOWTIE_PERIOD, layout.bowtieOffset);
+        return layout;
+    }
+
+    void countNonManifold(const NonManifoldLayout& layout, uint64_t& vertices, uint64_t& triangles)
+    {
+        vertices = (layout.cells + 1) * (layout.cells + 1) + layout.fins + 2 * layout.bowties;
+        triangles = 2 * layout.cells * layout.cells + layout.fins + layout.bowties;
+    }
+
+    // Fins stand on the diagonal of their cell, a third face on an edge that already has two. Bowties are triangles
+    // standing on a grid vertex, the vertex then joins two fans that share nothing else.
+    void generateNonManifold(const NonManifoldLayout& layout, uint64_t seed, Emitter& emit)
+    {
+        uint64_t cells = layout.cells, row = cells + 1;
+        float size = 2.0f / static_cast<float>(cells);
+        emitGrid(cells, seed, emit);
+        for (uint64_t cell = firstPeriodic(FIN_PERIOD, layout.finOffset); cell < cells * cells; cell += FIN_PERIOD)
+        {
+            uint64_t x = cell % cells, y = cell / cells;
+            glm::vec3 middle = (terrainPoint(x, y, cells, seed) + terrainPoint(x + 1, y + 1, cells, seed)) * 0.5f;
+            emit.vertex(middle + glm::vec3(0.0f, size, 0.0f));
+        }
+        for (uint64_t vertex = firstPeriodic(BOWTIE_PERIOD, layout.bowtieOffset); vertex < row * row; vertex += BOWTIE_PERIOD)
+        {
+            glm::vec3 base = terrainPoint(vertex % row, vertex / row, cells, seed);
+            emit.vertex(base + glm::vec3(size * 0.5f, size, 0.0f));
+            emit.vertex(base + glm::vec3(-size * 0.5f, size, 0.0f));
+        }
+
+        emitGridTriangles(cells, emit);
+        uint64_t next = row * row;
+        for (uint64_t cell = firstPeriodic(FIN_PERIOD, layout.finOffset); cell < cells * cells; cell += FIN_PERIOD)
+        {
+            uint64_t a = (cell / cells) * row + cell % cells;
+            emit.triangle(a, a + row + 1, next++);
+        }
+        for (uint64_t vertex = firstPeriodic(BOWTIE_PERIOD, layout.bowtieOffset); vertex < row * row; vertex += BOWTIE_PERIOD)
+        {
+            emit.triangle(vertex, next, next + 1);
+            next += 2;
+        }
+    }
+
+    // Torus, the surface of a plate with square holes. Cells are the squares of the lattice, lattice points inside a
+    // hole touch no face and get no vertex.
+
+    uint64_t plateCells(uint64_t triangles)
+    {
+        // 4 w^2 + 8 w triangles for w cells a side
+        uint64_t cells = static_cast<uint64_t>(std::llround(std::sqrt(triangles / 4.0) / HOLE_PERIOD)) * HOLE_PERIOD;
+        return std::max(cells, HOLE_PERIOD);
+    }
+
+    bool plateHole(uint64_t x, uint64_t y)
+    {
+        uint64_t i = x % HOLE_PERIOD, j = y % HOLE_PERIOD;
+        return (i == 1 || i == 2) && (j == 1 || j == 2);
+    }
+
+    bool plateSolid(int64_t x, int64_t y, uint64_t cells)
+    {
+        return x >= 0 && y >= 0 && static_cast<uint64_t>(x) < cells && static_cast<uint64_t>(y) < cells && !plateHole(x, y);
+    }
+
+    bool plateInner(uint64_t x, uint64_t y)
+    {
+        return x % HOLE_PERIOD == 2 && y % HOLE_PERIOD == 2;
+    }
+
+    void countPlate(uint64_t cells, uint64_t& vertices, uint64_t& triangles)
+    {
+        uint64_t holesPerRow = cells / HOLE_PERIOD;
+        vertices = 2 * ((cells + 1) * (cells + 1) - holesPerRow * holesPerRow);
+        triangles = 4 * cells * cells + 8 * cells;
+    }
+
+    void generatePlate(uint64_t cells, uint64_t seed, Emitter& emit)
+    {
+        uint64_t row = cells + 1, holesPerRow = cells / HOLE_PERIOD;
+        uint64_t layer = row * row - holesPerRow * holesPerRow;
+        float halfThickness = 1.0f / static_cast<float>(cells);
+
+        for (int side = 0; side < 2; side++)
+        {
+            float offset = side == 0 ? halfThickness : -halfThickness;
+            for (uint64_t y = 0; y <= cells && emit.ok; y++)
+            {
+                for (uint64_t x = 0; x <= cells; x++)
+                {
+                    if (plateInner(x, y))
+                        continue;
+                    float u = latticeCoordinate(x, cells), v = latticeCoordinate(y, cells);
+                    emit.vertex(flatPoint(u, v, PLATE_AMPLITUDE * fractalNoise(glm::vec3(u, v, 0.0f) * PLATE_FREQUENCY, seed) + offset));
+                }
+            }
+        }
+
+        // Lattice points before (x, y) inside holes are the ones of the earlier rows and of this row left of x
+        auto top = [&](uint64_t x, uint64_t y)
+        {
+            return y * row + x - (y + 1) / HOLE_PERIOD * holesPerRow - (y % HOLE_PERIOD == 2 ? (x + 1) / HOLE_PERIOD : 0);
+        };
+        auto bottom = [&](uint64_t x, uint64_t y) { return layer + top(x, y); };
+        // Wall from the lattice edge p0 p1 down to the bottom, for an edge with the solid on its right going from p0 to p1
+        auto wall = [&](uint64_t x0, uint64_t y0, uint64_t x1, uint64_t y1)
+        {
+            emit.triangle(top(x0, y0), top(x1, y1), bottom(x1, y1));
+            emit.triangle(top(x0, y0), bottom(x1, y1), bottom(x0, y0));
+        };
+
+        for (uint64_t y = 0; y < cells && emit.ok; y++)
+        {
+            for (uint64_t x = 0; x < cells; x++)
+            {
+                if (plateHole(x, y))
+                    continue;
+                emit.triangle(top(x, y), top(x + 1, y), top(x + 1, y + 1));
+                emit.triangle(top(x, y), top(x + 1, y + 1), top(x, y + 1));
+                emit.triangle(bottom(x, y), bottom(x + 1, y + 1), bottom(x + 1, y));
+                emit.triangle(bottom(x, y), bottom(x, y + 1), bottom(x + 1, y + 1));
+            }
+        }
+        // Walls stand on the lattice edges between solid and empty, the outer rim and the sides of the holes
+        for (uint64_t y = 0; y <= cells && emit.ok; y++)
+        {
+            for (uint64_t x = 0; x < cells; x++)
+            {
+                bool below = plateSolid(x, static_cast<int64_t>(y) - 1, cells), above = plateSolid(x, y, cells);
+                if (below && !above)
+                    wall(x, y, x + 1, y);
+                else if (above && !below)
+                    wall(x + 1, y, x, y);
+            }
+        }
+        for (uint64_t y = 0; y < cells && emit.ok; y++)
+        {
+            for (uint64_t x = 0; x <= cells; x++)
+            {
+                bool left = plateSolid(static_cast<int64_t>(x) - 1, y, cells), right = plateSolid(x, y, cells);
+                if (left && !right)
+                    wall(x, y + 1, x, y);
+                else if (right && !left)
+                    wall(x, y, x, y + 1);
+            }
+        }
+    }
+
+    // Holes
+
+    struct HolesLayout
+    {
+        uint64_t cells;
+        uint64_t seed;
+
+        bool cellRemoved(uint64_t x, uint64_t y) const
+        {
+            uint64_t bx = x / ROUND_HOLE_PERIOD, by = y / ROUND_HOLE_PERIOD;
+            if ((bx + 1) * ROUND_HOLE_PERIOD > cells || (by + 1) * ROUND_HOLE_PERIOD > cells)
+                return false;
+            float period = static_cast<float>(ROUND_HOLE_PERIOD);
+            float jitter = ROUND_HOLE_JITTER * period;
+            glm::vec2 center((bx + 0.5f) * period + (2.0f * latticeValue(bx, by, 0, seed) - 1.0f) * jitter,
+                (by + 0.5f) * period + (2.0f * latticeValue(bx, by, 1, seed) - 1.0f) * jitter);
+            glm::vec2 cell(x + 0.5f, y + 0.5f);
+            float radius = ROUND_HOLE_RADIUS * period;
+            return glm::dot(cell - center, cell - center) < radius * radius;
+        }
+
+        bool cellKept(int64_t x, int64_t y) const
+        {
+            return x >= 0 && y >= 0 && static_cast<uint64_t>(x) < cells && static_cast<uint64_t>(y) < cells && !cellRemoved(x, y);
+        }
+
+        bool vertexUsed(uint64_t x, uint64_t y) const
+        {
+            int64_t cx = static_cast<int64_t>(x), cy = static_cast<int64_t>(y);
+            return cellKept(cx - 1, cy - 1) || cellKept(cx, cy - 1) || cellKept(cx - 1, cy) || cellKept(cx, cy);
+        }
+    };
+
+    HolesLayout holesLayout(uint64_t triangles, uint64_t seed)
+    {
+        // A hole takes pi r^2 of its block
+        float removed = 3.14159265f * ROUND_HOLE_RADIUS * ROUND_HOLE_RADIUS;
+        return { gridCells(static_cast<uint64_t>(triangles / (1.0 - removed))), seed };
+    }
+
+    void countHoles(const HolesLayout& layout, uint64_t& vertices, uint64_t& triangles)
+    {
+        vertices = triangles = 0;
+        for (uint64_t y = 0; y <= layout.cells; y++)
+        {
+            for (uint64_t x = 0; x <= layout.cells; x++)
+            {
+                vertices += layout.vertexUsed(x, y);
+                triangles += x < layout.cells && y < layout.cells && !layout.cellRemoved(x, y) ? 2 : 0;
+            }
+        }
+    }
+
+    void generateHoles(const HolesLayout& layout, Emitter& emit)
+    {
+        uint64_t cells = layout.cells;
+        for (uint64_t y = 0; y <= cells && emit.ok; y++)
+            for (uint64_t x = 0; x <= cells; x++)
+                if (layout.vertexUsed(x, y))
+                    emit.vertex(terrainPoint(x, y, cells, layout.seed));
+
+        // Vertex ids of two lattice rows at a time, numbered in the order they were emitted
+        std::vector<uint64_t> lower(cells + 1), upper(cells + 1);
+        uint64_t next = 0;
+        auto numberRow = [&](uint64_t y, std::vector<uint64_t>& ids)
+        {
+            for (uint64_t x = 0; x <= cells; x++)
+                if (layout.vertexUsed(x, y))
+                    ids[x] = next++;
+        };
+        numberRow(0, lower);
+        for (uint64_t y = 0; y < cells && emit.ok; y++)
+        {
+            numberRow(y + 1, upper);
+            for (uint64_t x = 0; x < cells; x++)
+            {
+                if (layout.cellRemoved(x, y))
+                    continue;
+                emit.triangle(lower[x], lower[x + 1], upper[x + 1]);
+                emit.triangle(lower[x], upper[x + 1], upper[x]);
+            }
+            std::swap(lower, upper);
+        }
+    }
+
+    bool parseCount(const std::string& text, uint64_t& count)
+    {
+        char* end = nullptr;
+        double value = std::strtod(text.c_str(), &end);
+        if (end == text.c_str())
+            return false;
+        std::string suffix(end);
+        if (suffix == "k" || suffix == "K")
+            value *= 1e3;
+        else if (suffix == "m" || suffix == "M")
+            value *= 1e6;
+        else if (suffix == "g" || suffix == "G")
+            value *= 1e9;
+        else if (!suffix.empty())
+            return false;
+        if (!(value >= 1.0))
+            return false;
+        count = static_cast<uint64_t>(value);
+        return true;
+    }
+}
+
+bool parseSyntheticMesh(const std::string& spec, SyntheticMeshSettings& settings)
+{
+    size_t first = spec.find(':');
+    if (first == std::string::npos)
+        return false;
+    size_t second = spec.find(':', first + 1);
+
+    std::string shape = spec.substr(0, first);
+    size_t shapeIndex = 0;
+    while (shapeIndex < sizeof(SHAPE_NAMES) / sizeof(SHAPE_NAMES[0]) && shape != SHAPE_NAMES[shapeIndex])
+        shapeIndex++;
+    if (shapeIndex == sizeof(SHAPE_NAMES) / sizeof(SHAPE_NAMES[0]))
+        return false;
+
+    SyntheticMeshSettings parsed;
+    parsed.shape = static_cast<SyntheticShape>(shapeIndex);
+    if (!parseCount(spec.substr(first + 1, second == std::string::npos ? std::string::npos : second - first - 1), parsed.triangles))
+        return false;
+    if (second != std::string::npos)
+    {
+        std::string seed = spec.substr(second + 1);
+        char* end = nullptr;
+        parsed.seed = std::strtoull(seed.c_str(), &end, 10);
+        if (seed.empty() || *end != '\0')
+            return false;
+    }
+    settings = parsed;
+    return true;
+}
+
+std::string syntheticMeshSpec(const SyntheticMeshSettings& settings)
+{
+    return std::string(SHAPE_NAMES[static_cast<int>(settings.shape)]) + ':' + std::to_string(settings.triangles) + ':' + std::to_string(settings.seed);
+}
+
+std::string syntheticMeshName(const SyntheticMeshSettings& settings)
+{
+    std::string name = syntheticMeshSpec(settings);
+    std::replace(name.begin(), name.end(), ':', '_');
+    return name;
+}
+
+void countSyntheticMesh(const SyntheticMeshSettings& settings, uint64_t& vertices, uint64_t& triangles)
+{
+    switch (settings.shape)
+    {
+    case SyntheticShape::Icosphere:
+        countIcosphere(icosphereFrequency(settings.triangles), vertices, triangles);
+        break;
+    case SyntheticShape::Terrain:
+    {
+        uint64_t cells = gridCells(settings.triangles);
+        vertices = (cells + 1) * (cells + 1);
+        triangles = 2 * cells * cells;
+        break;
+    }
+    case SyntheticShape::Torus:
+        countPlate(plateCells(settings.triangles), vertices, triangles);
+        break;
+    case SyntheticShape::Holes:
+        countHoles(holesLayout(settings.triangles, settings.seed), vertices, triangles);
+        break;
+    case SyntheticShape::NonManifold:
+        countNonManifold(nonManifoldLayout(settings.triangles, settings.seed), vertices, triangles);
+        break;
+    }
+}
+
+bool generateSyntheticMesh(const SyntheticMeshSettings& settings, SyntheticMeshSink& sink)
+{
+    TRACE_ZONE("generate");
+    uint64_t vertices, triangles;
+    countSyntheticMesh(settings, vertices, triangles);
+    if (vertices > std::numeric_limits<uint32_t>::max() || 3 * triangles > std::numeric_limits<uint32_t>::max())
+    {
+        std::cerr << "ERROR::SYNTHETIC_MESH::" << syntheticMeshSpec(settings) << " has too many triangles for 32 bit indices" << std::endl;
+        return false;
+    }
+    if (!sink.begin(vertices, triangles))
+        return false;
+
+    Emitter emit(sink);
+    switch (settings.shape)
+    {
+    case SyntheticShape::Icosphere:
+        generateIcosphere(icosphereFrequency(settings.triangles), settings.seed, emit);
+        break;
+    case SyntheticShape::Terrain:
+    {
+        uint64_t cells = gridCells(settings.triangles);
+        emitGrid(cells, settings.seed, emit);
+        emitGridTriangles(cells, emit);
+        break;
+    }
+    case SyntheticShape::Torus:
+        generatePlate(plateCells(settings.triangles), settings.seed, emit);
+        break;
+    case SyntheticShape::Holes:
+        generateHoles(holesLayout(settings.triangles, settings.seed), emit);
+        break;
+    case SyntheticShape::NonManifold:
+        generateNonManifold(nonManifoldLayout(settings.triangles, settings.seed), settings.seed, emit);
+        break;
+    }
+    return emit.finish();
+}
+
+bool MeshDataSink::begin(uint64_t vertexCount, uint64_t triangleCount)
+{
+    data = MeshData();
+    data.positions.reserve(vertexCount);
+    data.indices.reserve(3 * triangleCount);
+    return true;
+}
+
+bool MeshDataSink::addVertices(const glm::vec3* positions, size_t count)
+{
+    data.positions.insert(data.positions.end(), positions, positions + count);
+    return true;
+}
+
+bool MeshDataSink::addTriangles(const uint32_t* indices, size_t count)
+{
+    data.indices.insert(data.indices.end(), indices, indices + 3 * count);
+    return true;
+}
+
+bool SimplifierSink::begin(uint64_t vertexCount, uint64_t triangleCount)
+{
+    simplifier.beginMesh(vertexCount, triangleCount);
+    return true;
+}
+
+bool SimplifierSink::addVertices(const glm::vec3* positions, size_t count)
+{
+    // glm::vec3 is three packed floats
+    simplifier.addVertices(&positions[0].x, count);
+    return true;
+}
+
+bool SimplifierSink::addTriangles(const uint32_t* indices, size_t count)
+{
+    return simplifier.addTriangles(indices, count);
+}
+
+bool SimplifierSink::end()
+{
+    simplifier.endMesh();
+    return true;
+}
+
+bool BinaryMeshSink::begin(uint64_t vertices, uint64_t triangles)
+{
+    file.open(path, std::ios::binary);
+    if (!file)
+    {
+        std::cerr << "ERROR::SYNTHETIC_MESH::Could not open " << path << " for writing" << std::endl;
+        return false;
+    }
+
+    vertexCount = vertices;
+    indexCount = 3 * triangles;
+    verticesWritten = indicesWritten = 0;
+    BinaryMeshHeader header;
+    std::copy(BINARY_MESH_MAGIC, BINARY_MESH_MAGIC + 4, header.magic);
+    header.version = BINARY_MESH_VERSION;
+    header.vertexCount = static_cast<uint32_t>(vertexCount);
+    header.indexCount = static_cast<uint32_t>(indexCount);
+    header.meshletCount = 0;
+    header.collapseCount = 0;
+    header.error = 0.0f;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    return vertexCount > 0 || writeAttributes();
+}
+
+bool BinaryMeshSink::addVertices(const glm::vec3* positions, size_t count)
+{
+    file.write(reinterpret_cast<const char*>(positions), count * sizeof(glm::vec3));
+    verticesWritten += count;
+    if (verticesWritten == vertexCount)
+        return writeAttributes();
+    return static_cast<bool>(file);
+}
+
+bool BinaryMeshSink::writeAttributes()
+{
+    std::vector<char> zeros(1 << 20, 0);
+    uint64_t remaining = vertexCount * (sizeof(glm::vec3) + sizeof(glm::vec2));
+    while (remaining > 0 && file)
+    {
+        size_t bytes = static_cast<size_t>(std::min<uint64_t>(remaining, zeros.size()));
+        file.write(zeros.data(), bytes);
+        remaining -= bytes;
+    }
+    return static_cast<bool>(file);
+}
+
+bool BinaryMeshSink::addTriangles(const uint32_t* indices, size_t count)
+{
+    file.write(reinterpret_cast<const char*>(indices), 3 * count * sizeof(uint32_t));
+    indicesWritten += 3 * count;
+    return static_cast<bool>(file);
+}
+
+bool BinaryMeshSink::end()
+{
+    file.close();
+    if (!file || verticesWritten != vertexCount || indicesWritten != indexCount)
+    {
+        std::cerr << "ERROR::SYNTHETIC_MESH::Failed writing " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ObjSink::begin(uint64_t vertexCount, uint64_t triangleCount)
+{
+    file.open(path, std::ios::binary);
+    if (!file)
+    {
+        std::cerr << "ERROR::SYNTHETIC_MESH::Could not open " << path << " for writing" << std::endl;
+        return false;
+    }
+    file << "# " << vertexCount << " vertices, " << triangleCount << " triangles\n";
+    return static_cast<bool>(file);
+}
+
+bool ObjSink::addVertices(const glm::vec3* positions, size_t count)
+{
+    // Formatted a chunk at a time, the streams' own number formatting is several times slower
+    std::string text;
+    char line[96];
+    for (size_t i = 0; i < count; i++)
+        text.append(line, snprintf(line, sizeof(line), "v %.7g %.7g %.7g\n", positions[i].x, positions[i].y, positions[i].z));
+    file.write(text.data(), text.size());
+    return static_cast<bool>(file);
+}
+
+bool ObjSink::addTriangles(const uint32_t* indices, size_t count)
+{
+    std::string text;
+    char line[64];
+    for (size_t i = 0; i < count; i++)
+        text.append(line, snprintf(line, sizeof(line), "f %u %u %u\n", indices[3 * i] + 1, indices[3 * i + 1] + 1, indices[3 * i + 2] + 1));
+    file.write(text.data(), text.size());
+    return static_cast<bool>(file);
+}
+
+bool ObjSink::end()
+{
+    file.close();
+    if (!file)
+    {
+        std::cerr << "ERROR::SYNTHETIC_MESH::Failed writing " << path << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,126 @@
+#ifndef SYNTHETICMESH_H
+#define SYNTHETICMESH_H
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+#include "BinaryMesh.h"
+
+class MyOpenMesh;
+
+// Test meshes of controlled size and topology, reproducible from a shape, a triangle count and a seed alone, so scaling
+// benchmarks and stress tests don't depend on scan files. Flat shapes lie in the xz plane facing +y, all fit in [-1, 1].
+enum class SyntheticShape
+{
+	Icosphere, // Closed, genus 0. An icosahedron with every face split into an n by n grid, the radius noisy
+	Terrain, // Height field with fractal noise, one boundary loop
+	Torus, // Closed, genus g. A thick plate with g square holes through it, g grows with the size
+	Holes, // Terrain with round holes punched through it, a boundary loop per hole
+	NonManifold, // Terrain with fins on some edges, giving them three faces, and triangles touching it at a single vertex
+};
+
+// Bumped whenever a shape comes out differently for the same settings, it is part of the cache key of generated inputs
+const uint32_t SYNTHETIC_MESH_VERSION = 1;
+
+struct SyntheticMeshSettings
+{
+	SyntheticShape shape = SyntheticShape::Icosphere;
+	uint64_t triangles = 100000; // Rounded to the grid of the shape, the counts actually generated come from countSyntheticMesh
+	uint64_t seed = 1;
+};
+
+// "<shape>:<triangles>[:<seed>]", e.g. "terrain:2M:7". Counts take k, M and G suffixes, the seed defaults to 1.
+bool parseSyntheticMesh(const std::string& spec, SyntheticMeshSettings& settings);
+// Canonical spec of the settings, which parses back to them
+std::string syntheticMeshSpec(const SyntheticMeshSettings& settings);
+// The spec with file name safe separators, e.g. "terrain_2000000_7"
+std::string syntheticMeshName(const SyntheticMeshSettings& settings);
+
+// Receives a generated mesh in chunks, all vertices first and then all triangles, so a mesh that only goes to a file
+// never has to fit in memory. Returning false from any call stops the generator.
+class SyntheticMeshSink
+{
+public:
+	virtual ~SyntheticMeshSink() = default;
+	// Exact counts of what follows
+	virtual bool begin(uint64_t vertexCount, uint64_t triangleCount) = 0;
+	virtual bool addVertices(const glm::vec3* positions, size_t count) = 0;
+	// Three indices per triangle, counter-clockwise seen from outside
+	virtual bool addTriangles(const uint32_t* indices, size_t count) = 0;
+	virtual bool end() = 0;
+};
+
+// Counts of the mesh the settings generate, without generating it
+void countSyntheticMesh(const SyntheticMeshSettings& settings, uint64_t& vertices, uint64_t& triangles);
+// False if the sink failed, or if the mesh has too many indices for 32 bits
+bool generateSyntheticMesh(const SyntheticMeshSettings& settings, SyntheticMeshSink& sink);
+
+// Collects the mesh in memory, positions and indices only
+class MeshDataSink : public SyntheticMeshSink
+{
+public:
+	explicit MeshDataSink(MeshData& data) : data(data) {}
+	bool begin(uint64_t vertexCount, uint64_t triangleCount) override;
+	bool addVertices(const glm::vec3* positions, size_t count) override;
+	bool addTriangles(const uint32_t* indices, size_t count) override;
+	bool end() override { return true; }
+
+private:
+	MeshData& data;
+};
+
+// Builds the mesh straight into a simplifier, without arrays of the whole mesh in between
+class SimplifierSink : public SyntheticMeshSink
+{
+public:
+	explicit SimplifierSink(MyOpenMesh& simplifier) : simplifier(simplifier) {}
+	bool begin(uint64_t vertexCount, uint64_t triangleCount) override;
+	bool addVertices(const glm::vec3* positions, size_t count) override;
+	bool addTriangles(const uint32_t* indices, size_t count) override;
+	bool end() override;
+
+private:
+	MyOpenMesh& simplifier;
+};
+
+// Streams the mesh into a binary mesh file as it is generated, with zero normals and texture coordinates and no meshlets
+class BinaryMeshSink : public SyntheticMeshSink
+{
+public:
+	explicit BinaryMeshSink(const std::string& path) : path(path) {}
+	bool begin(uint64_t vertexCount, uint64_t triangleCount) override;
+	bool addVertices(const glm::vec3* positions, size_t count) override;
+	bool addTriangles(const uint32_t* indices, size_t count) override;
+	bool end() override;
+
+private:
+	std::string path;
+	std::ofstream file;
+	uint64_t vertexCount = 0;
+	uint64_t verticesWritten = 0;
+	uint64_t indexCount = 0;
+	uint64_t indicesWritten = 0;
+
+	// The normal and texture coordinate arrays sit between the positions and the indices
+	bool writeAttributes();
+};
+
+// Streams the mesh into an obj file, for tools that don't read the binary format
+class ObjSink : public SyntheticMeshSink
+{
+public:
+	explicit ObjSink(const std::string& path) : path(path) {}
+	bool begin(uint64_t vertexCount, uint64_t triangleCount) override;
+	bool addVertices(const glm::vec3* positions, size_t count) override;
+	bool addTriangles(const uint32_t* indices, size_t count) override;
+	bool end() override;
+
+private:
+	std::string path;
+	std::ofstream file;
+};
+
+#endif
@@ -0,0 +1,113 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <string>
+
+#include "Trace.h"
+
+static thread_local int workerIndex = -1;
+
+ThreadPool::ThreadPool(size_t threadCount)
+{
+    if (threadCount == 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    for (size_t i = 0; i < threadCount; i++)
+        queues.push_back(std::make_unique<Queue>());
+
+    workers.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; i++)
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    jobAvailable.notify_all();
+    // Workers finish the queues before they see the stop flag
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+void ThreadPool::submit(std::function<void()> job)
+{
+    Queue& queue = *queues[nextQueue++ % queues.size()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back(std::move(job));
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queued++;
+        unfinished++;
+    }
+    jobAvailable.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    allDone.wait(lock, [this] { return unfinished == 0; });
+}
+
+int ThreadPool::currentWorker()
+{
+    return workerIndex;
+}
+
+bool ThreadPool::takeJob(size_t worker, std::function<void()>& job)
+{
+    // Own queue first, then the others starting with the next one, so thieves spread over the victims
+    for (size_t i = 0; i < queues.size(); i++)
+    {
+        Queue& queue = *queues[(worker + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.jobs.empty())
+            continue;
+
+        job = std::move(queue.jobs.front());
+        queue.jobs.pop_front();
+        if (i > 0)
+            stolen++;
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(size_t worker)
+{
+    workerIndex = static_cast<int>(worker);
+    Trace::setThreadName("worker " + std::to_string(worker));
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobAvailable.wait(lock, [this] { return stopping || queued > 0; });
+            if (queued == 0)
+                return;
+            // Claimed before it is taken, so other workers don't wake up for it
+            queued--;
+        }
+
+        // A claimed job is in some queue until taken, another worker may have taken it from this worker's queue first
+        std::function<void()> job;
+        while (!takeJob(worker, job))
+            std::this_thread::yield();
+
+        {
+            TRACE_ZONE("job");
+            job();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            unfinished--;
+            if (unfinished == 0)
+                allDone.notify_all();
+        }
+    }
+}
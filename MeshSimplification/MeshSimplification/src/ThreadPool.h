@@ -0,0 +1,63 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Worker threads with a job queue each. Jobs are dealt to the queues in turn, and a worker whose queue runs dry
+// steals from the others, so uneven jobs still keep every thread busy.
+// Jobs run in submission order per queue and are stolen from the same end, so submitting the largest jobs first
+// schedules them first everywhere, which is what balances jobs of very different sizes.
+// Jobs must not throw, and must not wait on other jobs of the same pool.
+class ThreadPool
+{
+public:
+	// Zero uses one thread per hardware thread
+	explicit ThreadPool(size_t threadCount = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	void submit(std::function<void()> job);
+	// Blocks until every job submitted so far has finished
+	void wait();
+
+	size_t size() const { return workers.size(); }
+	// Jobs a worker took from another worker's queue, for checking the balance
+	size_t stolenJobs() const { return stolen; }
+	// Index of the worker running the calling job, -1 outside the pool
+	static int currentWorker();
+
+private:
+	struct Queue
+	{
+		std::deque<std::function<void()>> jobs;
+		std::mutex mutex;
+	};
+
+	std::vector<std::thread> workers;
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::atomic<size_t> nextQueue{ 0 };
+	std::atomic<size_t> stolen{ 0 };
+
+	// Guards the counts the workers sleep and wake on
+	std::mutex mutex;
+	std::condition_variable jobAvailable;
+	std::condition_variable allDone;
+	size_t queued = 0; // Jobs in any queue
+	size_t unfinished = 0; // Jobs submitted that haven't finished
+	bool stopping = false;
+
+	bool takeJob(size_t worker, std::function<void()>& job);
+	void workerLoop(size_t worker);
+};
+
+#endif
@@ -0,0 +1,150 @@
+#include "Trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+    struct Event
+    {
+        const char* name;
+        int64_t start;
+        int64_t end;
+    };
+
+    // Written only by its thread. Readers take the events below the written count, which is published after each event.
+    struct Buffer
+    {
+        std::vector<Event> events;
+        std::atomic<uint64_t> written{ 0 };
+        std::atomic<uint64_t> cleared{ 0 }; // Events below this were cleared
+        uint32_t thread = 0;
+        std::string name; // Guarded by the registry's mutex
+    };
+
+    // Buffers stay here after their thread ends, so a dump still has the zones of finished workers
+    struct Registry
+    {
+        std::mutex mutex;
+        std::vector<std::shared_ptr<Buffer>> buffers;
+    };
+
+    Registry& registry()
+    {
+        static Registry instance;
+        return instance;
+    }
+
+    Buffer& localBuffer()
+    {
+        static thread_local std::shared_ptr<Buffer> buffer;
+        if (!buffer)
+        {
+            buffer = std::make_shared<Buffer>();
+            Registry& threads = registry();
+            std::lock_guard<std::mutex> lock(threads.mutex);
+            buffer->thread = static_cast<uint32_t>(threads.buffers.size());
+            threads.buffers.push_back(buffer);
+        }
+        return *buffer;
+    }
+
+    // Timestamps count from the first use, which keeps them short in the JSON
+    const int64_t epoch = Trace::now();
+
+    void writeEscaped(std::ostream& out, const std::string& text)
+    {
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+                out << '\\' << c;
+            else if (static_cast<unsigned char>(c) < 0x20)
+                out << ' ';
+            else
+                out << c;
+        }
+    }
+}
+
+namespace Trace
+{
+    std::atomic<bool> enabledFlag{ false };
+
+    void setEnabled(bool enabled)
+    {
+        enabledFlag.store(enabled, std::memory_order_relaxed);
+    }
+
+    void setThreadName(const std::string& name)
+    {
+        Buffer& buffer = localBuffer();
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        buffer.name = name;
+    }
+
+    int64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void record(const char* name, int64_t start, int64_t end)
+    {
+        Buffer& buffer = localBuffer();
+        // Threads that never record, e.g. idle pool workers, don't pay for a ring
+        if (buffer.events.empty())
+            buffer.events.resize(TRACE_BUFFER_EVENTS);
+        uint64_t index = buffer.written.load(std::memory_order_relaxed);
+        buffer.events[index % TRACE_BUFFER_EVENTS] = { name, start, end };
+        buffer.written.store(index + 1, std::memory_order_release);
+    }
+
+    bool writeChromeTrace(const std::string& path)
+    {
+        std::ofstream file(path);
+        if (!file)
+        {
+            fprintf(stderr, "Can't write the trace to %s\n", path.c_str());
+            return false;
+        }
+
+        Registry& threads = registry();
+        std::lock_guard<std::mutex> lock(threads.mutex);
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        bool first = true;
+        char number[64];
+        for (const std::shared_ptr<Buffer>& buffer : threads.buffers)
+        {
+            file << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->thread << ",\"args\":{\"name\":\"";
+            writeEscaped(file, buffer->name.empty() ? "thread " + std::to_string(buffer->thread) : buffer->name);
+            file << "\"}}";
+            first = false;
+
+            uint64_t written = buffer->written.load(std::memory_order_acquire);
+            uint64_t begin = std::max(buffer->cleared.load(std::memory_order_relaxed), written > TRACE_BUFFER_EVENTS ? written - TRACE_BUFFER_EVENTS : 0);
+            for (uint64_t i = begin; i < written; i++)
+            {
+                const Event& event = buffer->events[i % TRACE_BUFFER_EVENTS];
+                // Complete events, in microseconds
+                snprintf(number, sizeof(number), "%.3f,\"dur\":%.3f", (event.start - epoch) / 1e3, (event.end - event.start) / 1e3);
+                file << ",\n{\"name\":\"";
+                writeEscaped(file, event.name);
+                file << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->thread << ",\"ts\":" << number << "}";
+            }
+        }
+        file << "\n]}\n";
+        return static_cast<bool>(file);
+    }
+
+    void clear()
+    {
+        Registry& threads = registry();
+        std::lock_guard<std::mutex> lock(threads.mutex);
+        for (const std::shared_ptr<Buffer>& buffer : threads.buffers)
+            buffer->cleared.store(buffer->written.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Scoped CPU trace zones, written as Chrome trace JSON that chrome://tracing and ui.perfetto.dev open.
+// Every thread records into a ring buffer of its own, so recording takes no lock and a zone costs two clock reads
+// and a store. While tracing is off a zone is a single relaxed load, and defining MESHSIMP_NO_TRACE removes them.
+// The ring keeps the last TRACE_BUFFER_EVENTS zones of each thread, older ones are overwritten.
+namespace Trace
+{
+	const size_t TRACE_BUFFER_EVENTS = 1 << 16;
+
+	extern std::atomic<bool> enabledFlag;
+
+	inline bool enabled() { return enabledFlag.load(std::memory_order_relaxed); }
+	void setEnabled(bool enabled);
+	// Shown for the calling thread's row of the trace, threads are numbered in order of their first zone otherwise
+	void setThreadName(const std::string& name);
+
+	// Nanoseconds on the steady clock
+	int64_t now();
+	// Names must be string literals or otherwise outlive the trace
+	void record(const char* name, int64_t start, int64_t end);
+
+	// Writes the zones recorded so far. Call it with tracing off and no other thread inside a zone, turning tracing off
+	// doesn't stop zones that are already open from recording when they close.
+	bool writeChromeTrace(const std::string& path);
+	// Forgets the recorded zones
+	void clear();
+
+	class Zone
+	{
+	public:
+		explicit Zone(const char* name) : name(enabled() ? name : nullptr), start(this->name ? now() : 0) {}
+		~Zone()
+		{
+			if (name)
+				record(name, start, now());
+		}
+
+		Zone(const Zone&) = delete;
+		Zone& operator=(const Zone&) = delete;
+
+	private:
+		const char* name;
+		int64_t start;
+	};
+}
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#ifdef MESHSIMP_NO_TRACE
+#define TRACE_ZONE(name)
+#else
+// Traces the rest of the enclosing scope
+#define TRACE_ZONE(name) Trace::Zone TRACE_CONCAT(traceZone, __LINE__)(name)
+#endif
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef UNIFORMBLOCKS_H
+#define UNIFORMBLOCKS_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+// CPU side of the std140 uniform blocks declared in the shaders.
+// vec3 members are padded to 16 bytes, so each one is followed by a float (used or padding).
+
+const GLuint CAMERA_BLOCK_BINDING = 0;
+const GLuint LIGHTS_BLOCK_BINDING = 1;
+
+const int NR_POINT_LIGHTS = 2;
+
+// layout (std140) uniform Camera
+struct CameraBlock
+{
+	glm::mat4 projection;
+	glm::mat4 view;
+	glm::vec3 viewPos;
+	float padding;
+};
+
+struct DirLightBlock
+{
+	glm::vec3 direction;
+	float padding0;
+	glm::vec3 ambient;
+	float padding1;
+	glm::vec3 diffuse;
+	float padding2;
+	glm::vec3 specular;
+	float padding3;
+};
+
+struct PointLightBlock
+{
+	glm::vec3 position;
+	float constant;
+	glm::vec3 ambient;
+	float linear;
+	glm::vec3 diffuse;
+	float quadratic;
+	glm::vec3 specular;
+	float padding;
+};
+
+// layout (std140) uniform Lights
+struct LightsBlock
+{
+	DirLightBlock dirLight;
+	PointLightBlock pointLights[NR_POINT_LIGHTS];
+};
+
+static_assert(sizeof(CameraBlock) == 144, "CameraBlock doesn't match the std140 layout");
+static_assert(sizeof(LightsBlock) == 64 + 64 * NR_POINT_LIGHTS, "LightsBlock doesn't match the std140 layout");
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef UNIFORMBUFFER_H
+#define UNIFORMBUFFER_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+
+#include "GLResource.h"
+
+// Uniform buffer holding one std140 block of type T, attached to a fixed binding point.
+// T has to match the block layout in the shaders, see UniformBlocks.h.
+template<typename T>
+class UniformBuffer
+{
+public:
+	explicit UniformBuffer(GLuint binding) : binding(binding)
+	{
+		buffer = GLBuffer::create();
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(T), nullptr, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+	}
+
+	// Uploads the block only if it differs from the last upload, returns true if it did
+	bool update(const T& data)
+	{
+		if (uploaded && std::memcmp(&data, &current, sizeof(T)) == 0)
+			return false;
+
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &data);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+		current = data;
+		uploaded = true;
+		return true;
+	}
+
+	GLuint getBinding() const { return binding; }
+
+private:
+	GLBuffer buffer;
+	GLuint binding;
+	T current;
+	bool uploaded = false;
+};
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef VERTEX_H
+#define VERTEX_H
+
+#include <glm/glm.hpp>
+
+// Render vertex shared by the GL meshes and the headless simplification code, kept free of GL so both can use it
+struct Vertex
+{
+	glm::vec3 Position;
+	glm::vec3 Normal;
+	glm::vec2 TexCoords;
+	// Where the vertex ends up at the next coarser LOD level, blended towards when geomorphing.
+	// Equal to Position and Normal for vertices that don't move or meshes outside a LOD chain.
+	glm::vec3 MorphPosition;
+	glm::vec3 MorphNormal;
+
+	unsigned int index;
+	glm::mat4 quadric = glm::mat4(0.0f);
+};
+
+#endif
@@ -0,0 +1,453 @@
+#include "ViewDependentMesh.h"
+
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "OpenMesh/Tools/Decimater/DecimaterT.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <iostream>
+
+#include "MyOpenMesh.h"
+#include "QuadricErrorModule.h"
+
+// Splits forced to make a split legal are followed at most this deep, deeper chains are left for later frames
+const int VDPM_MAX_FORCED_DEPTH = 32;
+
+// Smallest cone around the two normal cones, angles in radians. Cones of half a turn or more never face away.
+static void mergeCones(const OpenMesh::Vec3f& axis1, float angle1, const OpenMesh::Vec3f& axis2, float angle2, OpenMesh::Vec3f& axis, float& angle)
+{
+    float between = std::acos(std::clamp(OpenMesh::dot(axis1, axis2), -1.0f, 1.0f));
+    if (between + angle2 <= angle1)
+    {
+        axis = axis1;
+        angle = angle1;
+        return;
+    }
+    if (between + angle1 <= angle2)
+    {
+        axis = axis2;
+        angle = angle2;
+        return;
+    }
+
+    angle = (between + angle1 + angle2) * 0.5f;
+    axis = axis1;
+    if (angle >= glm::half_pi<float>())
+    {
+        angle = glm::half_pi<float>();
+        return;
+    }
+
+    // Rotate the first axis towards the second until the new cone touches both
+    float t = (angle - angle1) / between;
+    axis = (axis1 * std::sin((1.0f - t) * between) + axis2 * std::sin(t * between)) / std::sin(between);
+}
+
+bool ViewDependentMesh::build(const std::string& path, size_t baseFaces)
+{
+    renderMesh.reset();
+    builtVertices.clear();
+    slotFaces.clear();
+    indices.clear();
+    knownFaces = 0;
+    vhierarchy.clear();
+    vfront.clear();
+    mesh.clear();
+    this->path = path;
+
+    printf("Building view-dependent mesh...\n");
+    const clock_t begin_time = clock();
+
+    bool read;
+    {
+        std::lock_guard<std::mutex> lock(MyOpenMesh::ioMutex());
+        read = OpenMesh::IO::read_mesh(mesh, path);
+    }
+    if (!read)
+    {
+        std::cerr << "Error loading mesh: " << path << std::endl;
+        return false;
+    }
+    mesh.update_normals();
+
+    // The normal cone of a vertex covers the faces around it, before any of them are collapsed
+    std::vector<float> leafAngles(mesh.n_vertices(), glm::half_pi<float>());
+    for (OpenMesh::VertexHandle vh : mesh.vertices())
+    {
+        const OpenMesh::Vec3f& normal = mesh.normal(vh);
+        if (normal.sqrnorm() < 0.5f)
+            continue;
+
+        float cosine = 1.0f;
+        for (OpenMesh::FaceHandle fh : mesh.vf_range(vh))
+            cosine = std::min(cosine, OpenMesh::dot(normal, mesh.normal(fh)));
+        leafAngles[vh.idx()] = std::acos(std::clamp(cosine, -1.0f, 1.0f));
+    }
+
+    // The collapses of a normal quadric decimation, each one is the inverse of a vertex split in the hierarchy
+    typedef ModQuadricErrorT<VDPMMesh> QuadricError;
+    std::vector<QuadricError::Collapse> collapses;
+    {
+        OpenMesh::Decimater::DecimaterT<VDPMMesh> decimater(mesh);
+        QuadricError::Handle quadric;
+        decimater.add(quadric);
+        decimater.module(quadric).setRecordCollapses(true);
+        decimater.initialize();
+        decimater.decimate_to_faces(0, baseFaces);
+        collapses = decimater.module(quadric).collapses();
+    }
+
+    // The vertices of the base mesh are the roots, they have to be the first nodes
+    std::vector<NodeHandle> roots;
+    std::vector<NodeHandle> vertexNode(mesh.n_vertices());
+    for (OpenMesh::VertexHandle vh : mesh.vertices())
+    {
+        NodeHandle node = vhierarchy.add_node();
+        vhierarchy.node(node).set_vertex_handle(vh);
+        mesh.data(vh).set_vhierarchy_node_handle(node);
+        vertexNode[vh.idx()] = node;
+        roots.push_back(node);
+    }
+    vhierarchy.set_num_roots(static_cast<unsigned int>(roots.size()));
+
+    size_t nodes = roots.size() + 2 * collapses.size();
+    cutLeft.assign(nodes, NodeHandle());
+    cutRight.assign(nodes, NodeHandle());
+    nodeDepth.assign(nodes, 0);
+    std::vector<float> splitErrors(nodes, 0.0f);
+
+    // Replaying the collapses backwards splits the node of v1 into v0 (left child) and v1 (right child).
+    // The nodes of vl and vr at that point are the fundamental cut the split depends on.
+    for (auto collapse = collapses.rbegin(); collapse != collapses.rend(); ++collapse)
+    {
+        NodeHandle parent = vertexNode[collapse->v1];
+        NodeHandle left = vhierarchy.add_node();
+        NodeHandle right = vhierarchy.add_node(); // Right child is always the node after the left one
+
+        vhierarchy.node(parent).set_children_handle(left);
+        vhierarchy.node(left).set_parent_handle(parent);
+        vhierarchy.node(left).set_vertex_handle(OpenMesh::VertexHandle(collapse->v0));
+        vhierarchy.node(right).set_parent_handle(parent);
+        vhierarchy.node(right).set_vertex_handle(OpenMesh::VertexHandle(collapse->v1));
+
+        if (collapse->vl >= 0)
+            cutLeft[parent.idx()] = vertexNode[collapse->vl];
+        if (collapse->vr >= 0)
+            cutRight[parent.idx()] = vertexNode[collapse->vr];
+        nodeDepth[left.idx()] = nodeDepth[right.idx()] = nodeDepth[parent.idx()] + 1;
+        splitErrors[parent.idx()] = collapse->error;
+
+        vertexNode[collapse->v0] = left;
+        vertexNode[collapse->v1] = right;
+    }
+
+    buildNodeBounds(leafAngles, splitErrors);
+    vfront.init(roots, static_cast<unsigned int>(collapses.size()));
+
+    // Every vertex goes to the GPU once, refinement only changes the indices. Normals are the ones of the full mesh.
+    std::vector<Vertex> vertices(mesh.n_vertices());
+    for (unsigned int i = 0; i < mesh.n_vertices(); i++)
+    {
+        OpenMesh::VertexHandle vh = mesh.vertex_handle(i);
+        const OpenMesh::Vec3f& p = mesh.point(vh);
+        const OpenMesh::Vec3f& n = mesh.normal(vh);
+
+        vertices[i].Position = glm::vec3(p[0], p[1], p[2]);
+        vertices[i].Normal = glm::vec3(n[0], n[1], n[2]);
+        vertices[i].TexCoords = glm::vec2(0.0f, 0.0f);
+        vertices[i].MorphPosition = vertices[i].Position;
+        vertices[i].MorphNormal = vertices[i].Normal;
+        vertices[i].index = i;
+    }
+    builtVertices = std::move(vertices);
+
+    printf("View-dependent mesh: %zu roots, %zu nodes, built in %.0f ms\n", roots.size(), vhierarchy.num_nodes(),
+        (1000 * float(clock() - begin_time)) / CLOCKS_PER_SEC);
+    return true;
+}
+
+void ViewDependentMesh::upload()
+{
+    if (builtVertices.empty())
+        return;
+
+    renderMesh = std::make_unique<Mesh>(std::move(builtVertices), std::vector<unsigned int>(), std::vector<Texture>());
+    builtVertices.clear();
+    updateRenderIndices();
+}
+
+void ViewDependentMesh::buildNodeBounds(const std::vector<float>& leafAngles, const std::vector<float>& splitErrors)
+{
+    // Children are always added after their parent, so going backwards visits them first
+    std::vector<float> angles(vhierarchy.num_nodes());
+    std::vector<float> errors(vhierarchy.num_nodes());
+    for (int i = static_cast<int>(vhierarchy.num_nodes()) - 1; i >= 0; i--)
+    {
+        OpenMesh::VDPM::VHierarchyNode& node = vhierarchy.node(NodeHandle(i));
+        OpenMesh::VertexHandle vh = node.vertex_handle();
+
+        if (node.is_leaf())
+        {
+            node.set_radius(0.0f);
+            node.set_normal(mesh.normal(vh));
+            angles[i] = leafAngles[vh.idx()];
+            errors[i] = 0.0f;
+        }
+        else
+        {
+            int left = node.lchild_handle().idx();
+            int right = node.rchild_handle().idx();
+            const OpenMesh::VDPM::VHierarchyNode& leftNode = vhierarchy.node(NodeHandle(left));
+            const OpenMesh::VDPM::VHierarchyNode& rightNode = vhierarchy.node(NodeHandle(right));
+
+            // Sphere around the node's vertex that holds the spheres of both children
+            const OpenMesh::Vec3f& p = mesh.point(vh);
+            float radius = std::max((p - mesh.point(leftNode.vertex_handle())).norm() + leftNode.radius(),
+                (p - mesh.point(rightNode.vertex_handle())).norm() + rightNode.radius());
+            node.set_radius(radius);
+
+            OpenMesh::Vec3f axis;
+            mergeCones(leftNode.normal(), angles[left], rightNode.normal(), angles[right], axis, angles[i]);
+            node.set_normal(axis);
+
+            // The error of a node bounds the error of everything below it, so refinement never makes it worse
+            errors[i] = std::max(splitErrors[i], std::max(errors[left], errors[right]));
+        }
+
+        node.set_semi_angle(angles[i]);
+        node.set_mue(errors[i]);
+        node.set_sigma(errors[i]);
+    }
+}
+
+void ViewDependentMesh::refine(const glm::mat4& modelView, const glm::mat4& projection, float fovY, float viewportHeight)
+{
+    refinements = 0;
+    coarsenings = 0;
+    if (!isBuilt())
+        return;
+
+    // The eye position and directions in model space come from the model view matrix
+    double matrix[16];
+    const float* values = glm::value_ptr(modelView);
+    for (int i = 0; i < 16; i++)
+        matrix[i] = values[i];
+    viewing.set_modelview_matrix(matrix);
+    viewing.set_fovy(fovY);
+    viewing.update_viewing_configurations();
+
+    // A node is split once its error projects to more than the tolerance in pixels:
+    // error / distance > pixelTolerance * 2 * tan(fovY / 2) / viewportHeight
+    float tolerance = pixelTolerance * 2.0f * std::tan(fovY * 0.5f) / viewportHeight;
+    viewing.set_tolerance_square(tolerance * tolerance);
+    frustum = Frustum(projection * modelView);
+
+    // Continue where the last frame ran out of time
+    auto start = std::chrono::steady_clock::now();
+    if (vfront.end())
+        vfront.begin();
+
+    size_t visited = 0;
+    while (!vfront.end())
+    {
+        NodeHandle node = vfront.node_handle();
+        NodeHandle parent = vhierarchy.parent_handle(node);
+
+        if (qrefine(node))
+        {
+            if (forceVsplit(node))
+                refinements++;
+        }
+        else if (parent.is_valid() && !qrefine(parent) && ecol(parent))
+            coarsenings++;
+
+        // Removing the current node from the front already moves on to the next one
+        if (vfront.is_active(node))
+            vfront.next();
+
+        if (++visited % 64 == 0 && std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() > timeBudget)
+            break;
+    }
+
+    updateRenderIndices();
+}
+
+void ViewDependentMesh::Draw(Shader& shader)
+{
+    if (!renderMesh)
+        return;
+
+    shader.setFloat("morphFactor", 0.0f);
+    renderMesh->Draw(shader);
+}
+
+bool ViewDependentMesh::qrefine(NodeHandle node)
+{
+    const OpenMesh::VDPM::VHierarchyNode& n = vhierarchy.node(node);
+    if (n.is_leaf())
+        return false;
+
+    const OpenMesh::Vec3f& p = mesh.point(n.vertex_handle());
+    if (!frustum.intersectsSphere(glm::vec3(p[0], p[1], p[2]), n.radius()))
+        return false;
+
+    OpenMesh::Vec3f toNode = p - viewing.eye_pos();
+    float distanceSquare = toNode.sqrnorm();
+    float distance = std::sqrt(distanceSquare);
+
+    // Every normal in the cone points away from the eye, the whole region is back facing
+    float product = OpenMesh::dot(n.normal(), toNode);
+    if (distance > n.radius() && product > 0.0f && product * product > distanceSquare * n.sin_square())
+        return false;
+
+    // Screen space error, measured from the nearest point of the bounding sphere
+    float nearest = std::max(distance - n.radius(), 1e-6f);
+    return n.mue_square() > viewing.tolerance_square() * nearest * nearest;
+}
+
+bool ViewDependentMesh::forceVsplit(NodeHandle node, int depth)
+{
+    if (depth > VDPM_MAX_FORCED_DEPTH || vhierarchy.is_leaf_node(node) || !vfront.is_active(node))
+        return false;
+
+    OpenMesh::VertexHandle vl, vr;
+    while (activeCuts(node, vl, vr))
+    {
+        if (vl != vr || !vl.is_valid())
+        {
+            vsplit(node, vl, vr);
+            return true;
+        }
+
+        // Both neighbours of the split are still merged into one vertex, which has to be split first
+        if (!forceVsplit(mesh.data(vl).vhierarchy_node_handle(), depth + 1))
+            return false;
+    }
+    return false;
+}
+
+bool ViewDependentMesh::activeCuts(NodeHandle node, OpenMesh::VertexHandle& vl, OpenMesh::VertexHandle& vr)
+{
+    // The neighbours the split needs are the active vertices of the fundamental cut: the cut nodes themselves,
+    // an ancestor that hasn't been split yet, or a descendant next to the vertex if they have been refined further
+    NodeHandle left = cutLeft[node.idx()];
+    NodeHandle right = cutRight[node.idx()];
+    vl = OpenMesh::VertexHandle();
+    vr = OpenMesh::VertexHandle();
+
+    for (OpenMesh::VertexHandle neighbour : mesh.vv_range(vhierarchy.vertex_handle(node)))
+    {
+        NodeHandle neighbourNode = mesh.data(neighbour).vhierarchy_node_handle();
+        if (left.is_valid() && !vl.is_valid() && related(neighbourNode, left))
+            vl = neighbour;
+        if (right.is_valid() && !vr.is_valid() && related(neighbourNode, right))
+            vr = neighbour;
+    }
+
+    return (!left.is_valid() || vl.is_valid()) && (!right.is_valid() || vr.is_valid());
+}
+
+bool ViewDependentMesh::related(NodeHandle a, NodeHandle b)
+{
+    // Walk the deeper node up to the depth of the other, one is an ancestor of the other if they meet
+    while (nodeDepth[a.idx()] > nodeDepth[b.idx()])
+        a = vhierarchy.parent_handle(a);
+    while (nodeDepth[b.idx()] > nodeDepth[a.idx()])
+        b = vhierarchy.parent_handle(b);
+    return a == b;
+}
+
+void ViewDependentMesh::vsplit(NodeHandle node, OpenMesh::VertexHandle vl, OpenMesh::VertexHandle vr)
+{
+    NodeHandle left = vhierarchy.lchild_handle(node);
+    NodeHandle right = vhierarchy.rchild_handle(node);
+    OpenMesh::VertexHandle v0 = vhierarchy.vertex_handle(left);
+    OpenMesh::VertexHandle v1 = vhierarchy.vertex_handle(right);
+
+    // v0 kept its point when it was collapsed, the split brings it back
+    mesh.status(v0).set_deleted(false);
+    mesh.vertex_split(v0, v1, vl, vr);
+    mesh.data(v0).set_vhierarchy_node_handle(left);
+    mesh.data(v1).set_vhierarchy_node_handle(right);
+
+    vfront.remove(node);
+    vfront.add(left);
+    vfront.add(right);
+}
+
+bool ViewDependentMesh::ecol(NodeHandle node)
+{
+    NodeHandle left = vhierarchy.lchild_handle(node);
+    NodeHandle right = vhierarchy.rchild_handle(node);
+    if (!vfront.is_active(left) || !vfront.is_active(right))
+        return false;
+
+    // Collapsing v0 into v1 leaves the parent's vertex
+    OpenMesh::VertexHandle v0 = vhierarchy.vertex_handle(left);
+    OpenMesh::VertexHandle v1 = vhierarchy.vertex_handle(right);
+    OpenMesh::HalfedgeHandle hh = mesh.find_halfedge(v0, v1);
+    if (!hh.is_valid() || !mesh.is_collapse_ok(hh))
+        return false;
+
+    mesh.collapse(hh);
+    mesh.data(v1).set_vhierarchy_node_handle(node);
+
+    vfront.remove(left);
+    vfront.remove(right);
+    vfront.add(node);
+    return true;
+}
+
+void ViewDependentMesh::updateRenderIndices()
+{
+    // Faces removed by collapses give their slot to the last face and faces added by splits are appended,
+    // so only the parts of the index list that the front changed get uploaded
+    size_t count = slotFaces.size();
+    size_t slot = 0;
+    while (slot < count)
+    {
+        if (mesh.status(mesh.face_handle(slotFaces[slot])).deleted())
+            slotFaces[slot] = slotFaces[--count];
+        else
+            slot++;
+    }
+    slotFaces.resize(count);
+
+    for (size_t i = knownFaces; i < mesh.n_faces(); i++)
+        if (!mesh.status(mesh.face_handle(static_cast<int>(i))).deleted())
+            slotFaces.push_back(static_cast<unsigned int>(i));
+    knownFaces = mesh.n_faces();
+
+    indices.resize(slotFaces.size() * 3);
+    for (size_t i = 0; i < slotFaces.size(); i++)
+    {
+        // Splits and collapses also move the corners of faces that survive, so always take them from the mesh
+        VDPMMesh::ConstFaceVertexIter fv = mesh.cfv_iter(mesh.face_handle(slotFaces[i]));
+        indices[i * 3] = fv->idx(); ++fv;
+        indices[i * 3 + 1] = fv->idx(); ++fv;
+        indices[i * 3 + 2] = fv->idx();
+    }
+    renderMesh->updateIndices(indices);
+
+    // Collapses and splits only mark faces and edges as deleted, clean up once they outnumber the live ones
+    if (mesh.n_faces() > 2 * slotFaces.size() + VDPM_BASE_FACES)
+        compact();
+}
+
+void ViewDependentMesh::compact()
+{
+    // The hierarchy refers to vertices by handle, so only edges and faces are collected.
+    // Collapsed vertices still point at edges that are about to go away, detach them first.
+    for (OpenMesh::VertexHandle vh : mesh.all_vertices())
+        if (mesh.status(vh).deleted())
+            mesh.set_isolated(vh);
+    mesh.garbage_collection(false, true, true);
+
+    // Face handles changed, the slots are rebuilt on the next update
+    slotFaces.clear();
+    knownFaces = 0;
+}
@@ -0,0 +1,93 @@
+#ifndef VIEWDEPENDENTMESH_H
+#define VIEWDEPENDENTMESH_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "OpenMesh/Core/IO/MeshIO.hh"
+#include "OpenMesh/Core/Mesh/TriMesh_ArrayKernelT.hh"
+#include "OpenMesh/Tools/VDPM/MeshTraits.hh"
+#include "OpenMesh/Tools/VDPM/VFront.hh"
+#include "OpenMesh/Tools/VDPM/VHierarchy.hh"
+#include "OpenMesh/Tools/VDPM/ViewingParameters.hh"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Frustum.h"
+#include "Mesh.h"
+#include "Shader.h"
+
+// Faces left in the base mesh the hierarchy is built down to
+const size_t VDPM_BASE_FACES = 1000;
+
+// View-dependent progressive mesh (Hoppe 1997) on top of OpenMesh's VDPM vertex hierarchy.
+// The whole collapse sequence of a quadric decimation is turned into a forest of vertex splits. Each frame the active front
+// of that forest is refined where the error of a node would be visible on screen, and coarsened behind the camera,
+// outside the frustum and far away, so the number of triangles stays bounded wherever the camera looks.
+class ViewDependentMesh
+{
+public:
+	typedef OpenMesh::TriMesh_ArrayKernelT<OpenMesh::VDPM::MeshTraits> VDPMMesh;
+	typedef OpenMesh::VDPM::VHierarchyNodeHandle NodeHandle;
+
+	float pixelTolerance = 1.0f; // Largest error on screen in pixels before a node is split
+	float timeBudget = 2.0f; // Milliseconds of refinement per frame, the rest continues next frame
+
+	// Statistics of the last refine call
+	size_t refinements = 0;
+	size_t coarsenings = 0;
+
+	ViewDependentMesh() {};
+
+	// Decimates the mesh down to baseFaces and builds the hierarchy from the collapses, this takes a while for big meshes.
+	// No GL calls, so it can run on a worker thread while the window keeps drawing.
+	bool build(const std::string& path, size_t baseFaces = VDPM_BASE_FACES);
+	// Creates the buffers of a built mesh, on the thread that owns the GL context
+	void upload();
+	bool isBuilt() const { return renderMesh != nullptr; }
+	const std::string& sourcePath() const { return path; }
+
+	// Adapt the front to the view. modelView and projection are the matrices the mesh is drawn with.
+	void refine(const glm::mat4& modelView, const glm::mat4& projection, float fovY, float viewportHeight);
+	void Draw(Shader& shader);
+
+	size_t faceCount() const { return slotFaces.size(); }
+	size_t activeVertices() { return static_cast<size_t>(vfront.size()); }
+	size_t nodeCount() const { return vhierarchy.num_nodes(); }
+
+private:
+	VDPMMesh mesh;
+	OpenMesh::VDPM::VHierarchy vhierarchy;
+	OpenMesh::VDPM::VFront vfront;
+	OpenMesh::VDPM::ViewingParameters viewing;
+	Frustum frustum; // In model space, from projection * modelView
+	std::string path;
+
+	// Per node: the nodes that were the left and right neighbours (vl, vr) when the node's vertex was split,
+	// known as the fundamental cut, and the depth of the node in its tree.
+	std::vector<NodeHandle> cutLeft, cutRight;
+	std::vector<int> nodeDepth;
+
+	std::unique_ptr<Mesh> renderMesh; // Holds every vertex of the full mesh, only the indices change
+	std::vector<Vertex> builtVertices; // Left by build for upload
+	std::vector<unsigned int> slotFaces; // Face handle index stored at each slot of the index list, as in MyOpenMesh
+	std::vector<unsigned int> indices;
+	size_t knownFaces = 0; // Faces below this index have been given a slot or were deleted
+
+	void buildNodeBounds(const std::vector<float>& leafAngles, const std::vector<float>& splitErrors);
+
+	bool qrefine(NodeHandle node);
+	bool forceVsplit(NodeHandle node, int depth = 0);
+	bool activeCuts(NodeHandle node, OpenMesh::VertexHandle& vl, OpenMesh::VertexHandle& vr);
+	bool related(NodeHandle a, NodeHandle b);
+	void vsplit(NodeHandle node, OpenMesh::VertexHandle vl, OpenMesh::VertexHandle vr);
+	bool ecol(NodeHandle node);
+
+	void updateRenderIndices();
+	void compact();
+};
+
+#endif
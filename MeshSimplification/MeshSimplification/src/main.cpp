@@ -6,19 +6,32 @@
 #include <GLFW/glfw3.h>
 
 #include <glm/glm.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #define STB_IMAGE_IMPLEMENTATION
 #include <file_browser/ImGuiFileDialog.h>
 
+#include <chrono>
+#include <future>
 #include <iostream>
 #include <map>
+#include <memory>
 
+#include "BenchmarkScene.h"
 #include "Camera.h"
+#include "ClusterLod.h"
+#include "Frustum.h"
+#include "GLResource.h"
 #include "Shader.h"
+#include "Trace.h"
+#include "UniformBlocks.h"
+#include "UniformBuffer.h"
+#include "MeshBatch.h"
 #include "Model.h"
 #include "MyOpenMesh.h"
 #include "MyImGui.h"
+#include "ViewDependentMesh.h"
 
 // Window resize
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
@@ -104,6 +117,12 @@ int main(void)
 
     Shader shaderProgram("res/shaders/default.vert", "res/shaders/default.frag");
     Shader lightProgram("res/shaders/light.vert", "res/shaders/light.frag");
+    // Multi-draw-indirect path, needs GL 4.3 for shader storage buffers and indirect draws
+    Shader batchProgram("res/shaders/batched.vert", "res/shaders/default.frag", "#define BATCHED\n");
+    // Instanced grid of the benchmark scene
+    Shader instancedProgram("res/shaders/instanced.vert", "res/shaders/default.frag");
+    // Same, but inverting the model matrix per vertex to measure what moving it to the CPU saves
+    Shader perVertexNormalProgram("res/shaders/instanced.vert", "res/shaders/default.frag", "#define PER_VERTEX_NORMAL_MATRIX\n");
 
     float lightVertices[] = {
         // positions        
@@ -156,9 +175,48 @@ int main(void)
         glm::vec3(0.0f,  0.0f, -3.0f)
     };
 
-    unsigned int lightCubeVAO, lightVBO;
-    glGenVertexArrays(1, &lightCubeVAO);
-    glGenBuffers(1, &lightVBO);
+    // Uniform blocks shared by both programs
+    shaderProgram.bindUniformBlock("Camera", CAMERA_BLOCK_BINDING);
+    shaderProgram.bindUniformBlock("Lights", LIGHTS_BLOCK_BINDING);
+    lightProgram.bindUniformBlock("Camera", CAMERA_BLOCK_BINDING);
+    batchProgram.bindUniformBlock("Camera", CAMERA_BLOCK_BINDING);
+    batchProgram.bindUniformBlock("Lights", LIGHTS_BLOCK_BINDING);
+    instancedProgram.bindUniformBlock("Camera", CAMERA_BLOCK_BINDING);
+    instancedProgram.bindUniformBlock("Lights", LIGHTS_BLOCK_BINDING);
+    perVertexNormalProgram.bindUniformBlock("Camera", CAMERA_BLOCK_BINDING);
+    perVertexNormalProgram.bindUniformBlock("Lights", LIGHTS_BLOCK_BINDING);
+
+    UniformBuffer<CameraBlock> cameraUbo(CAMERA_BLOCK_BINDING);
+    UniformBuffer<LightsBlock> lightsUbo(LIGHTS_BLOCK_BINDING);
+
+    LightsBlock lights = {};
+    // directional light
+    lights.dirLight.direction = glm::vec3(-0.2f, -1.0f, -0.3f);
+    lights.dirLight.ambient = glm::vec3(0.05f, 0.05f, 0.05f);
+    lights.dirLight.diffuse = glm::vec3(0.4f, 0.4f, 0.4f);
+    lights.dirLight.specular = glm::vec3(0.5f, 0.5f, 0.5f);
+    // point lights
+    for (int i = 0; i < NR_POINT_LIGHTS; i++)
+    {
+        lights.pointLights[i].position = pointLightPositions[i];
+        lights.pointLights[i].ambient = glm::vec3(0.05f, 0.05f, 0.05f);
+        lights.pointLights[i].diffuse = glm::vec3(0.8f, 0.8f, 0.8f);
+        lights.pointLights[i].specular = glm::vec3(1.0f, 1.0f, 1.0f);
+        lights.pointLights[i].constant = 1.0f;
+        lights.pointLights[i].linear = 0.09f;
+        lights.pointLights[i].quadratic = 0.032f;
+    }
+
+    // Material, uniform values stay with the program so this only has to be set once
+    shaderProgram.Activate();
+    shaderProgram.setFloat("material.shininess", 32.0f);
+    instancedProgram.Activate();
+    instancedProgram.setFloat("material.shininess", 32.0f);
+    perVertexNormalProgram.Activate();
+    perVertexNormalProgram.setFloat("material.shininess", 32.0f);
+
+    GLVertexArray lightCubeVAO = GLVertexArray::create();
+    GLBuffer lightVBO = GLBuffer::create();
 
     glBindVertexArray(lightCubeVAO);
     glBindBuffer(GL_ARRAY_BUFFER, lightVBO);
@@ -176,12 +234,34 @@ int main(void)
     // Placeholder for simplified mesh
     Model newModel(originalModelPath);
 
+    // Every mesh and LOD of both models in shared buffers, drawn with one call
+    MeshBatch sceneBatch;
+    size_t newModelBatchStart = 0;
+
+    // Original mesh refined per view, built the first time the mode is turned on for a file. The build runs on a
+    // worker and the mesh drawn so far stays until the new one is swapped in.
+    std::unique_ptr<ViewDependentMesh> vdMesh;
+    std::future<std::unique_ptr<ViewDependentMesh>> vdBuild;
+    std::string vdBuildPath;
+
+    // Cluster DAG of the original model, its groups are simplified in parallel on the pool
+    ThreadPool buildPool;
+    std::unique_ptr<ClusterLod> clusterLod;
+    // Runs on a worker that hands the groups to the pool, the DAG drawn so far stays until the new one is swapped in
+    std::future<std::unique_ptr<ClusterLod>> clusterBuild;
+
+    // Grid of instances of the original model for measuring rendering throughput
+    BenchmarkScene benchmarkScene;
+    bool bVSyncOff = false; // V-Sync is turned off while benchmarking so frame times aren't capped
+
     // ImGui setup
     myImGui.setup(window);
+    Trace::setThreadName("main");
 
     /* Loop until the user closes the window */
     while (!glfwWindowShouldClose(window))
     {
+        TRACE_ZONE("frame");
         processInput(window);
         // Per-frame time logic
         float currentFrame = static_cast<float>(glfwGetTime());
@@ -194,51 +274,158 @@ int main(void)
 
         shaderProgram.Activate();
 
-        // directional light
-        shaderProgram.setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-        shaderProgram.setVec3("dirLight.ambient", 0.05f, 0.05f, 0.05f);
-        shaderProgram.setVec3("dirLight.diffuse", 0.4f, 0.4f, 0.4f);
-        shaderProgram.setVec3("dirLight.specular", 0.5f, 0.5f, 0.5f);
-        // point light 1
-        shaderProgram.setVec3("pointLights[0].position", pointLightPositions[0]);
-        shaderProgram.setVec3("pointLights[0].ambient", 0.05f, 0.05f, 0.05f);
-        shaderProgram.setVec3("pointLights[0].diffuse", 0.8f, 0.8f, 0.8f);
-        shaderProgram.setVec3("pointLights[0].specular", 1.0f, 1.0f, 1.0f);
-        shaderProgram.setFloat("pointLights[0].constant", 1.0f);
-        shaderProgram.setFloat("pointLights[0].linear", 0.09f);
-        shaderProgram.setFloat("pointLights[0].quadratic", 0.032f);
-        // point light 2
-        shaderProgram.setVec3("pointLights[1].position", pointLightPositions[1]);
-        shaderProgram.setVec3("pointLights[1].ambient", 0.05f, 0.05f, 0.05f);
-        shaderProgram.setVec3("pointLights[1].diffuse", 0.8f, 0.8f, 0.8f);
-        shaderProgram.setVec3("pointLights[1].specular", 1.0f, 1.0f, 1.0f);
-        shaderProgram.setFloat("pointLights[1].constant", 1.0f);
-        shaderProgram.setFloat("pointLights[1].linear", 0.09f);
-        shaderProgram.setFloat("pointLights[1].quadratic", 0.032f);
-
-        // Material
-        shaderProgram.setFloat("material.shininess", 32.0f);
+        // Blocks are only uploaded when their contents change
+        lightsUbo.update(lights);
 
         // pass projection matrix to shader (note that in this case it could change every frame)
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)windowWidth / (float)windowHeight, 0.1f, 100.0f);
-        shaderProgram.setMat4("projection", projection);
-
+        CameraBlock cameraBlock = {};
+        cameraBlock.projection = glm::perspective(glm::radians(camera.Zoom), (float)windowWidth / (float)windowHeight, 0.1f, 100.0f);
         // camera/view transformation
-        glm::mat4 view = camera.GetViewMatrix();
-        shaderProgram.setMat4("view", view);
+        cameraBlock.view = camera.GetViewMatrix();
+        cameraBlock.viewPos = camera.Position;
+        cameraUbo.update(cameraBlock);
 
         // Model output
         std::vector<glm::mat4> modelMats = originalModel.calcModelMatrix();
-        shaderProgram.setMat4("model", modelMats[0]);
-        originalModel.Draw(shaderProgram);
 
-        shaderProgram.setMat4("model", modelMats[1]);
-        newModel.Draw(shaderProgram);
+        // Pick the level of detail of the original model from its error on screen
+        if (myImGui.bAutoLod)
+            originalModel.selectLod(modelMats[0], camera.Position, glm::radians(camera.Zoom), (float)windowHeight, myImGui.lodPixelThreshold, myImGui.bGeomorph);
+        else
+        {
+            originalModel.currentLod = 0;
+            originalModel.morphFactor = 0.0f;
+        }
+
+        // Frustum planes in world space and in the space of each model, culling is off when they're null
+        glm::mat4 viewProjection = cameraBlock.projection * cameraBlock.view;
+        Frustum worldFrustum(viewProjection);
+        Frustum originalFrustum(viewProjection * modelMats[0]);
+        Frustum newFrustum(viewProjection * modelMats[1]);
+        bool cull = myImGui.bFrustumCulling;
+        // Camera in the space of each model, for the facing test of meshlet culling
+        glm::vec3 originalView = glm::vec3(glm::inverse(modelMats[0]) * glm::vec4(camera.Position, 1.0f));
+        glm::vec3 newView = glm::vec3(glm::inverse(modelMats[1]) * glm::vec4(camera.Position, 1.0f));
+        bool cullMeshlets = cull && myImGui.bMeshletCulling;
+
+        if (myImGui.bBenchmarkScene)
+        {
+            Shader& benchmarkProgram = benchmarkScene.perVertexNormalMatrix ? perVertexNormalProgram : instancedProgram;
+            benchmarkProgram.Activate();
+            benchmarkScene.Draw(benchmarkProgram, originalModel, modelMats[0], camera.Position, glm::radians(camera.Zoom), (float)windowHeight, cull ? &worldFrustum : nullptr);
+            benchmarkScene.recordFrame(deltaTime);
+        }
+        else if (myImGui.bBatchedDraws)
+        {
+            // The simplified model goes last, so simplifying replaces and uploads only its part of the batch
+            if (myImGui.bBatchDirty)
+            {
+                sceneBatch.clear();
+                sceneBatch.addMaterial(32.0f);
+                originalModel.addToBatch(sceneBatch);
+                newModelBatchStart = sceneBatch.meshCount();
+                newModel.addToBatch(sceneBatch);
+                sceneBatch.upload();
+                myImGui.bBatchDirty = false;
+                myImGui.bNewModelBatchDirty = false;
+            }
+            else if (myImGui.bNewModelBatchDirty)
+            {
+                sceneBatch.truncate(newModelBatchStart);
+                newModel.addToBatch(sceneBatch);
+                sceneBatch.upload();
+                myImGui.bNewModelBatchDirty = false;
+            }
+
+            batchProgram.Activate();
+            sceneBatch.beginFrame();
+            originalModel.queueBatchDraws(sceneBatch, modelMats[0], 0, cull ? &originalFrustum : nullptr);
+            newModel.queueBatchDraws(sceneBatch, modelMats[1], 0, cull ? &newFrustum : nullptr);
+            sceneBatch.draw();
+        }
+        else
+        {
+            shaderProgram.setMat4("model", modelMats[0]);
+            shaderProgram.setMat3("normalMatrix", glm::inverseTranspose(glm::mat3(modelMats[0])));
+            if (myImGui.bViewDependent)
+            {
+                if (!vdBuild.valid() && vdBuildPath != myImGui.filePathName)
+                {
+                    vdBuildPath = myImGui.filePathName;
+                    vdBuild = std::async(std::launch::async, [path = vdBuildPath]()
+                    {
+                        Trace::setThreadName("view-dependent build");
+                        auto built = std::make_unique<ViewDependentMesh>();
+                        if (!built->build(path))
+                            built.reset();
+                        return built;
+                    });
+                }
+                if (vdBuild.valid() && vdBuild.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+                {
+                    std::unique_ptr<ViewDependentMesh> built = vdBuild.get();
+                    if (!built)
+                    {
+                        // Turning the mode on again retries, rather than every frame starting a build that fails
+                        vdBuildPath.clear();
+                        myImGui.bViewDependent = false;
+                    }
+                    else
+                    {
+                        built->upload();
+                        if (vdMesh)
+                        {
+                            built->pixelTolerance = vdMesh->pixelTolerance;
+                            built->timeBudget = vdMesh->timeBudget;
+                        }
+                        vdMesh = std::move(built);
+                    }
+                }
+                if (vdMesh)
+                {
+                    vdMesh->refine(cameraBlock.view * modelMats[0], cameraBlock.projection, glm::radians(camera.Zoom), (float)windowHeight);
+                    vdMesh->Draw(shaderProgram);
+                }
+            }
+            else if (myImGui.bClusterLod)
+            {
+                if (myImGui.bClusterLodDirty && !clusterBuild.valid())
+                {
+                    // The meshes are copied here, the model may be replaced while the DAG is built
+                    std::vector<Vertex> vertices;
+                    std::vector<unsigned int> indices;
+                    ClusterLod::gatherMeshes(originalModel.meshes, vertices, indices);
+                    clusterBuild = std::async(std::launch::async, [&buildPool, vertices = std::move(vertices), indices = std::move(indices)]() mutable
+                    {
+                        Trace::setThreadName("cluster LOD build");
+                        auto built = std::make_unique<ClusterLod>();
+                        built->build(std::move(vertices), std::move(indices), buildPool);
+                        return built;
+                    });
+                    myImGui.bClusterLodDirty = false;
+                }
+                if (clusterBuild.valid() && clusterBuild.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+                {
+                    std::unique_ptr<ClusterLod> built = clusterBuild.get();
+                    built->upload();
+                    if (clusterLod)
+                        built->pixelThreshold = clusterLod->pixelThreshold;
+                    clusterLod = std::move(built);
+                }
+                // The facing test still applies without frustum culling
+                if (clusterLod)
+                    clusterLod->Draw(shaderProgram, cull ? originalFrustum : Frustum(), originalView, glm::radians(camera.Zoom), (float)windowHeight);
+            }
+            else
+                originalModel.Draw(shaderProgram, cull ? &originalFrustum : nullptr, cullMeshlets ? &originalView : nullptr);
+
+            shaderProgram.setMat4("model", modelMats[1]);
+            shaderProgram.setMat3("normalMatrix", glm::inverseTranspose(glm::mat3(modelMats[1])));
+            newModel.Draw(shaderProgram, cull ? &newFrustum : nullptr, cullMeshlets ? &newView : nullptr);
+        }
 
         // Output light itself using the light shaders
         lightProgram.Activate();
-        lightProgram.setMat4("projection", projection);
-        lightProgram.setMat4("view", view);
 
         glBindVertexArray(lightCubeVAO);
         for (unsigned int i = 0; i < 2; i++)
@@ -253,12 +440,21 @@ int main(void)
         // Load ImGui menus
         myImGui.newFrame();
         myImGui.showControlsWindow();
-        myImGui.showOptionsWindow();
-        myImGui.showMeshInfoWindow(originalModel, newModel);
+        myImGui.showOptionsWindow(vdBuild.valid() || clusterBuild.valid());
+        myImGui.showMeshInfoWindow(originalModel, newModel, sceneBatch);
         myImGui.showImportWindow(originalModel, newModel);
+        myImGui.showBenchmarkWindow(benchmarkScene);
+        myImGui.showViewDependentWindow(vdMesh.get(), vdBuild.valid());
+        myImGui.showClusterLodWindow(clusterLod.get(), clusterBuild.valid());
         myImGui.toggleWireframe();
         myImGui.render();
 
+        if (myImGui.bBenchmarkScene != bVSyncOff)
+        {
+            bVSyncOff = myImGui.bBenchmarkScene;
+            glfwSwapInterval(bVSyncOff ? 0 : 1);
+        }
+
         /* Swap front and back buffers */
         glfwSwapBuffers(window);
 
@@ -266,6 +462,14 @@ int main(void)
         glfwPollEvents();
     }
 
+    // Free the GPU resources of the models while the context still exists
+    originalModel = Model();
+    newModel = Model();
+    clusterLod.reset();
+    vdMesh.reset();
+    lightCubeVAO.release();
+    lightVBO.release();
+
     glfwTerminate();
     return 0;
 }
@@ -0,0 +1,13 @@
+# Finds an installed OpenMesh for the Linux builds of meshsimp, libmeshsimp and meshbench, the libraries under
+# Dependancies are only built for MSVC. Sets OPENMESH_FOUND, OPENMESH_INCLUDE_DIR, OPENMESH_CORE_LIBRARY and
+# OPENMESH_TOOLS_LIBRARY, and warns that the including project won't be built when it isn't found.
+
+find_path(OPENMESH_INCLUDE_DIR OpenMesh/Core/Mesh/TriMeshT.hh)
+find_library(OPENMESH_CORE_LIBRARY NAMES OpenMeshCore)
+find_library(OPENMESH_TOOLS_LIBRARY NAMES OpenMeshTools)
+if (OPENMESH_INCLUDE_DIR AND OPENMESH_CORE_LIBRARY AND OPENMESH_TOOLS_LIBRARY)
+    set(OPENMESH_FOUND TRUE)
+else()
+    set(OPENMESH_FOUND FALSE)
+    message(WARNING "OpenMesh not found, ${PROJECT_NAME} will not be built. Point CMAKE_PREFIX_PATH at an OpenMesh install.")
+endif()
@@ -0,0 +1,246 @@
+#include "meshsimp.h"
+
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include <OpenMesh/Core/System/omstream.hh>
+
+#include "MyOpenMesh.h"
+
+struct meshsimp_result
+{
+    std::vector<float> positions;
+    std::vector<uint32_t> sourceVertices;
+    std::vector<uint32_t> indices;
+    float error = 0.0f;
+    size_t droppedFaces = 0;
+};
+
+namespace
+{
+    // The struct of version 1, every field read here has been there since then
+    constexpr size_t OPTIONS_V1_SIZE = offsetof(meshsimp_options, target_ratio) + sizeof(float);
+
+    meshsimp_status checkArguments(const float* positions, size_t vertexCount, const uint32_t* indices, size_t indexCount, const meshsimp_options* options)
+    {
+        if ((!positions && vertexCount > 0) || (!indices && indexCount > 0) || indexCount % 3 != 0 || !options)
+            return MESHSIMP_ERROR_INVALID_ARGUMENT;
+        // Fields added after version 1 are to be read only when struct_size covers them
+        if (options->struct_size < OPTIONS_V1_SIZE)
+            return MESHSIMP_ERROR_INVALID_ARGUMENT;
+        if (options->engine != MESHSIMP_ENGINE_QUADRIC)
+            return MESHSIMP_ERROR_UNSUPPORTED_ENGINE;
+        if (options->target_faces == 0 && !(options->target_ratio > 0.0f && options->target_ratio <= 1.0f))
+            return MESHSIMP_ERROR_INVALID_ARGUMENT;
+        if (vertexCount > UINT32_MAX)
+            return MESHSIMP_ERROR_INVALID_ARGUMENT;
+        return MESHSIMP_OK;
+    }
+
+    meshsimp_status simplify(MyOpenMesh& simplifier, const float* positions, size_t vertexCount, const uint32_t* indices, size_t indexCount,
+        const meshsimp_options* options)
+    {
+        meshsimp_status status = checkArguments(positions, vertexCount, indices, indexCount, options);
+        if (status != MESHSIMP_OK)
+            return status;
+
+        // Failures only come back as a status, OpenMesh's own complaints about non-manifold faces are turned off too
+        static const bool silenced = (omerr().disable(), true);
+        (void)silenced;
+        simplifier.verbose = false;
+        simplifier.printErrors = false;
+        if (!simplifier.loadMesh(positions, vertexCount, indices, indexCount))
+            return MESHSIMP_ERROR_INVALID_MESH;
+
+        size_t target = options->target_faces > 0 ? options->target_faces : static_cast<size_t>(std::floor(simplifier.faceCount * options->target_ratio));
+        simplifier.simplifyToFaces(target);
+        return MESHSIMP_OK;
+    }
+
+    void countResult(const MyOpenMesh::oMesh& mesh, size_t& vertexCount, size_t& indexCount)
+    {
+        vertexCount = 0;
+        for (MyOpenMesh::oMesh::VertexHandle vh : mesh.vertices())
+        {
+            (void)vh;
+            vertexCount++;
+        }
+        indexCount = 0;
+        for (MyOpenMesh::oMesh::FaceHandle fh : mesh.faces())
+        {
+            (void)fh;
+            indexCount += 3;
+        }
+    }
+
+    // Straight from the half-edge mesh into the output arrays, the removed vertices are skipped and the rest renumbered
+    void writeResult(const MyOpenMesh::oMesh& mesh, float* positions, uint32_t* sourceVertices, uint32_t* indices)
+    {
+        std::vector<uint32_t> remap(mesh.n_vertices());
+        uint32_t next = 0;
+        for (MyOpenMesh::oMesh::VertexHandle vh : mesh.vertices())
+        {
+            const MyOpenMesh::oMesh::Point& p = mesh.point(vh);
+            positions[3 * next] = p[0];
+            positions[3 * next + 1] = p[1];
+            positions[3 * next + 2] = p[2];
+            if (sourceVertices)
+                sourceVertices[next] = static_cast<uint32_t>(vh.idx());
+            remap[vh.idx()] = next++;
+        }
+
+        for (MyOpenMesh::oMesh::FaceHandle fh : mesh.faces())
+            for (MyOpenMesh::oMesh::VertexHandle vh : mesh.fv_range(fh))
+                *indices++ = remap[vh.idx()];
+    }
+}
+
+uint32_t meshsimp_api_version(void)
+{
+    return MESHSIMP_API_VERSION;
+}
+
+const char* meshsimp_status_string(meshsimp_status status)
+{
+    switch (status)
+    {
+    case MESHSIMP_OK: return "ok";
+    case MESHSIMP_ERROR_INVALID_ARGUMENT: return "invalid argument";
+    case MESHSIMP_ERROR_INVALID_MESH: return "index out of range";
+    case MESHSIMP_ERROR_UNSUPPORTED_ENGINE: return "unsupported engine";
+    case MESHSIMP_ERROR_BUFFER_TOO_SMALL: return "output buffer too small";
+    case MESHSIMP_ERROR_OUT_OF_MEMORY: return "out of memory";
+    case MESHSIMP_ERROR_INTERNAL: return "internal error";
+    }
+    return "unknown status";
+}
+
+void meshsimp_default_options(meshsimp_options* options)
+{
+    if (!options)
+        return;
+    options->struct_size = sizeof(meshsimp_options);
+    options->engine = MESHSIMP_ENGINE_QUADRIC;
+    options->target_faces = 0;
+    options->target_ratio = 0.5f;
+}
+
+meshsimp_status meshsimp_simplify_into(
+    const float* positions, size_t vertex_count, const uint32_t* indices, size_t index_count,
+    const meshsimp_options* options,
+    float* out_positions, uint32_t* out_source_vertices, size_t out_vertex_capacity,
+    uint32_t* out_indices, size_t out_index_capacity,
+    size_t* out_vertex_count, size_t* out_index_count, float* out_error, size_t* out_dropped_faces)
+{
+    if (!out_vertex_count || !out_index_count || (!out_positions && out_vertex_capacity > 0) || (!out_indices && out_index_capacity > 0))
+        return MESHSIMP_ERROR_INVALID_ARGUMENT;
+
+    // Nothing may escape into a C caller
+    try
+    {
+        MyOpenMesh simplifier;
+        meshsimp_status status = simplify(simplifier, positions, vertex_count, indices, index_count, options);
+        if (status != MESHSIMP_OK)
+            return status;
+        countResult(simplifier.mesh, *out_vertex_count, *out_index_count);
+        if (*out_vertex_count > out_vertex_capacity || *out_index_count > out_index_capacity)
+            return MESHSIMP_ERROR_BUFFER_TOO_SMALL;
+
+        if (out_dropped_faces)
+            *out_dropped_faces = simplifier.droppedFaceCount();
+
+        writeResult(simplifier.mesh, out_positions, out_source_vertices, out_indices);
+        if (out_error)
+            *out_error = static_cast<float>(simplifier.geometricError());
+        return MESHSIMP_OK;
+    }
+    catch (const std::bad_alloc&)
+    {
+        return MESHSIMP_ERROR_OUT_OF_MEMORY;
+    }
+    catch (...)
+    {
+        return MESHSIMP_ERROR_INTERNAL;
+    }
+}
+
+meshsimp_status meshsimp_simplify(
+    const float* positions, size_t vertex_count, const uint32_t* indices, size_t index_count,
+    const meshsimp_options* options, meshsimp_result** result)
+{
+    if (!result)
+        return MESHSIMP_ERROR_INVALID_ARGUMENT;
+    *result = nullptr;
+
+    try
+    {
+        MyOpenMesh simplifier;
+        meshsimp_status status = simplify(simplifier, positions, vertex_count, indices, index_count, options);
+        if (status != MESHSIMP_OK)
+            return status;
+
+        auto simplified = std::make_unique<meshsimp_result>();
+        size_t vertexCount, indexCount;
+        countResult(simplifier.mesh, vertexCount, indexCount);
+        simplified->positions.resize(vertexCount * 3);
+        simplified->sourceVertices.resize(vertexCount);
+        simplified->indices.resize(indexCount);
+        writeResult(simplifier.mesh, simplified->positions.data(), simplified->sourceVertices.data(), simplified->indices.data());
+        simplified->error = static_cast<float>(simplifier.geometricError());
+        simplified->droppedFaces = simplifier.droppedFaceCount();
+
+        *result = simplified.release();
+        return MESHSIMP_OK;
+    }
+    catch (const std::bad_alloc&)
+    {
+        return MESHSIMP_ERROR_OUT_OF_MEMORY;
+    }
+    catch (...)
+    {
+        return MESHSIMP_ERROR_INTERNAL;
+    }
+}
+
+size_t meshsimp_result_vertex_count(const meshsimp_result* result)
+{
+    return result ? result->sourceVertices.size() : 0;
+}
+
+size_t meshsimp_result_index_count(const meshsimp_result* result)
+{
+    return result ? result->indices.size() : 0;
+}
+
+const float* meshsimp_result_positions(const meshsimp_result* result)
+{
+    return result ? result->positions.data() : nullptr;
+}
+
+const uint32_t* meshsimp_result_source_vertices(const meshsimp_result* result)
+{
+    return result ? result->sourceVertices.data() : nullptr;
+}
+
+const uint32_t* meshsimp_result_indices(const meshsimp_result* result)
+{
+    return result ? result->indices.data() : nullptr;
+}
+
+float meshsimp_result_error(const meshsimp_result* result)
+{
+    return result ? result->error : 0.0f;
+}
+
+size_t meshsimp_result_dropped_faces(const meshsimp_result* result)
+{
+    return result ? result->droppedFaces : 0;
+}
+
+void meshsimp_result_free(meshsimp_result* result)
+{
+    delete result;
+}
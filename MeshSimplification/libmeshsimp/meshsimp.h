@@ -0,0 +1,113 @@
+#ifndef MESHSIMP_H
+#define MESHSIMP_H
+
+/*
+ * C interface of the simplifier, for calling it in-process from pipelines and engines without exchanging files.
+ *
+ * Inputs are caller owned arrays that are only read during the call: xyz floats per vertex and three 32 bit
+ * indices per triangle. Results either go into caller provided buffers (meshsimp_simplify_into) or stay in an
+ * opaque result owned by the library until meshsimp_result_free (meshsimp_simplify).
+ *
+ * The simplifier only removes vertices, it never moves or creates them, so every output vertex is an input vertex.
+ * The source vertex arrays map each output vertex back to its input index, to carry over any attribute the
+ * library doesn't know about.
+ *
+ * The simplifier works on a manifold half-edge mesh. Triangles that can't be added to it, such as a third face on an
+ * edge or a face repeated with the same winding, are dropped before simplifying and don't appear in the output.
+ * The call still succeeds, the number dropped comes back in out_dropped_faces or meshsimp_result_dropped_faces.
+ *
+ * Calls on different inputs may run at the same time from any threads. No function throws, aborts or prints,
+ * errors only come back as a meshsimp_status. The first call turns off OpenMesh's error stream (omerr) for the
+ * process, which it would otherwise fill with a line per dropped triangle.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#if defined(MESHSIMP_BUILD)
+#define MESHSIMP_API __declspec(dllexport)
+#else
+#define MESHSIMP_API __declspec(dllimport)
+#endif
+#else
+#define MESHSIMP_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bumped whenever a function or struct changes incompatibly */
+#define MESHSIMP_API_VERSION 2
+
+typedef enum meshsimp_status
+{
+	MESHSIMP_OK = 0,
+	MESHSIMP_ERROR_INVALID_ARGUMENT = 1, /* Null pointer, index count not a multiple of three, bad option */
+	MESHSIMP_ERROR_INVALID_MESH = 2, /* An index is out of range */
+	MESHSIMP_ERROR_UNSUPPORTED_ENGINE = 3,
+	MESHSIMP_ERROR_BUFFER_TOO_SMALL = 4, /* The counts written back are the sizes needed */
+	MESHSIMP_ERROR_OUT_OF_MEMORY = 5,
+	MESHSIMP_ERROR_INTERNAL = 6,
+} meshsimp_status;
+
+typedef enum meshsimp_engine
+{
+	/* Quadric error edge collapse, the same engine as the app's OpenMesh path and meshsimp --engine quadric */
+	MESHSIMP_ENGINE_QUADRIC = 0,
+} meshsimp_engine;
+
+typedef struct meshsimp_options
+{
+	/* sizeof(meshsimp_options), set by meshsimp_default_options. Sizes from older headers stay accepted,
+	 * fields added later are only read when struct_size covers them. */
+	uint32_t struct_size;
+	meshsimp_engine engine;
+	uint32_t target_faces; /* Takes precedence over the ratio when not zero */
+	float target_ratio; /* Fraction of the faces to keep, in (0, 1] */
+} meshsimp_options;
+
+typedef struct meshsimp_result meshsimp_result;
+
+MESHSIMP_API uint32_t meshsimp_api_version(void);
+MESHSIMP_API const char* meshsimp_status_string(meshsimp_status status);
+MESHSIMP_API void meshsimp_default_options(meshsimp_options* options);
+
+/*
+ * Simplifies into caller buffers. out_positions holds out_vertex_capacity xyz triples, out_indices holds
+ * out_index_capacity indices and out_source_vertices, which may be null, out_vertex_capacity indices.
+ * The counts used are written to out_vertex_count and out_index_count, the geometric error to out_error and the
+ * number of non-manifold input triangles that were dropped to out_dropped_faces (both may be null).
+ * On MESHSIMP_ERROR_BUFFER_TOO_SMALL nothing is written but out_vertex_count and out_index_count, call again with
+ * larger buffers or use meshsimp_simplify. An output never has more vertices or indices than its input.
+ */
+MESHSIMP_API meshsimp_status meshsimp_simplify_into(
+	const float* positions, size_t vertex_count, const uint32_t* indices, size_t index_count,
+	const meshsimp_options* options,
+	float* out_positions, uint32_t* out_source_vertices, size_t out_vertex_capacity,
+	uint32_t* out_indices, size_t out_index_capacity,
+	size_t* out_vertex_count, size_t* out_index_count, float* out_error, size_t* out_dropped_faces);
+
+/* Simplifies into a result owned by the library, *result is null on failure */
+MESHSIMP_API meshsimp_status meshsimp_simplify(
+	const float* positions, size_t vertex_count, const uint32_t* indices, size_t index_count,
+	const meshsimp_options* options, meshsimp_result** result);
+
+/* The arrays stay valid until the result is freed */
+MESHSIMP_API size_t meshsimp_result_vertex_count(const meshsimp_result* result);
+MESHSIMP_API size_t meshsimp_result_index_count(const meshsimp_result* result);
+MESHSIMP_API const float* meshsimp_result_positions(const meshsimp_result* result);
+MESHSIMP_API const uint32_t* meshsimp_result_source_vertices(const meshsimp_result* result);
+MESHSIMP_API const uint32_t* meshsimp_result_indices(const meshsimp_result* result);
+/* Largest distance of the simplified surface from the input, in the units of the positions */
+MESHSIMP_API float meshsimp_result_error(const meshsimp_result* result);
+/* Input triangles left out because they would have made the mesh non-manifold */
+MESHSIMP_API size_t meshsimp_result_dropped_faces(const meshsimp_result* result);
+MESHSIMP_API void meshsimp_result_free(meshsimp_result* result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
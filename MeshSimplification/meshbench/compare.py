@@ -0,0 +1,66 @@
+#!/usr/bin/env python3
+"""Compares a meshbench run against a stored baseline and flags the stages that got slower.
+
+    meshbench --json current.json
+    python3 compare.py baseline.json current.json [--threshold 10] [--min-ms 1]
+
+Either file may be the JSON or the CSV meshbench writes. Stages are matched by mesh, engine, threads and stage,
+and compared on their medians. Exits with 1 if any stage regressed, so it can gate a build.
+"""
+
+import argparse
+import csv
+import json
+import sys
+
+
+def load(path):
+    if path.endswith(".csv"):
+        with open(path, newline="") as file:
+            rows = list(csv.DictReader(file))
+    else:
+        with open(path) as file:
+            rows = json.load(file)["results"]
+    return {(row["mesh"], row["engine"], int(row["threads"]), row["stage"]): float(row["median_ms"]) for row in rows}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--threshold", type=float, default=10.0, help="Percent slower that counts as a regression (default 10)")
+    parser.add_argument("--min-ms", type=float, default=1.0,
+                        help="Stages faster than this in both runs are only reported, timer noise dominates them (default 1)")
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    current = load(args.current)
+
+    regressions = 0
+    print(f"{'mesh':<22} {'engine':<8} {'threads':>7} {'stage':<11} {'baseline':>10} {'current':>10} {'change':>8}")
+    for key in sorted(baseline.keys() & current.keys()):
+        before, after = baseline[key], current[key]
+        change = (after - before) / before * 100.0 if before > 0 else 0.0
+        flag = ""
+        if change > args.threshold and max(before, after) >= args.min_ms:
+            flag = "  REGRESSION"
+            regressions += 1
+        elif change < -args.threshold and max(before, after) >= args.min_ms:
+            flag = "  faster"
+        mesh, engine, threads, stage = key
+        print(f"{mesh:<22} {engine:<8} {threads:>7} {stage:<11} {before:>10.2f} {after:>10.2f} {change:>+7.1f}%{flag}")
+
+    for key in sorted(baseline.keys() - current.keys()):
+        print("Missing from the current run: " + " ".join(str(part) for part in key))
+    for key in sorted(current.keys() - baseline.keys()):
+        print("Not in the baseline: " + " ".join(str(part) for part in key))
+
+    if regressions:
+        print(f"{regressions} stages more than {args.threshold:g}% slower than the baseline")
+        return 1
+    print("No regressions")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,507 @@
+// Benchmarks every stage of the headless pipeline over the standard corpus and synthetic meshes, for each engine
+// and thread count, and writes the timings as JSON or CSV. compare.py checks a run against a stored baseline.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+#include "BinaryMesh.h"
+#include "MyOpenMesh.h"
+#include "SimplifierWorkspace.h"
+#include "SyntheticMesh.h"
+#include "ThreadPool.h"
+
+namespace fs = std::filesystem;
+
+// Models the app has transforms for in Model::calcModelMatrix, looked up as <corpus>/<name>/<name>.<extension>
+const char* const CORPUS[] = { "bunny", "armadillo", "dragon", "happy", "lucy" };
+const char* const CORPUS_EXTENSIONS[] = { ".obj", ".ply", ".off", ".stl" };
+// Engines that run without a GL context, as in meshsimp
+const char* const ENGINES[] = { "quadric" };
+// Version of the result files, bumped when a stage is added, renamed or measured differently
+const int RESULT_VERSION = 2;
+// The pipeline stage gives every thread this many meshes, so the last one to finish doesn't dominate
+const size_t PIPELINE_JOBS_PER_THREAD = 2;
+
+struct Options
+{
+    std::string corpus = "res/models";
+    std::vector<std::string> synthetic = { "icosphere:100k", "torus:100k" };
+    std::vector<std::string> engines = { "quadric" };
+    std::vector<size_t> threads; // Powers of two up to the hardware threads when empty
+    float ratio = 0.5f;
+    size_t repetitions = 5;
+    std::string json;
+    std::string csv;
+};
+
+struct BenchMesh
+{
+    std::string name;
+    std::string path;
+    size_t faces = 0;
+};
+
+// Timings of one stage of one mesh, over all repetitions
+struct StageResult
+{
+    std::string mesh;
+    size_t faces = 0;
+    std::string engine;
+    size_t threads = 1;
+    std::string stage;
+    std::vector<double> times; // Milliseconds
+
+    double median() const
+    {
+        std::vector<double> sorted = times;
+        std::sort(sorted.begin(), sorted.end());
+        size_t n = sorted.size();
+        return n == 0 ? 0.0 : n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2.0;
+    }
+    double min() const { return times.empty() ? 0.0 : *std::min_element(times.begin(), times.end()); }
+    double max() const { return times.empty() ? 0.0 : *std::max_element(times.begin(), times.end()); }
+};
+
+static void printUsage()
+{
+    printf("Usage: meshbench [options]\n"
+        "      --corpus <dir>       Directory with <name>/<name>.obj for bunny, armadillo, dragon, happy and lucy,\n"
+        "                           missing models are skipped (default res/models)\n"
+        "      --synthetic <list>   Synthetic meshes, <shape>:<triangles>[:<seed>] comma separated, or none\n"
+        "                           (default icosphere:100k,torus:100k). Shapes as in meshsimp --generate\n"
+        "  -e, --engine <list>      Engines to run, comma separated: quadric (default)\n"
+        "  -j, --threads <list>     Thread counts of the pipeline stage, comma separated\n"
+        "                           (default powers of two up to one per hardware thread)\n"
+        "  -r, --ratio <0..1>       Fraction of the faces to keep (default 0.5)\n"
+        "  -n, --repetitions <n>    Runs of every stage, the median is reported (default 5)\n"
+        "      --json <file>        Write the results as JSON, the format compare.py reads\n"
+        "      --csv <file>         Write the results as CSV\n"
+        "  -h, --help               Show this message\n");
+}
+
+template<size_t N>
+static bool isOneOf(const std::string& value, const char* const (&list)[N])
+{
+    for (const char* entry : list)
+        if (value == entry)
+            return true;
+    return false;
+}
+
+static std::vector<std::string> splitList(const std::string& list)
+{
+    std::vector<std::string> values;
+    std::stringstream stream(list);
+    std::string value;
+    while (std::getline(stream, value, ','))
+        if (!value.empty())
+            values.push_back(value);
+    return values;
+}
+
+static std::vector<size_t> parseCounts(const std::string& list)
+{
+    std::vector<size_t> counts;
+    for (const std::string& value : splitList(list))
+    {
+        size_t count = std::strtoull(value.c_str(), nullptr, 10);
+        if (count > 0)
+            counts.push_back(count);
+    }
+    return counts;
+}
+
+static bool parseOptions(int argc, char** argv, Options& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        auto value = [&]() -> const char*
+        {
+            if (i + 1 >= argc)
+            {
+                fprintf(stderr, "Missing value for %s\n", arg.c_str());
+                return nullptr;
+            }
+            return argv[++i];
+        };
+
+        if (arg == "-h" || arg == "--help")
+        {
+            printUsage();
+            std::exit(0);
+        }
+        else if (arg == "--corpus")
+        {
+            const char* v = value();
+            if (!v)
+                return false;
+            options.corpus = v;
+        }
+        else if (arg == "--synthetic")
+        {
+            const char* v = value();
+            if (!v)
+                return false;
+            options.synthetic.clear();
+            for (const std::string& spec : splitList(v))
+            {
+                SyntheticMeshSettings settings;
+                if (spec == "none")
+                    continue;
+                if (!parseSyntheticMesh(spec, settings))
+                {
+                    fprintf(stderr, "Can't read the synthetic mesh %s\n", spec.c_str());
+                    return false;
+                }
+                options.synthetic.push_back(spec);
+            }
+        }
+        else if (arg == "-e" || arg == "--engine")
+        {
+            const char* v = value();
+            if (!v)
+                return false;
+            options.engines = splitList(v);
+        }
+        else if (arg == "-j" || arg == "--threads")
+        {
+            const char* v = value();
+            if (!v)
+                return false;
+            options.threads = parseCounts(v);
+        }
+        else if (arg == "-r" || arg == "--ratio")
+        {
+            const char* v = value();
+            if (!v)
+                return false;
+            options.ratio = std::strtof(v, nullptr);
+        }
+        else if (arg == "-n" || arg == "--repetitions")
+        {
+            const char* v = value();
+            if (!v)
+                return false;
+            options.repetitions = std::max<size_t>(1, std::strtoull(v, nullptr, 10));
+        }
+        else if (arg == "--json")
+        {
+            const char* v = value();
+            if (!v)
+                return false;
+            options.json = v;
+        }
+        else if (arg == "--csv")
+        {
+            const char* v = value();
+            if (!v)
+                return false;
+            options.csv = v;
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option %s\n", arg.c_str());
+            printUsage();
+            return false;
+        }
+    }
+
+    for (const std::string& engine : options.engines)
+    {
+        if (!isOneOf(engine, ENGINES))
+        {
+            fprintf(stderr, "Unknown engine %s, available: quadric\n", engine.c_str());
+            return false;
+        }
+    }
+    if (options.ratio <= 0.0f || options.ratio > 1.0f)
+    {
+        fprintf(stderr, "The ratio has to be in (0, 1]\n");
+        return false;
+    }
+    if (options.threads.empty())
+    {
+        size_t hardware = std::max<size_t>(1, std::thread::hardware_concurrency());
+        for (size_t threads = 1; threads < hardware; threads *= 2)
+            options.threads.push_back(threads);
+        options.threads.push_back(hardware);
+    }
+    return true;
+}
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static std::vector<BenchMesh> collectMeshes(const Options& options, const fs::path& scratch)
+{
+    std::vector<BenchMesh> meshes;
+    for (const char* name : CORPUS)
+    {
+        bool found = false;
+        for (const char* extension : CORPUS_EXTENSIONS)
+        {
+            fs::path path = fs::path(options.corpus) / name / (std::string(name) + extension);
+            if (fs::exists(path))
+            {
+                meshes.push_back({ name, path.string() });
+                found = true;
+                break;
+            }
+        }
+        if (!found)
+            printf("Skipping %s, not found under %s\n", name, options.corpus.c_str());
+    }
+
+    // Written as obj so they go through the same load as the corpus
+    for (const std::string& spec : options.synthetic)
+    {
+        SyntheticMeshSettings settings;
+        parseSyntheticMesh(spec, settings);
+        BenchMesh mesh;
+        mesh.name = syntheticMeshName(settings);
+        mesh.path = (scratch / (mesh.name + ".obj")).string();
+        ObjSink sink(mesh.path);
+        if (generateSyntheticMesh(settings, sink))
+            meshes.push_back(mesh);
+        else
+            fprintf(stderr, "Couldn't write the synthetic mesh %s\n", mesh.path.c_str());
+    }
+    return meshes;
+}
+
+// Every stage on one thread, each timed on its own. The workspace is the thread's, as it is for meshsimp's workers,
+// so after the first repetition the simplifier runs in memory it already has.
+static bool benchStages(const Options& options, BenchMesh& mesh, const std::string& engine, const fs::path& scratch, std::vector<StageResult>& results)
+{
+    const char* const STAGES[] = { "load", "simplify", "extract", "write obj", "write msbm", "read msbm" };
+    size_t first = results.size();
+    for (const char* stage : STAGES)
+    {
+        StageResult result;
+        result.mesh = mesh.name;
+        result.engine = engine;
+        result.stage = stage;
+        results.push_back(result);
+    }
+
+    SimplifierWorkspace& workspace = SimplifierWorkspace::local();
+    MyOpenMesh& simplifier = workspace.simplifier;
+    MeshData& data = workspace.result;
+    MeshData readBack;
+    std::string objPath = (scratch / (mesh.name + "_simplified.obj")).string();
+    std::string msbmPath = (scratch / (mesh.name + "_simplified.msbm")).string();
+
+    for (size_t repetition = 0; repetition < options.repetitions; repetition++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        if (!simplifier.loadMesh(mesh.path))
+            return false;
+        results[first].times.push_back(millisecondsSince(start));
+        mesh.faces = simplifier.faceCount;
+
+        start = std::chrono::steady_clock::now();
+        simplifier.simplifyToFaces(static_cast<size_t>(mesh.faces * options.ratio));
+        results[first + 1].times.push_back(millisecondsSince(start));
+
+        // The arrays the app uploads, with their meshlets
+        start = std::chrono::steady_clock::now();
+        simplifier.extractMeshData(data);
+        results[first + 2].times.push_back(millisecondsSince(start));
+
+        start = std::chrono::steady_clock::now();
+        if (!simplifier.writeMesh(objPath))
+            return false;
+        results[first + 3].times.push_back(millisecondsSince(start));
+
+        start = std::chrono::steady_clock::now();
+        if (!writeBinaryMesh(msbmPath, data))
+            return false;
+        results[first + 4].times.push_back(millisecondsSince(start));
+
+        start = std::chrono::steady_clock::now();
+        if (!readBinaryMesh(msbmPath, readBack))
+            return false;
+        results[first + 5].times.push_back(millisecondsSince(start));
+    }
+
+    for (size_t i = first; i < results.size(); i++)
+        results[i].faces = mesh.faces;
+    std::error_code error;
+    fs::remove(objPath, error);
+    fs::remove(msbmPath, error);
+    return true;
+}
+
+// Load, simplify and extract of several copies of the mesh at once. Reported per mesh, wall time over the number of
+// meshes, so perfect scaling halves it with every doubling of the threads. False when a copy fails to load, which
+// would otherwise show up as a faster time.
+static bool benchPipeline(const Options& options, const BenchMesh& mesh, const std::string& engine, size_t threads, std::vector<StageResult>& results)
+{
+    StageResult result;
+    result.mesh = mesh.name;
+    result.faces = mesh.faces;
+    result.engine = engine;
+    result.threads = threads;
+    result.stage = "pipeline";
+
+    ThreadPool pool(threads);
+    size_t jobs = threads * PIPELINE_JOBS_PER_THREAD;
+    std::atomic<size_t> failed{ 0 };
+    for (size_t repetition = 0; repetition < options.repetitions; repetition++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t job = 0; job < jobs; job++)
+        {
+            pool.submit([&]()
+            {
+                SimplifierWorkspace& workspace = SimplifierWorkspace::local();
+                if (!workspace.simplifier.loadMesh(mesh.path))
+                {
+                    failed++;
+                    return;
+                }
+                workspace.simplifier.simplifyToFaces(static_cast<size_t>(workspace.simplifier.faceCount * options.ratio));
+                workspace.simplifier.extractMeshData(workspace.result);
+            });
+        }
+        pool.wait();
+        if (failed > 0)
+            return false;
+        result.times.push_back(millisecondsSince(start) / jobs);
+    }
+    results.push_back(result);
+    return true;
+}
+
+static std::string escapeJson(const std::string& text)
+{
+    std::string escaped;
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+            escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+static bool writeJson(const std::string& path, const Options& options, const std::vector<StageResult>& results)
+{
+    std::ofstream file(path);
+    if (!file)
+    {
+        fprintf(stderr, "Can't write the results to %s\n", path.c_str());
+        return false;
+    }
+
+    file << "{\n  \"version\": " << RESULT_VERSION << ",\n  \"hardware_threads\": " << std::thread::hardware_concurrency()
+        << ",\n  \"ratio\": " << options.ratio << ",\n  \"repetitions\": " << options.repetitions << ",\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const StageResult& result = results[i];
+        file << (i > 0 ? ",\n" : "\n") << "    {\"mesh\": \"" << escapeJson(result.mesh) << "\", \"faces\": " << result.faces
+            << ", \"engine\": \"" << result.engine << "\", \"threads\": " << result.threads << ", \"stage\": \"" << result.stage
+            << "\", \"median_ms\": " << result.median() << ", \"min_ms\": " << result.min() << ", \"max_ms\": " << result.max() << "}";
+    }
+    file << "\n  ]\n}\n";
+    return true;
+}
+
+static bool writeCsv(const std::string& path, const std::vector<StageResult>& results)
+{
+    std::ofstream file(path);
+    if (!file)
+    {
+        fprintf(stderr, "Can't write the results to %s\n", path.c_str());
+        return false;
+    }
+
+    file << "mesh,faces,engine,threads,stage,median_ms,min_ms,max_ms\n";
+    for (const StageResult& result : results)
+        file << '"' << result.mesh << "\"," << result.faces << ',' << result.engine << ',' << result.threads << ',' << result.stage << ','
+            << result.median() << ',' << result.min() << ',' << result.max() << '\n';
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+        return 2;
+
+    std::error_code error;
+    // Per process, so runs at the same time don't remove each other's files
+    fs::path scratch = fs::temp_directory_path(error) / ("meshbench-" + std::to_string(getpid()));
+    fs::create_directories(scratch, error);
+    std::vector<BenchMesh> meshes = collectMeshes(options, scratch);
+    if (meshes.empty())
+    {
+        fprintf(stderr, "No meshes to benchmark\n");
+        return 2;
+    }
+
+    std::vector<StageResult> results;
+    printf("%-22s %10s %-8s %7s %-11s %10s %10s\n", "mesh", "faces", "engine", "threads", "stage", "median ms", "min ms");
+    for (const std::string& engine : options.engines)
+    {
+        for (BenchMesh& mesh : meshes)
+        {
+            size_t first = results.size();
+            if (!benchStages(options, mesh, engine, scratch, results))
+            {
+                fprintf(stderr, "Failed on %s\n", mesh.path.c_str());
+                results.resize(first);
+                continue;
+            }
+            for (size_t threads : options.threads)
+                if (!benchPipeline(options, mesh, engine, threads, results))
+                    fprintf(stderr, "Failed on %s with %zu threads\n", mesh.path.c_str(), threads);
+
+            for (size_t i = first; i < results.size(); i++)
+                printf("%-22s %10zu %-8s %7zu %-11s %10.2f %10.2f\n", results[i].mesh.c_str(), results[i].faces, results[i].engine.c_str(),
+                    results[i].threads, results[i].stage.c_str(), results[i].median(), results[i].min());
+        }
+    }
+
+    for (const BenchMesh& mesh : meshes)
+        if (fs::path(mesh.path).parent_path() == scratch)
+            fs::remove(mesh.path, error);
+    fs::remove(scratch, error);
+
+    bool written = true;
+    if (!options.json.empty())
+    {
+        if (writeJson(options.json, options, results))
+            printf("Results written to %s\n", options.json.c_str());
+        else
+            written = false;
+    }
+    if (!options.csv.empty())
+    {
+        if (writeCsv(options.csv, results))
+            printf("Results written to %s\n", options.csv.c_str());
+        else
+            written = false;
+    }
+    return written ? 0 : 1;
+}
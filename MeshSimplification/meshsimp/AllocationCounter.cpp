@@ -0,0 +1,65 @@
+#include "AllocationCounter.h"
+
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// Per thread, so jobs running side by side don't count each other's allocations
+static thread_local uint64_t allocations = 0;
+
+uint64_t threadAllocations()
+{
+    return allocations;
+}
+
+// The array and nothrow forms call these, so with the sized and aligned forms every allocation of the program is counted
+void* operator new(std::size_t size)
+{
+    allocations++;
+    if (void* memory = std::malloc(size > 0 ? size : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    allocations++;
+    std::size_t align = static_cast<std::size_t>(alignment);
+    size = size > 0 ? size : 1;
+#ifdef _WIN32
+    void* memory = _aligned_malloc(size, align);
+#else
+    // aligned_alloc wants the size in whole multiples of the alignment
+    void* memory = std::aligned_alloc(align, (size + align - 1) / align * align);
+#endif
+    if (memory)
+        return memory;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept
+{
+#ifdef _WIN32
+    _aligned_free(memory);
+#else
+    std::free(memory);
+#endif
+}
+
+void operator delete(void* memory, std::size_t, std::align_val_t alignment) noexcept
+{
+    operator delete(memory, alignment);
+}
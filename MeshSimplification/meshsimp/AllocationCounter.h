@@ -0,0 +1,10 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <cstdint>
+
+// Heap allocations the calling thread has made through operator new so far. meshsimp replaces the global
+// operator new to count them, the difference across a step is what that step allocated.
+uint64_t threadAllocations();
+
+#endif
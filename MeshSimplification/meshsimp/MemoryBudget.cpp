@@ -0,0 +1,241 @@
+#include "MemoryBudget.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    // Bytes per element of TriMesh_ArrayKernelT<> as MyOpenMesh sets it up, with the decimater attached
+    const uint64_t VERTEX_BYTES =
+        12 + 12 // Point and normal
+        + 4 + 4 // Outgoing halfedge and status
+        + 80 // Quadric of ModQuadricT, ten doubles
+        + 16 // Decimater heap position, priority, collapse target and heap entry
+        + 4; // Collapse target of ModQuadricErrorT
+    const uint64_t FACE_BYTES = 4 + 4 + 12; // Halfedge, status and normal
+    const uint64_t EDGE_BYTES = 2 * (16 + 4) + 4; // Two halfedges with next, previous, vertex, face and status, edge status
+    // The compact Vertex array and the MeshData built from it for the result
+    const uint64_t RESULT_VERTEX_BYTES = 128 + 32;
+    const uint64_t RESULT_FACE_BYTES = 2 * 12;
+    // Allocator slack and the importers' temporary arrays
+    const uint64_t HEADROOM_PERCENT = 25;
+    // Density of a text mesh, for files whose counts can't be read
+    const uint64_t BYTES_PER_FACE_GUESS = 30;
+
+    std::string lowerExtension(const std::string& path)
+    {
+        std::string extension = fs::path(path).extension().string();
+        for (char& c : extension)
+            c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        return extension;
+    }
+
+    // Counts the lines starting with "v " and "f " in a single pass of large reads
+    bool countObj(const std::string& path, uint64_t& vertices, uint64_t& faces)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            return false;
+
+        enum { LINE_START, AFTER_V, AFTER_F, REST_OF_LINE } state = LINE_START;
+        std::vector<char> buffer(1 << 20);
+        vertices = faces = 0;
+        while (file)
+        {
+            file.read(buffer.data(), buffer.size());
+            const char* c = buffer.data();
+            const char* end = c + file.gcount();
+            while (c < end)
+            {
+                switch (state)
+                {
+                case LINE_START:
+                    state = *c == 'v' ? AFTER_V : *c == 'f' ? AFTER_F : *c == '\n' ? LINE_START : REST_OF_LINE;
+                    c++;
+                    break;
+                case AFTER_V:
+                case AFTER_F:
+                    if (*c == ' ' || *c == '\t')
+                        (state == AFTER_V ? vertices : faces)++;
+                    state = *c == '\n' ? LINE_START : REST_OF_LINE;
+                    c++;
+                    break;
+                case REST_OF_LINE:
+                {
+                    // Most of the file, skipped a line at a time
+                    const char* newline = static_cast<const char*>(std::memchr(c, '\n', end - c));
+                    c = newline ? newline + 1 : end;
+                    state = newline ? LINE_START : REST_OF_LINE;
+                    break;
+                }
+                }
+            }
+        }
+        return true;
+    }
+
+    bool countOff(const std::string& path, uint64_t& vertices, uint64_t& faces)
+    {
+        std::ifstream file(path);
+        std::string line;
+        bool headerSeen = false;
+        while (std::getline(file, line))
+        {
+            std::istringstream tokens(line.substr(0, line.find('#')));
+            std::string first;
+            if (!(tokens >> first))
+                continue;
+            // The keyword may carry the counts on the same line, e.g. "OFF 8 6 12"
+            if (!headerSeen && first.find("OFF") != std::string::npos)
+            {
+                headerSeen = true;
+                if (tokens >> vertices >> faces)
+                    return true;
+                continue;
+            }
+            std::istringstream counts(line);
+            return static_cast<bool>(counts >> vertices >> faces);
+        }
+        return false;
+    }
+
+    bool countPly(const std::string& path, uint64_t& vertices, uint64_t& faces)
+    {
+        std::ifstream file(path, std::ios::binary);
+        std::string line;
+        bool vertexSeen = false, faceSeen = false;
+        while (std::getline(file, line) && line.compare(0, 10, "end_header") != 0)
+        {
+            std::istringstream tokens(line);
+            std::string keyword, element;
+            uint64_t count;
+            if (!(tokens >> keyword >> element >> count) || keyword != "element")
+                continue;
+            if (element == "vertex")
+            {
+                vertices = count;
+                vertexSeen = true;
+            }
+            else if (element == "face")
+            {
+                faces = count;
+                faceSeen = true;
+            }
+        }
+        return vertexSeen && faceSeen;
+    }
+
+    bool countStl(const std::string& path, uint64_t& vertices, uint64_t& faces)
+    {
+        std::error_code error;
+        uintmax_t size = fs::file_size(path, error);
+        if (error)
+            return false;
+
+        std::ifstream file(path, std::ios::binary);
+        char header[84];
+        if (!file.read(header, sizeof(header)))
+            return false;
+        uint32_t count;
+        std::memcpy(&count, header + 80, sizeof(count));
+
+        if (size == 84 + 50 * static_cast<uintmax_t>(count))
+            faces = count;
+        else
+        {
+            // ASCII, one "endfacet" per triangle
+            file.seekg(0);
+            std::string word;
+            faces = 0;
+            while (file >> word)
+                faces += word == "endfacet";
+        }
+        // Corners are stored per triangle and merged on load, a closed mesh has half as many vertices as faces
+        vertices = faces / 2;
+        return true;
+    }
+}
+
+bool peekMeshCounts(const std::string& path, uint64_t& vertices, uint64_t& faces)
+{
+    std::string extension = lowerExtension(path);
+    if (extension == ".obj")
+        return countObj(path, vertices, faces);
+    if (extension == ".off")
+        return countOff(path, vertices, faces);
+    if (extension == ".ply")
+        return countPly(path, vertices, faces);
+    if (extension == ".stl")
+        return countStl(path, vertices, faces);
+    return false;
+}
+
+uint64_t estimateSimplifyBytes(uint64_t vertices, uint64_t faces)
+{
+    // Euler's formula, V - E + F = 2 for a closed mesh
+    uint64_t edges = vertices + faces;
+    uint64_t bytes = vertices * (VERTEX_BYTES + RESULT_VERTEX_BYTES) + faces * (FACE_BYTES + RESULT_FACE_BYTES) + edges * EDGE_BYTES;
+    return bytes + bytes * HEADROOM_PERCENT / 100;
+}
+
+uint64_t estimateSimplifyBytes(const std::string& path)
+{
+    uint64_t vertices, faces;
+    if (!peekMeshCounts(path, vertices, faces))
+    {
+        std::error_code error;
+        uintmax_t size = fs::file_size(path, error);
+        faces = error ? 0 : size / BYTES_PER_FACE_GUESS;
+        vertices = faces / 2;
+    }
+    return estimateSimplifyBytes(vertices, faces);
+}
+
+bool MemoryBudget::acquire(const std::function<Pick(uint64_t available, uint64_t& bytes)>& pick, uint64_t& bytes)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        uint64_t available = budgetBytes == 0 || used == 0 ? std::numeric_limits<uint64_t>::max() : budgetBytes - std::min(used, budgetBytes);
+        Pick result = pick(available, bytes);
+        if (result == Pick::Empty)
+            return false;
+        if (result == Pick::Taken)
+        {
+            used += bytes;
+            peakBytes = std::max(peakBytes, used);
+            return true;
+        }
+        // Something is running whenever nothing fits, so a release comes
+        released.wait(lock);
+    }
+}
+
+void MemoryBudget::release(uint64_t bytes)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        used -= bytes;
+    }
+    released.notify_all();
+}
+
+uint64_t MemoryBudget::inUse()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return used;
+}
+
+uint64_t MemoryBudget::peak()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return peakBytes;
+}
@@ -0,0 +1,56 @@
+#ifndef MEMORYBUDGET_H
+#define MEMORYBUDGET_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+
+// Vertex and face counts of a mesh file, read from its header or by counting its lines without building the mesh.
+// False for files that can't be read or formats it doesn't know.
+bool peekMeshCounts(const std::string& path, uint64_t& vertices, uint64_t& faces);
+
+// Estimated peak heap use of simplifying a mesh: the OpenMesh connectivity and properties, the decimater's quadrics
+// and heap, and the extracted result. Meant for scheduling, it is deliberately on the high side.
+uint64_t estimateSimplifyBytes(uint64_t vertices, uint64_t faces);
+// Estimate for a file, from its counts when they can be read and from its size otherwise
+uint64_t estimateSimplifyBytes(const std::string& path);
+
+// Keeps the estimated memory of the running jobs under a budget.
+// Schedulers hand it a pick function instead of a job, so whoever is waiting can take the largest job that still fits
+// and small jobs fill the space next to a big one instead of queueing behind it.
+class MemoryBudget
+{
+public:
+	enum class Pick
+	{
+		Taken, // A job was taken, its estimate is in bytes
+		NothingFits, // Jobs are waiting but none fits next to the running ones
+		Empty, // No jobs are waiting
+	};
+
+	// Zero for no budget, every job is admitted at once
+	explicit MemoryBudget(uint64_t budgetBytes = 0) : budgetBytes(budgetBytes) {}
+
+	// Calls pick with the bytes left until it takes a job, waiting for running jobs to release theirs in between.
+	// pick runs under the budget's lock, so several waiting workers never take the same space.
+	// A job bigger than the whole budget is offered everything once nothing else runs, so it still gets done, alone.
+	// Returns false when pick found no jobs, otherwise the job runs and release has to be called with bytes after.
+	bool acquire(const std::function<Pick(uint64_t available, uint64_t& bytes)>& pick, uint64_t& bytes);
+	void release(uint64_t bytes);
+
+	uint64_t budget() const { return budgetBytes; }
+	uint64_t inUse();
+	// Largest total admitted at once
+	uint64_t peak();
+
+private:
+	uint64_t budgetBytes;
+	uint64_t used = 0;
+	uint64_t peakBytes = 0;
+	std::mutex mutex;
+	std::condition_variable released;
+};
+
+#endif
@@ -0,0 +1,644 @@
+#include "Service.h"
+
+#ifdef _WIN32
+
+#include <cstdio>
+
+int runService(const ServiceSettings&)
+{
+    fprintf(stderr, "The service needs Unix domain sockets and isn't available on Windows\n");
+    return 2;
+}
+
+int connectService(const std::string&)
+{
+    fprintf(stderr, "The service needs Unix domain sockets and isn't available on Windows\n");
+    return -1;
+}
+
+void closeService(int)
+{
+}
+
+bool sendMessage(int, uint32_t, const std::string&)
+{
+    return false;
+}
+
+bool receiveMessage(int, uint32_t&, std::string&)
+{
+    return false;
+}
+
+#else
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "MemoryBudget.h"
+#include "MeshCache.h"
+#include "MyOpenMesh.h"
+#include "SimplifierWorkspace.h"
+#include "SimplifyProgress.h"
+#include "ThreadPool.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    // Times the most urgent job may be passed over by smaller ones before they have to wait for it
+    const uint32_t MAX_TIMES_PASSED_OVER = 32;
+    // A client that doesn't read its results for this long is dropped, so it can't hold a worker thread in send
+    const int SEND_TIMEOUT_SECONDS = 10;
+
+    std::atomic<bool> stopRequested{ false };
+
+    void onSignal(int)
+    {
+        stopRequested = true;
+    }
+
+    bool writeAll(int socket, const char* data, size_t size)
+    {
+        while (size > 0)
+        {
+            ssize_t written = ::send(socket, data, size, 0);
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written <= 0)
+                return false;
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+        return true;
+    }
+
+    bool readAll(int socket, char* data, size_t size)
+    {
+        while (size > 0)
+        {
+            ssize_t received = ::recv(socket, data, size, 0);
+            if (received < 0 && errno == EINTR)
+                continue;
+            if (received <= 0)
+                return false;
+            data += received;
+            size -= static_cast<size_t>(received);
+        }
+        return true;
+    }
+
+    bool makeAddress(const std::string& path, sockaddr_un& address)
+    {
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path))
+        {
+            fprintf(stderr, "Socket path %s is too long\n", path.c_str());
+            return false;
+        }
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        return true;
+    }
+
+    double millisecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    struct Client
+    {
+        int socket;
+        std::mutex writeMutex; // Results of several workers go out on the same socket
+        std::atomic<bool> finished{ false }; // Set by the thread reading from the client when it returns
+        bool stalled = false; // A send timed out part way through a message, guarded by writeMutex
+
+        explicit Client(int socket) : socket(socket) {}
+        // Jobs keep their client alive, so the socket isn't closed and reused while a result is still being sent
+        ~Client() { ::close(socket); }
+    };
+
+    struct Job
+    {
+        uint64_t id = 0;
+        int32_t priority = 0;
+        uint64_t sequence = 0;
+        uint32_t targetFaces = 0;
+        float ratio = 0.5f;
+        std::string path;
+        uint64_t estimatedBytes = 0; // Only worked out under a memory budget
+        uint32_t passedOver = 0;
+        std::shared_ptr<Client> client;
+        std::chrono::steady_clock::time_point submitted;
+        CancellationToken cancellation; // Set by a cancel request or when the client goes away, also stops a running job
+    };
+
+    // Highest priority first, then first come first served
+    struct JobOrder
+    {
+        bool operator()(const std::shared_ptr<Job>& a, const std::shared_ptr<Job>& b) const
+        {
+            return a->priority != b->priority ? a->priority > b->priority : a->sequence < b->sequence;
+        }
+    };
+
+    struct ResidentMesh
+    {
+        std::string path;
+        fs::file_time_type modified;
+        std::shared_ptr<const MyOpenMesh::oMesh> mesh;
+    };
+
+    class Service
+    {
+    public:
+        explicit Service(const ServiceSettings& settings);
+        int run();
+
+    private:
+        struct Connection
+        {
+            std::shared_ptr<Client> client;
+            std::thread thread;
+        };
+
+        ServiceSettings settings;
+        std::unique_ptr<MeshCache> cache;
+
+        // Guards the queue and the jobs by client
+        std::mutex mutex;
+        std::set<std::shared_ptr<Job>, JobOrder> pending;
+        std::map<std::pair<const Client*, uint64_t>, std::shared_ptr<Job>> jobs;
+        uint64_t nextSequence = 0;
+
+        // Most recently used first
+        std::mutex residentMutex;
+        std::list<ResidentMesh> resident;
+
+        std::atomic<size_t> jobsDone{ 0 };
+        std::atomic<size_t> jobsFailed{ 0 };
+        std::atomic<size_t> jobsCancelled{ 0 };
+
+        MemoryBudget budget;
+
+        std::vector<Connection> connections;
+        // Last, so it finishes the running jobs before anything they use is destroyed
+        ThreadPool pool;
+
+        void serveClient(std::shared_ptr<Client> client);
+        void submit(const std::shared_ptr<Client>& client, const std::string& body);
+        void cancel(const Client* client, uint64_t jobId);
+        // Cancels everything of a client that went away, nothing is sent back
+        void dropClient(const Client* client);
+
+        // Runs the most urgent pending job, the pool gets one call per submitted job
+        void runNext();
+        bool simplify(const Job& job, MeshData& data, ResultHeader& result);
+        std::shared_ptr<const MyOpenMesh::oMesh> residentMesh(const std::string& path);
+        void finish(const std::shared_ptr<Job>& job, JobStatus status, ResultHeader result, const MeshData* data);
+        void sendResult(Client& client, const std::string& message);
+    };
+
+    Service::Service(const ServiceSettings& settings)
+        : settings(settings), budget(settings.memoryBudget), pool(settings.threads)
+    {
+        if (!settings.cacheDirectory.empty())
+            cache = std::make_unique<MeshCache>(settings.cacheDirectory, settings.cacheBytes);
+    }
+
+    int Service::run()
+    {
+        signal(SIGPIPE, SIG_IGN);
+        signal(SIGINT, onSignal);
+        signal(SIGTERM, onSignal);
+
+        sockaddr_un address;
+        if (!makeAddress(settings.socketPath, address))
+            return 2;
+
+        // A socket file left by a service that died is removed, one that still answers belongs to a running service
+        int probe = connectService(settings.socketPath);
+        if (probe >= 0)
+        {
+            closeService(probe);
+            fprintf(stderr, "A service is already running on %s\n", settings.socketPath.c_str());
+            return 2;
+        }
+        ::unlink(settings.socketPath.c_str());
+
+        int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener < 0 || ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(listener, SOMAXCONN) != 0)
+        {
+            fprintf(stderr, "Can't listen on %s: %s\n", settings.socketPath.c_str(), std::strerror(errno));
+            if (listener >= 0)
+                ::close(listener);
+            return 2;
+        }
+        printf("Serving on %s with %zu threads\n", settings.socketPath.c_str(), pool.size());
+        fflush(stdout);
+
+        // Polled with a timeout, so the loop notices a shutdown request or a signal without another thread waking it
+        while (!stopRequested)
+        {
+            pollfd entry = { listener, POLLIN, 0 };
+            if (::poll(&entry, 1, 200) <= 0)
+                continue;
+            int socket = ::accept(listener, nullptr, nullptr);
+            if (socket < 0)
+                continue;
+            timeval timeout = { SEND_TIMEOUT_SECONDS, 0 };
+            setsockopt(socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+            // Threads of clients that went away are joined here, so a long running service doesn't pile them up
+            for (size_t i = 0; i < connections.size();)
+            {
+                if (connections[i].client->finished)
+                {
+                    connections[i].thread.join();
+                    connections[i] = std::move(connections.back());
+                    connections.pop_back();
+                }
+                else
+                    i++;
+            }
+
+            auto client = std::make_shared<Client>(socket);
+            connections.push_back({ client, std::thread(&Service::serveClient, this, client) });
+        }
+
+        ::close(listener);
+        ::unlink(settings.socketPath.c_str());
+
+        // Jobs that haven't started are answered as cancelled, the running ones finish
+        std::vector<std::shared_ptr<Job>> dropped;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            dropped.assign(pending.begin(), pending.end());
+            pending.clear();
+        }
+        for (const std::shared_ptr<Job>& job : dropped)
+            finish(job, JOB_CANCELLED, ResultHeader(), nullptr);
+        pool.wait();
+
+        for (Connection& connection : connections)
+        {
+            ::shutdown(connection.client->socket, SHUT_RDWR);
+            connection.thread.join();
+        }
+        connections.clear();
+
+        printf("Service stopped: %zu jobs done, %zu failed, %zu cancelled\n", jobsDone.load(), jobsFailed.load(), jobsCancelled.load());
+        if (cache)
+            printf("Cache: %zu hits, %zu misses\n", cache->hits(), cache->misses());
+        if (budget.budget() > 0)
+            printf("Memory budget %.1f MB, at most %.1f MB estimated at once\n", budget.budget() / 1e6, budget.peak() / 1e6);
+        return 0;
+    }
+
+    void Service::serveClient(std::shared_ptr<Client> client)
+    {
+        uint32_t type;
+        std::string body;
+        while (receiveMessage(client->socket, type, body))
+        {
+            if (type == MESSAGE_SUBMIT)
+                submit(client, body);
+            else if (type == MESSAGE_CANCEL && body.size() >= sizeof(CancelRequest))
+            {
+                CancelRequest request;
+                std::memcpy(&request, body.data(), sizeof(request));
+                cancel(client.get(), request.jobId);
+            }
+            else if (type == MESSAGE_SHUTDOWN)
+                stopRequested = true;
+            else
+            {
+                fprintf(stderr, "Dropping a client that sent a malformed message\n");
+                break;
+            }
+        }
+
+        dropClient(client.get());
+        client->finished = true;
+    }
+
+    void Service::submit(const std::shared_ptr<Client>& client, const std::string& body)
+    {
+        SubmitRequest request;
+        if (body.size() < sizeof(request))
+            return;
+        std::memcpy(&request, body.data(), sizeof(request));
+
+        auto job = std::make_shared<Job>();
+        job->id = request.jobId;
+        job->priority = request.priority;
+        job->targetFaces = request.targetFaces;
+        job->ratio = request.ratio;
+        job->path = body.substr(sizeof(request), request.pathLength);
+        job->client = client;
+        job->submitted = std::chrono::steady_clock::now();
+        if (settings.memoryBudget > 0)
+            job->estimatedBytes = estimateSimplifyBytes(job->path);
+
+        bool accepted;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job->sequence = nextSequence++;
+            accepted = jobs.emplace(std::make_pair(client.get(), job->id), job).second;
+            if (accepted)
+                pending.insert(job);
+        }
+        if (!accepted)
+        {
+            // The id of an unfinished job, answered without touching the job that has it
+            ResultHeader result = {};
+            result.jobId = job->id;
+            result.status = JOB_FAILED;
+            sendResult(*client, std::string(reinterpret_cast<const char*>(&result), sizeof(result)));
+            return;
+        }
+        pool.submit([this]() { runNext(); });
+    }
+
+    void Service::cancel(const Client* client, uint64_t jobId)
+    {
+        std::shared_ptr<Job> job;
+        bool wasPending = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto found = jobs.find({ client, jobId });
+            if (found == jobs.end())
+                return;
+            job = found->second;
+            job->cancellation.cancel();
+            wasPending = pending.erase(job) > 0;
+        }
+        // A running job stops within milliseconds and is answered when it returns
+        if (wasPending)
+            finish(job, JOB_CANCELLED, ResultHeader(), nullptr);
+    }
+
+    void Service::dropClient(const Client* client)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto it = jobs.begin(); it != jobs.end();)
+        {
+            if (it->first.first != client)
+            {
+                ++it;
+                continue;
+            }
+            it->second->cancellation.cancel();
+            pending.erase(it->second);
+            jobsCancelled++;
+            it = jobs.erase(it);
+        }
+    }
+
+    void Service::runNext()
+    {
+        // The most urgent job that fits the memory budget. Smaller jobs may go ahead of one that doesn't fit yet,
+        // but only so often, or a stream of small jobs would hold a big one back forever.
+        std::shared_ptr<Job> job;
+        uint64_t bytes = 0;
+        auto pick = [&](uint64_t available, uint64_t& taken)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            // Cancelled jobs leave the queue without taking their pool call with them, so some calls find nothing
+            if (pending.empty())
+                return MemoryBudget::Pick::Empty;
+            for (auto it = pending.begin(); it != pending.end(); ++it)
+            {
+                if ((*it)->estimatedBytes <= available)
+                {
+                    for (auto skipped = pending.begin(); skipped != it; ++skipped)
+                        (*skipped)->passedOver++;
+                    job = *it;
+                    taken = job->estimatedBytes;
+                    pending.erase(it);
+                    return MemoryBudget::Pick::Taken;
+                }
+                if ((*it)->passedOver >= MAX_TIMES_PASSED_OVER)
+                    break;
+            }
+            return MemoryBudget::Pick::NothingFits;
+        };
+        if (!budget.acquire(pick, bytes))
+            return;
+
+        // The workspace of this worker, the result is sent before its next job overwrites it
+        MeshData& data = SimplifierWorkspace::local().result;
+        ResultHeader result = {};
+        bool ok = simplify(*job, data, result);
+        // Freed before the result is sent, the data is all that is left of the job by then
+        budget.release(bytes);
+        if (job->cancellation.cancelled())
+            finish(job, JOB_CANCELLED, result, nullptr);
+        else
+            finish(job, ok ? JOB_DONE : JOB_FAILED, result, ok ? &data : nullptr);
+    }
+
+    bool Service::simplify(const Job& job, MeshData& data, ResultHeader& result)
+    {
+        // Same key as meshsimp --cache, so the service and the command line share their results
+        std::string cacheKey;
+        if (cache)
+        {
+            std::string target = job.targetFaces > 0 ? "f" + std::to_string(job.targetFaces) : "r" + std::to_string(job.ratio);
+            cacheKey = MeshCache::makeKey(cache->hashFile(job.path), "quadric", target, "ModQuadric");
+            if (cache->load(cacheKey, data))
+            {
+                result.cached = 1;
+                result.outputFaces = static_cast<uint32_t>(data.indices.size() / 3);
+                result.error = data.error;
+                return true;
+            }
+        }
+
+        std::shared_ptr<const MyOpenMesh::oMesh> input = residentMesh(job.path);
+        if (!input || job.cancellation.cancelled())
+            return false;
+
+        // Copied into the working mesh of the worker, which already has room for it after the first few jobs
+        MyOpenMesh& simplifier = SimplifierWorkspace::local().simplifier;
+        simplifier.verbose = settings.verbose;
+        simplifier.recordCollapses = cache != nullptr;
+        simplifier.cancellation = &job.cancellation;
+        simplifier.loadMesh(*input);
+        result.inputFaces = static_cast<uint32_t>(simplifier.faceCount);
+
+        size_t target = job.targetFaces > 0 ? job.targetFaces : static_cast<size_t>(simplifier.faceCount * job.ratio);
+        simplifier.simplifyToFaces(target);
+        if (simplifier.cancelled)
+            return false;
+        simplifier.extractMeshData(data);
+        result.outputFaces = static_cast<uint32_t>(simplifier.faceCount);
+        result.error = data.error;
+        result.simplifyTime = static_cast<float>(simplifier.timeTaken);
+
+        if (cache)
+            cache->store(cacheKey, data);
+        return true;
+    }
+
+    std::shared_ptr<const MyOpenMesh::oMesh> Service::residentMesh(const std::string& path)
+    {
+        std::error_code error;
+        fs::file_time_type modified = fs::last_write_time(path, error);
+        if (error)
+        {
+            fprintf(stderr, "Error loading mesh: %s\n", path.c_str());
+            return nullptr;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(residentMutex);
+            for (auto it = resident.begin(); it != resident.end(); ++it)
+            {
+                if (it->path != path)
+                    continue;
+                if (it->modified == modified)
+                {
+                    resident.splice(resident.begin(), resident, it);
+                    return it->mesh;
+                }
+                resident.erase(it);
+                break;
+            }
+        }
+
+        // Loaded outside the lock, two jobs on a new file may both load it and the second one is kept
+        MyOpenMesh loader;
+        loader.verbose = settings.verbose;
+        if (!loader.loadMesh(path))
+            return nullptr;
+        auto mesh = std::make_shared<const MyOpenMesh::oMesh>(loader.mesh);
+
+        std::lock_guard<std::mutex> lock(residentMutex);
+        for (auto it = resident.begin(); it != resident.end(); ++it)
+        {
+            if (it->path == path)
+            {
+                resident.erase(it);
+                break;
+            }
+        }
+        resident.push_front({ path, modified, mesh });
+        while (resident.size() > settings.residentMeshes)
+            resident.pop_back();
+        return mesh;
+    }
+
+    void Service::finish(const std::shared_ptr<Job>& job, JobStatus status, ResultHeader result, const MeshData* data)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto found = jobs.find({ job->client.get(), job->id });
+            // Gone when the client went away, it isn't waiting for an answer then
+            if (found == jobs.end() || found->second != job)
+                return;
+            jobs.erase(found);
+        }
+
+        result.jobId = job->id;
+        result.status = status;
+        result.totalTime = static_cast<float>(millisecondsSince(job->submitted));
+
+        std::ostringstream message(std::ios::binary);
+        message.write(reinterpret_cast<const char*>(&result), sizeof(result));
+        if (data)
+            writeBinaryMesh(message, *data);
+
+        if (status == JOB_DONE)
+            jobsDone++;
+        else if (status == JOB_FAILED)
+            jobsFailed++;
+        else
+            jobsCancelled++;
+
+        if (settings.verbose)
+            printf("Job %llu %s: %s\n", static_cast<unsigned long long>(job->id), job->path.c_str(),
+                status == JOB_DONE ? (result.cached ? "cached" : "done") : status == JOB_FAILED ? "failed" : "cancelled");
+
+        sendResult(*job->client, message.str());
+    }
+
+    void Service::sendResult(Client& client, const std::string& message)
+    {
+        std::lock_guard<std::mutex> lock(client.writeMutex);
+        if (client.stalled || sendMessage(client.socket, MESSAGE_RESULT, message))
+            return;
+        // The stream may end inside a message now, so nothing more can go out on it. Shutting the socket down ends
+        // the client's reading thread, which cancels its other jobs.
+        client.stalled = true;
+        if (!client.finished)
+            fprintf(stderr, "Dropping a client that stopped reading its results\n");
+        ::shutdown(client.socket, SHUT_RDWR);
+    }
+}
+
+int runService(const ServiceSettings& settings)
+{
+    Service service(settings);
+    return service.run();
+}
+
+int connectService(const std::string& socketPath)
+{
+    sockaddr_un address;
+    if (!makeAddress(socketPath, address))
+        return -1;
+
+    int socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (socket < 0)
+        return -1;
+    if (::connect(socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        ::close(socket);
+        return -1;
+    }
+    return socket;
+}
+
+void closeService(int socket)
+{
+    ::close(socket);
+}
+
+bool sendMessage(int socket, uint32_t type, const std::string& body)
+{
+    MessageHeader header = { type, static_cast<uint32_t>(body.size()) };
+    return writeAll(socket, reinterpret_cast<const char*>(&header), sizeof(header)) && writeAll(socket, body.data(), body.size());
+}
+
+bool receiveMessage(int socket, uint32_t& type, std::string& body)
+{
+    MessageHeader header;
+    if (!readAll(socket, reinterpret_cast<char*>(&header), sizeof(header)) || header.size > SERVICE_MAX_MESSAGE)
+        return false;
+    type = header.type;
+    body.resize(header.size);
+    return readAll(socket, &body[0], body.size());
+}
+
+#endif
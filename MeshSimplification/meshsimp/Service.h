@@ -0,0 +1,93 @@
+#ifndef SERVICE_H
+#define SERVICE_H
+
+#include <cstdint>
+#include <string>
+
+// Local simplification service, a long running meshsimp that takes jobs over a Unix domain socket.
+// It keeps its worker threads, the inputs it loaded last and the result cache warm between jobs, so a build
+// system can hand it thousands of small meshes without paying process start and parsing for each one.
+// Unix only, on Windows runService and connectService report that and fail.
+//
+// Every message is a MessageHeader followed by size bytes of body, all little endian.
+// Clients send SubmitRequest (followed by the input path), CancelRequest or an empty Shutdown.
+// The service answers every submitted job exactly once with ResultHeader, followed by the result in the binary mesh
+// format when the job succeeded. Results come back in the order jobs finish, not the order they were sent.
+// A client has to keep reading, one that leaves a result unread for ten seconds is disconnected and its jobs cancelled.
+
+enum MessageType : uint32_t
+{
+	MESSAGE_SUBMIT = 1,
+	MESSAGE_CANCEL = 2,
+	MESSAGE_SHUTDOWN = 3,
+	MESSAGE_RESULT = 4,
+};
+
+enum JobStatus : uint32_t
+{
+	JOB_DONE = 0,
+	JOB_FAILED = 1,
+	JOB_CANCELLED = 2,
+};
+
+struct MessageHeader
+{
+	uint32_t type;
+	uint32_t size;
+};
+
+struct SubmitRequest
+{
+	uint64_t jobId; // Chosen by the client, only has to be unique among its own unfinished jobs
+	int32_t priority; // Higher first, jobs of the same priority run in the order they were submitted
+	uint32_t targetFaces; // Takes precedence over the ratio when not zero
+	float ratio;
+	uint32_t pathLength;
+};
+
+// Drops a waiting job, or stops a running one within milliseconds. Either way the job is answered as JOB_CANCELLED.
+struct CancelRequest
+{
+	uint64_t jobId;
+};
+
+struct ResultHeader
+{
+	uint64_t jobId;
+	uint32_t status;
+	uint32_t cached; // Read from the result cache without loading or simplifying
+	uint32_t inputFaces; // Zero when the input wasn't loaded
+	uint32_t outputFaces;
+	float error;
+	float simplifyTime; // Milliseconds
+	float totalTime; // Milliseconds from submission to the result being sent
+	uint32_t padding; // Spelled out, so the layout doesn't depend on the compiler
+};
+
+// Largest message accepted, anything bigger is taken as a broken stream
+const uint32_t SERVICE_MAX_MESSAGE = 1u << 30;
+
+struct ServiceSettings
+{
+	std::string socketPath;
+	size_t threads = 0; // Zero for one per hardware thread
+	std::string cacheDirectory; // No result cache when empty
+	uint64_t cacheBytes = 0;
+	size_t residentMeshes = 16; // Inputs kept loaded for the next job on the same file
+	// Estimated bytes of the jobs running at once, no limit when zero. The resident inputs aren't charged against it,
+	// so the footprint of the service is up to residentMeshes loaded meshes above the budget.
+	uint64_t memoryBudget = 0;
+	bool verbose = false;
+};
+
+// Serves until a client sends Shutdown or the process gets SIGINT or SIGTERM, returns the exit code
+int runService(const ServiceSettings& settings);
+
+// Socket connected to a running service, -1 on failure
+int connectService(const std::string& socketPath);
+void closeService(int socket);
+bool sendMessage(int socket, uint32_t type, const std::string& body);
+// False once the other end has closed the connection
+bool receiveMessage(int socket, uint32_t& type, std::string& body);
+
+#endif
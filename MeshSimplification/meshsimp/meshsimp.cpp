@@ -0,0 +1,1054 @@
+// Headless front end of the simplifier. Loads, simplifies and writes meshes without a window, GL context or ImGui,
+// so it runs on build machines and its timings aren't disturbed by rendering.
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "AllocationCounter.h"
+#include "BinaryMesh.h"
+#include "MemoryBudget.h"
+#include "MeshCache.h"
+#include "MyOpenMesh.h"
+#include "Service.h"
+#include "SimplifyProgress.h"
+#include "SimplifierWorkspace.h"
+#include "SyntheticMesh.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+
+namespace fs = std::filesystem;
+
+// Set by the first Ctrl+C of a local run, the running meshes stop within milliseconds and the rest are skipped
+static CancellationToken interrupted;
+
+static void onInterrupt(int)
+{
+    interrupted.cancel();
+    // A second Ctrl+C kills the process as usual
+    std::signal(SIGINT, SIG_DFL);
+}
+
+// Engines that run without a GL context. The half-edge trial in Model::simplifyModel works on GL meshes and isn't one of them.
+const char* const ENGINES[] = { "quadric" };
+// Output formats, msbm is the binary cache format with meshlets, the rest are written by OpenMesh
+const char* const FORMATS[] = { "obj", "off", "ply", "stl", "msbm" };
+// Files picked up from a batch directory
+const char* const MESH_EXTENSIONS[] = { ".obj", ".off", ".ply", ".stl" };
+// Inputs starting with this are generated rather than loaded, see SyntheticMesh.h
+const char* const SYNTHETIC_PREFIX = "synthetic:";
+// Most heap allocations --check-warm-allocations accepts from a simplification in a warm workspace. DecimaterT creates
+// its heap and support list on every call, a few allocations whatever the size of the mesh.
+const uint64_t WARM_ALLOCATION_LIMIT = 32;
+
+struct Options
+{
+    std::string engine = "quadric";
+    size_t targetFaces = 0; // Takes precedence over the ratio when set
+    float ratio = 0.5f; // Fraction of the faces to keep
+    size_t threads = 1;
+    std::string format; // Taken from the output path when empty, obj otherwise
+    std::string output; // File for a single input, directory for several
+    std::string batch; // Directory searched for meshes, or a manifest listing one mesh per line
+    std::string report; // CSV with a line per mesh, written next to the outputs in batch mode by default
+    std::string cache; // Directory of the result cache, no cache when empty
+    uint64_t cacheSize = MESH_CACHE_DEFAULT_CAPACITY;
+    std::string serve; // Socket to run the service on, instead of simplifying anything directly
+    std::string connect; // Socket of a running service the meshes are handed to
+    int priority = 0;
+    uint64_t memoryBudget = 0; // Estimated bytes of the meshes simplified at once, no limit when zero
+    std::string trace; // Chrome trace of the run, not traced when empty
+    std::string generate; // Synthetic mesh written to the output instead of simplifying anything
+    std::string memoryReport; // JSON of the memory held after each stage of each mesh, not measured when empty
+    bool checkWarmAllocations = false; // Simplify every input twice and fail if the second one allocates much
+    bool verbose = false;
+    std::vector<std::string> inputs;
+};
+
+struct FileJob
+{
+    std::string input;
+    std::string output;
+    uintmax_t inputBytes = 0; // Estimate of the work, the pool gets the largest files first
+    uint64_t estimatedBytes = 0; // Peak memory expected while simplifying, only worked out under a memory budget
+};
+
+struct JobResult
+{
+    bool ok = false;
+    std::string output;
+    size_t inputFaces = 0;
+    size_t outputFaces = 0;
+    double error = 0.0;
+    double loadTime = 0.0; // Milliseconds
+    double simplifyTime = 0.0;
+    double writeTime = 0.0;
+    uintmax_t outputBytes = 0;
+    int worker = -1;
+    bool cached = false; // Read from the cache, without loading or simplifying
+    bool cancelled = false; // Interrupted before it finished, nothing was written
+    uint64_t simplifyAllocations = 0; // Heap allocations while simplifying and extracting, few once the worker's workspace is warm
+    std::vector<MemoryStage> memory; // With --memory-report
+};
+
+static void printUsage()
+{
+    printf("Usage: meshsimp [options] <input>...\n"
+        "       meshsimp [options] --batch <directory|manifest>\n"
+        "  -e, --engine <name>    Simplification engine: quadric (default)\n"
+        "  -t, --target <faces>   Faces to keep\n"
+        "  -r, --ratio <0..1>     Fraction of the faces to keep when no target is given (default 0.5)\n"
+        "  -j, --threads <n>      Inputs simplified at once (default 1, 0 for one per hardware thread)\n"
+        "  -f, --format <fmt>     obj, off, ply, stl or msbm (default from the output extension, else obj)\n"
+        "  -o, --output <path>    Output file for one input, output directory for several\n"
+        "                         (default <input>_simplified.<fmt> next to each input, with the input's\n"
+        "                         extension kept as <input>_<ext>_simplified.<fmt> when two would share a name)\n"
+        "  -b, --batch <path>     Simplify every obj/off/ply/stl under a directory, or every path listed in a\n"
+        "                         manifest file (one per line, relative to the manifest, # for comments).\n"
+        "                         Outputs keep the relative layout under --output (default <path>/simplified)\n"
+        "      --report <file>    CSV with the timings and sizes of every mesh (default report.csv in the output\n"
+        "                         directory in batch mode)\n"
+        "      --cache <dir>      Reuse results of earlier runs with the same input and settings, and keep new ones\n"
+        "      --cache-size <MB>  Size the cache is trimmed to, least recently used first (default 1024)\n"
+        "  -m, --memory <MB>      Only start a mesh while the estimated memory of those running stays under this,\n"
+        "                         smaller meshes fill in next to big ones (default no limit). With --serve the\n"
+        "                         last 16 inputs also stay loaded for the next job on them, outside this limit\n"
+        "      --serve <socket>   Run as a service taking jobs on a Unix domain socket until shut down (Unix only)\n"
+        "      --connect <socket> Hand the meshes to a service running on the socket instead of simplifying them here\n"
+        "      --priority <n>     Priority of the jobs handed to a service, higher first (default 0)\n"
+        "      --generate <spec>  Write the synthetic mesh <shape>:<triangles>[:<seed>] to --output and exit. msbm and\n"
+        "                         obj outputs are streamed as the mesh is generated, so any size fits in memory.\n"
+        "                         Shapes: icosphere, terrain, torus, holes, nonmanifold. Any input may also be\n"
+        "                         synthetic:<spec>, e.g. synthetic:torus:2M:7, generated straight into the simplifier\n"
+        "      --trace <file>     Write a Chrome trace of every stage on every thread, for chrome://tracing or\n"
+        "                         ui.perfetto.dev. With --serve it covers the whole life of the service\n"
+        "      --memory-report <file>  Write the bytes held by each data structure and the resident set after\n"
+        "                         every stage of every mesh as JSON. The resident set is the process's, run with -j 1\n"
+        "                         to attribute it to one mesh\n"
+        "      --check-warm-allocations  Simplify every input twice on one thread, without the cache, and fail if the\n"
+        "                         second simplification makes more heap allocations than a small constant\n"
+        "  -v, --verbose          Print every step of every mesh\n"
+        "  -h, --help             Show this message\n");
+}
+
+template<size_t N>
+static bool isOneOf(const std::string& value, const char* const (&list)[N])
+{
+    for (const char* entry : list)
+        if (value == entry)
+            return true;
+    return false;
+}
+
+// Settings of an input that is generated, false for files
+static bool syntheticInput(const std::string& input, SyntheticMeshSettings& settings)
+{
+    size_t prefix = std::strlen(SYNTHETIC_PREFIX);
+    return input.compare(0, prefix, SYNTHETIC_PREFIX) == 0 && parseSyntheticMesh(input.substr(prefix), settings);
+}
+
+static bool parseOptions(int argc, char** argv, Options& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        // Every option but the flags takes the next argument as its value
+        auto value = [&]() -> const char*
+        {
+            if (i + 1 >= argc)
+            {
+                fprintf(stderr, "Missing value for %s\n", arg.c_str());
+                return nullptr;
+            }
+            return argv[++i];
+        };
+
+        if (arg == "-h" || arg == "--help")
+        {
+            printUsage();
+            std::exit(0);
+        }
+        else if (arg == "-v" || arg == "--verbose")
+            options.verbose = true;
+        else if (arg == "-e" || arg == "--engine")
+        {
+            const char* v = value();
+            if (!v)
+                return false;
+            options.engine = v;
+        }
+        else if (arg == "-t" || arg == "--target")
+        {
+            const char* v = value();
+            if (!v)
+                return false;
+            options.targetFaces = std::strtoull(v, nullptr, 10);
+        }
+        else if (arg == "-r" || arg == "--ratio")
+        {
+            const char* v = value();
+            if (!v)
+                return false;
+            options.ratio = std::strtof(v, nullptr);
+        }
+        else if (arg == "-j" || arg == "--threads")
+        {
+            const char* v = value();
+            if (!v)
+                return false;
+            options.threads = std::strtoull(v, nullptr, 10);
+        }
+        else if (arg == "-f" || arg == "--format")
+        {
+            const char* v = value();
+            if (!v)
+                return false;
+            options.format = v;
+        }
+        else if (arg == "-o" || arg == "--output")
+        {
+            const char* v = value();
+            if (!v)
+                return false;
+            options.output = v;
+        }
+        else if (arg == "-b" || arg == "--batch")
+        {
+            const char* v = value();
+            if (!v)
+                return false;
+            options.batch = v;
+        }
+        else if (arg == "--report")
+        {
+            const char* v = value();
+            if (!v)
+                return false;
+            options.report = v;
+        }
+        else if (arg == "--cache")
+        {
+            const char* v = value();
+            if (!v)
+                return false;
+            options.cache = v;
+        }
+        else if (arg == "--cache-size")
+        {
+            const char* v = value();
+            if (!v)
+                return false;
+            options.cacheSize = std::strtoull(v, nullptr, 10) * 1024 * 1024;
+        }
+        else if (arg == "-m" || arg == "--memory")
+        {
+            const char* v = value();
+            if (!v)
+                return false;
+            options.memoryBudget = std::strtoull(v, nullptr, 10) * 1024 * 1024;
+        }
+        else if (arg == "--serve")
+        {
+            const char* v = value();
+            if (!v)
+                return false;
+            options.serve = v;
+        }
+        else if (arg == "--connect")
+        {
+            const char* v = value();
+            if (!v)
+                return false;
+            options.connect = v;
+        }
+        else if (arg == "--priority")
+        {
+            const char* v = value();
+            if (!v)
+                return false;
+            options.priority = std::atoi(v);
+        }
+        else if (arg == "--check-warm-allocations")
+            options.checkWarmAllocations = true;
+        else if (arg == "--trace")
+        {
+            const char* v = value();
+            if (!v)
+                return false;
+            options.trace = v;
+        }
+        else if (arg == "--memory-report")
+        {
+            const char* v = value();
+            if (!v)
+                return false;
+            options.memoryReport = v;
+        }
+        else if (arg == "--generate")
+        {
+            const char* v = value();
+            if (!v)
+                return false;
+            options.generate = v;
+        }
+        else if (arg.size() > 1 && arg[0] == '-')
+        {
+            fprintf(stderr, "Unknown option %s\n", arg.c_str());
+            return false;
+        }
+        else
+            options.inputs.push_back(arg);
+    }
+
+    if (!options.serve.empty())
+        return true;
+    if (!options.generate.empty())
+    {
+        SyntheticMeshSettings settings;
+        if (!parseSyntheticMesh(options.generate, settings) || options.output.empty())
+        {
+            fprintf(stderr, "--generate takes <shape>:<triangles>[:<seed>] and needs --output\n");
+            return false;
+        }
+        return true;
+    }
+    if (options.inputs.empty() == options.batch.empty())
+    {
+        printUsage();
+        return false;
+    }
+    for (const std::string& input : options.inputs)
+    {
+        if (input.compare(0, std::strlen(SYNTHETIC_PREFIX), SYNTHETIC_PREFIX) != 0)
+            continue;
+        SyntheticMeshSettings settings;
+        if (!syntheticInput(input, settings))
+        {
+            fprintf(stderr, "Can't read %s, expected synthetic:<shape>:<triangles>[:<seed>]\n", input.c_str());
+            return false;
+        }
+        // The service loads its inputs from files
+        if (!options.connect.empty())
+        {
+            fprintf(stderr, "Synthetic inputs are only generated in local runs\n");
+            return false;
+        }
+    }
+    if (options.checkWarmAllocations && !options.connect.empty())
+    {
+        fprintf(stderr, "--check-warm-allocations counts the allocations of this process, it can't run with --connect\n");
+        return false;
+    }
+    if (!isOneOf(options.engine, ENGINES))
+    {
+        fprintf(stderr, "Unknown engine %s, available: quadric\n", options.engine.c_str());
+        return false;
+    }
+    if (options.targetFaces == 0 && (options.ratio <= 0.0f || options.ratio > 1.0f))
+    {
+        fprintf(stderr, "The ratio has to be in (0, 1]\n");
+        return false;
+    }
+
+    bool singleFile = options.batch.empty() && options.inputs.size() == 1 && !options.output.empty() && !fs::is_directory(options.output);
+    if (options.format.empty())
+    {
+        std::string extension = singleFile ? fs::path(options.output).extension().string() : "";
+        options.format = extension.empty() ? "obj" : extension.substr(1);
+    }
+    if (!isOneOf(options.format, FORMATS))
+    {
+        fprintf(stderr, "Unknown format %s, available: obj, off, ply, stl, msbm\n", options.format.c_str());
+        return false;
+    }
+    return true;
+}
+
+static std::string outputName(const fs::path& input, const std::string& format)
+{
+    return input.stem().string() + "_simplified." + format;
+}
+
+static bool isMeshFile(const fs::path& path)
+{
+    std::string extension = path.extension().string();
+    for (char& c : extension)
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return isOneOf(extension, MESH_EXTENSIONS);
+}
+
+// Inputs given on the command line, written next to each input or into the output directory
+static void collectInputs(const Options& options, std::vector<FileJob>& jobs)
+{
+    bool singleFile = options.inputs.size() == 1 && !options.output.empty() && !fs::is_directory(options.output);
+    for (const std::string& input : options.inputs)
+    {
+        FileJob job;
+        job.input = input;
+        if (singleFile)
+            job.output = options.output;
+        else
+        {
+            SyntheticMeshSettings synthetic;
+            fs::path directory = options.output.empty() ? fs::path(input).parent_path() : fs::path(options.output);
+            std::string name = syntheticInput(input, synthetic) ? syntheticMeshName(synthetic) + "_simplified." + options.format : outputName(input, options.format);
+            job.output = (directory / name).string();
+        }
+        jobs.push_back(job);
+    }
+}
+
+// Meshes under a directory or listed in a manifest, written with the same relative layout under the output directory
+static bool collectBatch(const Options& options, std::vector<FileJob>& jobs, fs::path& outputRoot)
+{
+    fs::path batch(options.batch);
+    std::error_code error;
+    bool isDirectory = fs::is_directory(batch, error);
+    fs::path base = isDirectory ? batch : batch.parent_path();
+    outputRoot = options.output.empty() ? base / "simplified" : fs::path(options.output);
+
+    std::vector<fs::path> inputs;
+    if (isDirectory)
+    {
+        fs::path skip = fs::weakly_canonical(outputRoot, error);
+        for (fs::recursive_directory_iterator it(batch, error), end; it != end; it.increment(error))
+        {
+            // Results of an earlier run in the same tree are not inputs
+            if (it->is_directory() && fs::weakly_canonical(it->path(), error) == skip)
+            {
+                it.disable_recursion_pending();
+                continue;
+            }
+            if (it->is_regular_file() && isMeshFile(it->path()))
+                inputs.push_back(it->path());
+        }
+        std::sort(inputs.begin(), inputs.end());
+    }
+    else
+    {
+        std::ifstream manifest(batch);
+        if (!manifest)
+        {
+            fprintf(stderr, "Can't read %s\n", options.batch.c_str());
+            return false;
+        }
+        std::string line;
+        while (std::getline(manifest, line))
+        {
+            line.erase(0, line.find_first_not_of(" \t"));
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            if (line.empty() || line[0] == '#')
+                continue;
+            fs::path path(line);
+            inputs.push_back(path.is_absolute() ? path : base / path);
+        }
+    }
+
+    for (const fs::path& input : inputs)
+    {
+        fs::path relative = input.lexically_relative(base);
+        if (relative.empty() || *relative.begin() == "..")
+            relative = input.filename();
+
+        FileJob job;
+        job.input = input.string();
+        job.output = (outputRoot / relative.parent_path() / outputName(input, options.format)).string();
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+// Inputs that differ only by extension, like a.obj and a.ply, keep it in their output name, a_obj_simplified.<fmt>.
+// Any outputs still shared after that, such as manifest entries outside the base directory with the same file name,
+// would overwrite each other and fail the run
+static bool uniqueOutputs(std::vector<FileJob>& jobs)
+{
+    std::map<std::string, std::vector<size_t>> byOutput;
+    for (size_t i = 0; i < jobs.size(); i++)
+        byOutput[fs::path(jobs[i].output).lexically_normal().string()].push_back(i);
+    for (const auto& entry : byOutput)
+    {
+        if (entry.second.size() < 2)
+            continue;
+        for (size_t i : entry.second)
+        {
+            fs::path input(jobs[i].input), output(jobs[i].output);
+            std::string extension = input.extension().string();
+            if (extension.empty())
+                continue;
+            output.replace_filename(input.stem().string() + "_" + extension.substr(1) + "_simplified" + output.extension().string());
+            jobs[i].output = output.string();
+        }
+    }
+
+    std::map<std::string, size_t> seen;
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        auto inserted = seen.emplace(fs::path(jobs[i].output).lexically_normal().string(), i);
+        if (!inserted.second)
+        {
+            fprintf(stderr, "%s and %s would both be written to %s\n", jobs[inserted.first->second].input.c_str(),
+                jobs[i].input.c_str(), jobs[i].output.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool writeReport(const std::string& path, const std::vector<FileJob>& jobs, const std::vector<JobResult>& results)
+{
+    std::ofstream file(path);
+    if (!file)
+    {
+        fprintf(stderr, "Can't write the report to %s\n", path.c_str());
+        return false;
+    }
+
+    file << "input,output,status,input_bytes,estimated_bytes,output_bytes,input_faces,output_faces,error,load_ms,simplify_ms,write_ms,worker,cached,simplify_allocations\n";
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        const JobResult& result = results[i];
+        file << '"' << jobs[i].input << "\",\"" << jobs[i].output << "\"," << (result.ok ? "ok" : result.cancelled ? "cancelled" : "failed") << ','
+            << jobs[i].inputBytes << ',' << jobs[i].estimatedBytes << ',' << result.outputBytes << ',' << result.inputFaces << ',' << result.outputFaces << ','
+            << result.error << ',' << result.loadTime << ',' << result.simplifyTime << ',' << result.writeTime << ',' << result.worker << ',' << result.cached << ',' << result.simplifyAllocations << '\n';
+    }
+    return true;
+}
+
+static std::string escapeJson(const std::string& text)
+{
+    std::string escaped;
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+            escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+static bool writeMemoryReport(const std::string& path, const std::vector<FileJob>& jobs, const std::vector<JobResult>& results)
+{
+    std::ofstream file(path);
+    if (!file)
+    {
+        fprintf(stderr, "Can't write the memory report to %s\n", path.c_str());
+        return false;
+    }
+
+    file << "{\n  \"version\": 1,\n  \"meshes\": [";
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        file << (i > 0 ? "," : "") << "\n    {\"input\": \"" << escapeJson(jobs[i].input) << "\", \"output\": \"" << escapeJson(jobs[i].output)
+            << "\", \"input_faces\": " << results[i].inputFaces << ", \"output_faces\": " << results[i].outputFaces << ",\n     \"stages\": ";
+        writeMemoryJson(file, results[i].memory, "     ");
+        file << "}";
+    }
+    file << "\n  ]\n}\n";
+    return static_cast<bool>(file);
+}
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void recordOutputSize(JobResult& result)
+{
+    std::error_code error;
+    uintmax_t bytes = fs::file_size(result.output, error);
+    result.outputBytes = error ? 0 : bytes;
+}
+
+static JobResult simplifyFile(const Options& options, const FileJob& job, MeshCache* cache)
+{
+    JobResult result;
+    result.worker = ThreadPool::currentWorker();
+    const std::string& input = job.input;
+    result.output = job.output;
+
+    // Every job of a worker goes through the same workspace
+    SimplifierWorkspace& workspace = SimplifierWorkspace::local();
+    MyOpenMesh& simplifier = workspace.simplifier;
+    MeshData& data = workspace.result;
+
+    if (interrupted.cancelled())
+    {
+        result.cancelled = true;
+        return result;
+    }
+
+    // Each stage of the memory report ends with what the workspace holds
+    bool measure = !options.memoryReport.empty();
+    auto beginStage = [&](const char* name)
+    {
+        if (measure)
+        {
+            result.memory.emplace_back();
+            result.memory.back().begin(name);
+        }
+    };
+    auto endStage = [&]()
+    {
+        if (measure)
+        {
+            simplifier.reportMemory(result.memory.back());
+            result.memory.back().add("Result", data.memoryBytes());
+            result.memory.back().end();
+        }
+    };
+
+    // Timestamps are taken inside each stage's bracket, the memory report's own /proc reads aren't part of the timings.
+    // A ratio is part of the key as given, the face count it stands for isn't known without loading the mesh
+    std::string cacheKey;
+    std::chrono::steady_clock::time_point start;
+    if (cache)
+    {
+        beginStage("cache read");
+        start = std::chrono::steady_clock::now();
+        std::string target = options.targetFaces > 0 ? "f" + std::to_string(options.targetFaces) : "r" + std::to_string(options.ratio);
+        // A generated mesh is identified by its settings, they stand for the geometry as long as the generator doesn't change
+        SyntheticMeshSettings synthetic;
+        if (syntheticInput(input, synthetic))
+            cacheKey = MeshCache::makeKey(0, options.engine, target, "ModQuadric " + syntheticMeshSpec(synthetic) + " v" + std::to_string(SYNTHETIC_MESH_VERSION));
+        else
+            cacheKey = MeshCache::makeKey(cache->hashFile(input), options.engine, target, "ModQuadric");
+
+        if (cache->load(cacheKey, data))
+        {
+            result.loadTime = millisecondsSince(start);
+            endStage();
+            result.cached = true;
+            result.outputFaces = data.indices.size() / 3;
+            result.error = data.error;
+
+            beginStage("write");
+            start = std::chrono::steady_clock::now();
+            result.ok = options.format == "msbm" ? writeBinaryMesh(result.output, data) : MyOpenMesh::writeMesh(result.output, data);
+            result.writeTime = millisecondsSince(start);
+            endStage();
+            recordOutputSize(result);
+            return result;
+        }
+        if (measure)
+            result.memory.pop_back();
+    }
+
+    simplifier.verbose = options.verbose;
+    simplifier.recordCollapses = cache != nullptr;
+
+    beginStage("load");
+    start = std::chrono::steady_clock::now();
+    SyntheticMeshSettings synthetic;
+    bool loaded;
+    if (syntheticInput(input, synthetic))
+    {
+        SimplifierSink sink(simplifier);
+        loaded = generateSyntheticMesh(synthetic, sink);
+    }
+    else
+        loaded = simplifier.loadMesh(input);
+    result.loadTime = millisecondsSince(start);
+    endStage();
+    if (!loaded)
+        return result;
+    result.inputFaces = simplifier.faceCount;
+
+    size_t target = options.targetFaces > 0 ? options.targetFaces : static_cast<size_t>(result.inputFaces * options.ratio);
+    uint64_t allocations = threadAllocations();
+    simplifier.cancellation = &interrupted;
+    beginStage("simplify");
+    simplifier.simplifyToFaces(target);
+    endStage();
+    result.simplifyTime = simplifier.timeTaken;
+    // A partly simplified mesh would pass for the result it was asked for, so nothing is written
+    if (simplifier.cancelled)
+    {
+        result.cancelled = true;
+        return result;
+    }
+    result.outputFaces = simplifier.faceCount;
+    result.error = simplifier.geometricError();
+
+    beginStage("extract and write");
+    start = std::chrono::steady_clock::now();
+    if (options.format == "msbm" || cache)
+        simplifier.extractMeshData(data);
+    result.simplifyAllocations = threadAllocations() - allocations;
+    if (options.format == "msbm")
+        result.ok = writeBinaryMesh(result.output, data);
+    else
+        result.ok = simplifier.writeMesh(result.output);
+    result.writeTime = millisecondsSince(start);
+    endStage();
+    recordOutputSize(result);
+
+    if (cache && result.ok)
+        cache->store(cacheKey, data);
+
+    return result;
+}
+
+// The second simplification of each input runs in the workspace the first one left warm, and should only make the
+// allocations OpenMesh's decimater makes on every call
+static int checkWarmAllocations(const Options& options, const std::vector<FileJob>& jobs)
+{
+    Options checkOptions = options;
+    checkOptions.memoryReport.clear();
+    int failed = 0;
+    for (const FileJob& job : jobs)
+    {
+        JobResult cold = simplifyFile(checkOptions, job, nullptr);
+        JobResult warm = simplifyFile(checkOptions, job, nullptr);
+        bool ok = cold.ok && warm.ok && warm.simplifyAllocations <= WARM_ALLOCATION_LIMIT;
+        printf("%s: %llu allocations cold, %llu warm (limit %llu), %s\n", job.input.c_str(), static_cast<unsigned long long>(cold.simplifyAllocations),
+            static_cast<unsigned long long>(warm.simplifyAllocations), static_cast<unsigned long long>(WARM_ALLOCATION_LIMIT), ok ? "ok" : "FAILED");
+        failed += !ok;
+    }
+    return failed == 0 ? 0 : 1;
+}
+
+static void printResult(const FileJob& job, const JobResult& result)
+{
+    if (result.ok && result.cached)
+        printf("%s -> %s: %zu faces from the cache, error %g, lookup %.1f ms, write %.1f ms\n",
+            job.input.c_str(), result.output.c_str(), result.outputFaces, result.error, result.loadTime, result.writeTime);
+    else if (result.ok)
+        printf("%s -> %s: %zu -> %zu faces, error %g, load %.1f ms, simplify %.1f ms, write %.1f ms\n",
+            job.input.c_str(), result.output.c_str(), result.inputFaces, result.outputFaces, result.error,
+            result.loadTime, result.simplifyTime, result.writeTime);
+    else if (result.cancelled)
+        fprintf(stderr, "%s: cancelled\n", job.input.c_str());
+    else
+        fprintf(stderr, "%s: failed\n", job.input.c_str());
+}
+
+// Sends every job to a running service and writes the results as they come back.
+// The service doesn't share the working directory, so inputs go as absolute paths.
+static bool runClient(const Options& options, const std::vector<FileJob>& jobs, const std::vector<size_t>& order, std::vector<JobResult>& results)
+{
+    int socket = connectService(options.connect);
+    if (socket < 0)
+    {
+        fprintf(stderr, "No service running on %s\n", options.connect.c_str());
+        return false;
+    }
+
+    // The service reads on its own thread, so all jobs can be sent before reading any result without blocking it
+    for (size_t i : order)
+    {
+        std::error_code error;
+        std::string path = fs::absolute(jobs[i].input, error).string();
+        SubmitRequest request;
+        request.jobId = i;
+        request.priority = options.priority;
+        request.targetFaces = static_cast<uint32_t>(options.targetFaces);
+        request.ratio = options.ratio;
+        request.pathLength = static_cast<uint32_t>(path.size());
+        std::string body(reinterpret_cast<const char*>(&request), sizeof(request));
+        if (!sendMessage(socket, MESSAGE_SUBMIT, body + path))
+        {
+            fprintf(stderr, "Lost the connection to the service\n");
+            closeService(socket);
+            return false;
+        }
+    }
+
+    size_t answered = 0;
+    uint32_t type;
+    std::string body;
+    while (answered < jobs.size() && receiveMessage(socket, type, body))
+    {
+        ResultHeader header;
+        if (type != MESSAGE_RESULT || body.size() < sizeof(header))
+            continue;
+        std::memcpy(&header, body.data(), sizeof(header));
+        if (header.jobId >= jobs.size())
+            continue;
+        answered++;
+
+        JobResult& result = results[header.jobId];
+        result.output = jobs[header.jobId].output;
+        result.cached = header.cached != 0;
+        result.inputFaces = header.inputFaces;
+        result.outputFaces = header.outputFaces;
+        result.error = header.error;
+        result.simplifyTime = header.simplifyTime;
+        // Everything the service spent on the job besides simplifying, queueing included
+        result.loadTime = std::max(0.0, static_cast<double>(header.totalTime - header.simplifyTime));
+
+        if (header.status == JOB_DONE)
+        {
+            auto start = std::chrono::steady_clock::now();
+            if (options.format == "msbm")
+            {
+                std::ofstream file(result.output, std::ios::binary);
+                file.write(body.data() + sizeof(header), body.size() - sizeof(header));
+                result.ok = static_cast<bool>(file);
+            }
+            else
+            {
+                MeshData data;
+                std::istringstream stream(body.substr(sizeof(header)), std::ios::binary);
+                result.ok = readBinaryMesh(stream, data) && MyOpenMesh::writeMesh(result.output, data);
+            }
+            result.writeTime = millisecondsSince(start);
+            recordOutputSize(result);
+        }
+        printResult(jobs[header.jobId], result);
+    }
+    closeService(socket);
+
+    if (answered < jobs.size())
+        fprintf(stderr, "The service went away with %zu jobs unanswered\n", jobs.size() - answered);
+    return true;
+}
+
+static void finishTrace(const Options& options)
+{
+    if (options.trace.empty())
+        return;
+    Trace::setEnabled(false);
+    if (Trace::writeChromeTrace(options.trace))
+        printf("Trace written to %s\n", options.trace.c_str());
+}
+
+// Writes the mesh of --generate, streamed for the formats that allow it
+static int generateMesh(const Options& options)
+{
+    SyntheticMeshSettings settings;
+    parseSyntheticMesh(options.generate, settings);
+    std::string extension = fs::path(options.output).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+
+    auto start = std::chrono::steady_clock::now();
+    bool ok;
+    if (extension == ".msbm")
+    {
+        BinaryMeshSink sink(options.output);
+        ok = generateSyntheticMesh(settings, sink);
+    }
+    else if (extension == ".obj")
+    {
+        ObjSink sink(options.output);
+        ok = generateSyntheticMesh(settings, sink);
+    }
+    else
+    {
+        MeshData data;
+        MeshDataSink sink(data);
+        ok = generateSyntheticMesh(settings, sink) && MyOpenMesh::writeMesh(options.output, data);
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "Failed to write %s\n", options.output.c_str());
+        return 1;
+    }
+
+    uint64_t vertices, triangles;
+    countSyntheticMesh(settings, vertices, triangles);
+    printf("%s: %llu vertices, %llu triangles in %.0f ms\n", options.output.c_str(), static_cast<unsigned long long>(vertices),
+        static_cast<unsigned long long>(triangles), millisecondsSince(start));
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+        return 2;
+    if (!options.trace.empty())
+    {
+        Trace::setThreadName("main");
+        Trace::setEnabled(true);
+    }
+
+    if (!options.serve.empty())
+    {
+        ServiceSettings settings;
+        settings.socketPath = options.serve;
+        settings.threads = options.threads;
+        settings.cacheDirectory = options.cache;
+        settings.cacheBytes = options.cacheSize;
+        settings.memoryBudget = options.memoryBudget;
+        settings.verbose = options.verbose;
+        int exitCode = runService(settings);
+        finishTrace(options);
+        return exitCode;
+    }
+    if (!options.generate.empty())
+    {
+        int exitCode = generateMesh(options);
+        finishTrace(options);
+        return exitCode;
+    }
+
+    std::vector<FileJob> jobs;
+    fs::path outputRoot = options.output;
+    if (options.batch.empty())
+        collectInputs(options, jobs);
+    else if (!collectBatch(options, jobs, outputRoot))
+        return 2;
+    if (!uniqueOutputs(jobs))
+        return 2;
+    if (jobs.empty())
+    {
+        fprintf(stderr, "No meshes to simplify\n");
+        return 2;
+    }
+
+    // Output directories are made up front, the jobs only write files
+    std::error_code error;
+    for (FileJob& job : jobs)
+    {
+        SyntheticMeshSettings synthetic;
+        if (syntheticInput(job.input, synthetic))
+        {
+            // Counted as the positions and indices it would take in a file
+            uint64_t vertices, faces;
+            countSyntheticMesh(synthetic, vertices, faces);
+            job.inputBytes = vertices * 12 + faces * 12;
+            if (options.memoryBudget > 0)
+                job.estimatedBytes = estimateSimplifyBytes(vertices, faces);
+        }
+        else
+        {
+            job.inputBytes = fs::file_size(job.input, error);
+            if (error)
+                job.inputBytes = 0;
+            // Reads the counts from the file, a header for most formats but a pass over the whole file for obj
+            if (options.memoryBudget > 0 && options.connect.empty())
+                job.estimatedBytes = estimateSimplifyBytes(job.input);
+        }
+        fs::path directory = fs::path(job.output).parent_path();
+        if (!directory.empty())
+            fs::create_directories(directory, error);
+    }
+
+    // Largest first, by estimated memory under a budget and by file size otherwise, so the big meshes start early
+    // and small ones fill in at the end
+    std::vector<size_t> order(jobs.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+    {
+        return jobs[a].estimatedBytes != jobs[b].estimatedBytes ? jobs[a].estimatedBytes > jobs[b].estimatedBytes : jobs[a].inputBytes > jobs[b].inputBytes;
+    });
+
+    if (options.checkWarmAllocations)
+    {
+        int exitCode = checkWarmAllocations(options, jobs);
+        finishTrace(options);
+        return exitCode;
+    }
+
+    std::unique_ptr<MeshCache> cache;
+    if (!options.cache.empty() && options.connect.empty())
+        cache = std::make_unique<MeshCache>(options.cache, options.cacheSize);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<JobResult> results(jobs.size());
+    std::string ranOn;
+
+    if (!options.connect.empty())
+    {
+        if (!runClient(options, jobs, order, results))
+            return 2;
+        ranOn = "the service";
+    }
+    else
+    {
+        std::mutex printMutex;
+        // Guarded by the budget, every pool call takes the largest waiting mesh that fits next to the running ones
+        std::vector<size_t> waiting = order;
+        MemoryBudget budget(options.memoryBudget);
+        auto pickLargestFitting = [&](uint64_t available, uint64_t& bytes, size_t& index)
+        {
+            if (waiting.empty())
+                return MemoryBudget::Pick::Empty;
+            for (auto it = waiting.begin(); it != waiting.end(); ++it)
+            {
+                if (jobs[*it].estimatedBytes <= available)
+                {
+                    index = *it;
+                    bytes = jobs[index].estimatedBytes;
+                    waiting.erase(it);
+                    return MemoryBudget::Pick::Taken;
+                }
+            }
+            return MemoryBudget::Pick::NothingFits;
+        };
+
+        std::signal(SIGINT, onInterrupt);
+        ThreadPool pool(options.threads);
+        for (size_t n = 0; n < jobs.size(); n++)
+        {
+            pool.submit([&]()
+            {
+                size_t i = 0;
+                uint64_t bytes = 0;
+                if (!budget.acquire([&](uint64_t available, uint64_t& taken) { return pickLargestFitting(available, taken, i); }, bytes))
+                    return;
+                results[i] = simplifyFile(options, jobs[i], cache.get());
+                budget.release(bytes);
+
+                std::lock_guard<std::mutex> lock(printMutex);
+                printResult(jobs[i], results[i]);
+            });
+        }
+        pool.wait();
+        std::signal(SIGINT, SIG_DFL);
+        ranOn = std::to_string(pool.size()) + " threads, " + std::to_string(pool.stolenJobs()) + " jobs stolen";
+        if (budget.budget() > 0)
+            printf("Memory budget %.1f MB, at most %.1f MB estimated at once\n", budget.budget() / 1e6, budget.peak() / 1e6);
+    }
+    double wallTime = millisecondsSince(start);
+
+    size_t failed = 0, cancelled = 0;
+    double jobTime = 0.0;
+    uintmax_t inputBytes = 0, outputBytes = 0;
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        failed += !results[i].ok;
+        cancelled += results[i].cancelled;
+        jobTime += results[i].loadTime + results[i].simplifyTime + results[i].writeTime;
+        inputBytes += jobs[i].inputBytes;
+        outputBytes += results[i].outputBytes;
+    }
+    if (jobs.size() > 1)
+    {
+        // Job time over wall time is the speedup the pool got out of its threads
+        printf("%zu of %zu meshes simplified in %.1f ms (%.1fx, %s)\n",
+            jobs.size() - failed, jobs.size(), wallTime, wallTime > 0.0 ? jobTime / wallTime : 0.0, ranOn.c_str());
+        printf("%.1f MB in, %.1f MB out, %.1f MB/s\n", inputBytes / 1e6, outputBytes / 1e6, wallTime > 0.0 ? inputBytes / 1e3 / wallTime : 0.0);
+    }
+
+    if (cancelled > 0)
+        printf("Interrupted, %zu meshes cancelled\n", cancelled);
+
+    if (cache)
+        printf("Cache: %zu hits, %zu misses, %zu entries, %.1f MB\n", cache->hits(), cache->misses(), cache->entryCount(), cache->sizeBytes() / 1e6);
+
+    std::string report = options.report;
+    if (report.empty() && !options.batch.empty())
+        report = (outputRoot / "report.csv").string();
+    if (!report.empty() && writeReport(report, jobs, results))
+        printf("Report written to %s\n", report.c_str());
+    if (!options.memoryReport.empty() && writeMemoryReport(options.memoryReport, jobs, results))
+        printf("Memory report written to %s\n", options.memoryReport.c_str());
+    finishTrace(options);
+
+    return failed == 0 ? 0 : 1;
+}